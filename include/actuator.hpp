@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Owns GRINDER_ACTIVE_PIN. Callers ask for the grinder to run; how that maps onto relay edges
+// depends on the recipe's grindMode: continuous holds the relay while grinding, impulse
+// presses the grinder's own start/stop switch for RELAY_IMPULSE_US at the start and at the stop.
+// Timed edges are fired by a hardware timer interrupt, not by a task. The safety supervisor
+// (safety.hpp) can force a stop from its own interrupt and lock out further starts.
+
+// Requested and actual time of the last stop edge, in esp_timer_get_time() µs
+struct ActuatorStop
+{
+    int64_t deadline;
+    int64_t at;
+};
+
+//Methods
+void setupActuator();
+void actuatorStart();
+void actuatorRun(uint32_t durationUs);
+void actuatorStop();
+bool actuatorStopIn(uint32_t delayUs);
+bool actuatorRunning();
+unsigned long actuatorStoppedAt();
+ActuatorStop actuatorLastStop();
+int64_t actuatorOnTimeFromISR(int64_t now);
+void actuatorFailSafeFromISR();
+void actuatorUnlock();
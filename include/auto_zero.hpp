@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+#include "stability.hpp"
+
+// Correction applied since the last tare
+struct AutoZeroStats
+{
+    double drift;                   // g currently subtracted from every sample
+    double maxDrift;                // largest |drift| since the last tare
+    uint32_t corrections;           // steps taken since the last tare
+    uint32_t tareAt;                // millis() of the last tare
+    uint32_t lastCorrectionAt;      // millis() of the last step, 0 if none
+    bool saturated;                 // drift reached AUTO_ZERO_MAX_DRIFT, tracking paused until the next tare
+};
+
+//Methods
+void autoZeroReset();
+void autoZeroUpdate(const WeightStability &stability, bool idle, unsigned long now);
+double autoZeroDrift();
+AutoZeroStats autoZeroStats();
+void autoZeroPrintStats();
+String autoZeroJson();
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Calibration wizard states
+#define CALIBRATION_IDLE 0      // not calibrating
+#define CALIBRATION_READY 1     // waiting for the next known weight
+#define CALIBRATION_CAPTURING 2 // averaging samples of the weight on the scale
+#define CALIBRATION_DONE 3      // fitted; residuals are valid
+#define CALIBRATION_FAILED 4    // fit rejected, nothing was applied
+
+struct CalibrationStatus
+{
+    uint8_t state;
+    uint8_t points;      // captured known weights (the tare is the implicit zero point)
+    uint8_t progress;    // samples of the running capture, out of CALIBRATION_SAMPLES
+    double weight;       // known weight the next capture is recorded as
+    double factor;       // fitted counts per gram at zero
+    double curvature;    // fitted g per count^2
+    double maxResidual;  // largest |fitted - known| in g over all points
+};
+
+// Raw HX711 counts to grams. Owns the tare offset, the calibrated factor and the linearity
+// term; the linear part is folded into gain and bias whenever one of them changes, so a
+// sample costs one multiply-add (plus the curvature term after a multi-point calibration).
+class CalibrationModel
+{
+    public:
+        CalibrationModel(double factor) { set(0, factor, 0); }
+        void set(long offset, double factor, double curvature)
+        {
+            this->offset = offset;
+            this->factor = factor;
+            this->curvature = curvature;
+            gain = 1 / factor;
+            bias = -offset * gain;
+        }
+        void setOffset(long offset) { set(offset, factor, curvature); }
+        void setCalibration(double factor, double curvature) { set(offset, factor, curvature); }
+        double grams(long raw) const
+        {
+            double g = raw * gain + bias;
+            if (curvature != 0) {
+                double c = raw - offset;
+                g += curvature * c * c;
+            }
+            return g;
+        }
+        long counts(long raw) const { return raw - offset; } // above the tare
+        double countsToGrams(double counts) const { return counts * gain; } // linear part, for spreads
+        long getOffset() const { return offset; }
+        double getFactor() const { return factor; }
+        double getCurvature() const { return curvature; }
+    private:
+        long offset;
+        double factor;    // counts per gram, as calibrated and stored
+        double curvature; // g per count^2
+        double gain;      // 1 / factor
+        double bias;      // -offset * gain
+};
+
+//Methods
+void calibrationBegin();
+void calibrationCancel();
+void calibrationAdjustWeight(double delta);
+bool calibrationCapture();
+void calibrationFeed(long counts, bool stable);
+bool calibrationFinish();
+CalibrationStatus calibrationStatus();
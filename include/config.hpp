@@ -1,6 +1,5 @@
 #pragma once
 
-#include <SimpleKalmanFilter.h>
 #include "HX711.h"
 #include <MathBuffer.h>
 #include <AiEsp32RotaryEncoder.h>
@@ -12,7 +11,6 @@
 // Declarations of global variables (no memory allocation here)
 extern Preferences preferences;       // Preferences object
 extern HX711 loadcell;                // HX711 load cell object
-extern SimpleKalmanFilter kalmanFilter; // Kalman filter for smoothing weight measurements
 
 extern TaskHandle_t ScaleTask;        // Task handle for the scale task
 extern TaskHandle_t ScaleStatusTask;  // Task handle for the scale status task
@@ -41,13 +39,16 @@ class MenuItem
 
 #define CUP_WEIGHT 70
 #define CUP_DETECTION_TOLERANCE 5 // 5 grams tolerance above or bellow cup weight to detect it
+#define CUP_REGISTRY_SIZE 12 // known cups and portafilters (NVS namespace "cups")
+#define CUP_MATCH_HYSTERESIS 1.0 // g; a recognised cup is kept until another one is this much closer
 
 #define LOADCELL_DOUT_PIN 16
 #define LOADCELL_SCK_PIN 17
 
 #define LOADCELL_SCALE_FACTOR 1409.88
 
-#define TARE_MEASURES 20 // use the average of measure for taring
+#define TARE_MEASURES 10 // use the average of measure for taring, one per sampling cycle
+#define TARE_MAX_MISSES 5 // consecutive HX711 timeouts before a tare fails
 #define SIGNIFICANT_WEIGHT_CHANGE 5 // 5 grams changes are used to detect a significant change
 #define COFFEE_DOSE_WEIGHT 18
 #define COFFEE_DOSE_OFFSET -2.5
@@ -55,12 +56,44 @@ class MenuItem
 #define GRINDING_FAILED_WEIGHT_TO_RESET 150 // force on balance need to be measured to reset grinding
 
 #define GRINDER_ACTIVE_PIN 14
+#define DEFAULT_GRIND_MODE true // true = continuous (relay held while grinding), false = impulse (start/stop presses)
+#define RELAY_IMPULSE_US 100000 // press length in impulse mode
+#define ACTUATOR_TIMER 0 // hardware timer that fires timed relay edges
+
+// Safety supervisor
+#define SAFETY_TIMER 1 // hardware timer of the supervisor, independent of ACTUATOR_TIMER
+#define SAFETY_CHECK_US 50000 // supervisor period
+#define SAFETY_MAX_ON_MS 60000 // absolute relay on-time in every mode, manual and scale only included
+#define SAFETY_HEARTBEAT_MS 1000 // a running grinder is stopped if acquisition or control is silent this long
+#define SAFETY_WDT_TIMEOUT_S 8 // task watchdog: a wedged acquisition or control task reboots the board
+
+// Stop strategies
+#define STOP_WEIGHT 0 // grind until the target weight
+#define STOP_TIME 1 // grind for the recipe's time
+#define STOP_WEIGHT_TOPUP 2 // grind by weight, then top up an under-dose with short bursts
+#define DEFAULT_STOP_MODE STOP_WEIGHT
+#define COFFEE_GRIND_TIME 10.0 // s
+#define TOPUP_MIN_DEFICIT 0.2 // g short of the target before a burst is fired
+#define TOPUP_MAX_PULSES 3 // bursts per shot
+#define TOPUP_MIN_PULSE_US 30000
+#define TOPUP_MAX_PULSE_US 1000000
+#define CUTOFF_HORIZON_US 250000 // arm the predicted cutoff once it is less than this ahead
+#define CUTOFF_MIN_FLOW 0.2 // g/s; below this no cutoff time is predicted
+#define CUTOFF_MAX_DELAY_US 2000000 // an armed cutoff never lies further ahead than this
 
 #define GRIND_BUTTON_PIN 25
 #define DEFAULT_GRIND_TRIGGER_MODE true  // true = use button, false = cup detection
 #define AUTO_OFFSET_ADJUSTMENT true     // Enable automatic offset adjustment after grinding
 
-#define TARE_MIN_INTERVAL 10 * 1000 // auto-tare at most once every 10 seconds
+#define TARE_MIN_INTERVAL 10 * 1000 // auto-tare at most once every 10 seconds; also the auto-zero hold-off after a tare or grind
+
+// Auto-zero: follows slow drift of an empty, idle, stable scale (see auto_zero.cpp)
+#define AUTO_ZERO_BAND 1.0 // g; readings further from zero mean something is on the scale
+#define AUTO_ZERO_DEADBAND 0.05 // g; closer to zero than this needs no correction
+#define AUTO_ZERO_GAIN 0.2 // fraction of the reading corrected per step
+#define AUTO_ZERO_STEP 0.02 // g, largest single correction
+#define AUTO_ZERO_INTERVAL 1000 // ms between corrections
+#define AUTO_ZERO_MAX_DRIFT 3.0 // g; beyond this tracking stops until the next tare
 
 #define ROTARY_ENCODER_A_PIN 23
 #define ROTARY_ENCODER_B_PIN 32
@@ -72,6 +105,101 @@ class MenuItem
 #define OLED_SDA 21
 #define OLED_SCL 22
 
+// Task topology. Acquisition and control own the application core (1) above everything else
+// there; display, network and statistics run at low priority on the protocol core (0).
+// Build with -DTASK_TOPOLOGY_FLAT=1 for the old layout (all on core 1 at idle priority) to
+// compare the sample_jitter and relay_latency probes.
+#ifndef TASK_TOPOLOGY_FLAT
+#define TASK_TOPOLOGY_FLAT 0
+#endif
+#if TASK_TOPOLOGY_FLAT
+#define ACQUISITION_TASK_CORE 1
+#define ACQUISITION_TASK_PRIORITY 0
+#define CONTROL_TASK_CORE 1
+#define CONTROL_TASK_PRIORITY 0
+#define UI_TASK_CORE 1
+#define UI_TASK_PRIORITY 0
+#else
+#define ACQUISITION_TASK_CORE 1 // updateScale
+#define ACQUISITION_TASK_PRIORITY 5
+#define CONTROL_TASK_CORE 1 // scaleStatusLoop
+#define CONTROL_TASK_PRIORITY 4
+#define UI_TASK_CORE 0 // display and its helper tasks
+#define UI_TASK_PRIORITY 1
+#endif
+#define NETWORK_TASK_CORE 0 // MQTT
+#define NETWORK_TASK_PRIORITY 1
+#define STATS_TASK_CORE 0
+#define STATS_TASK_PRIORITY 0
+
+// Weight filter (see filter.hpp): median spike rejection, step detection, flow-adaptive Kalman
+#define FILTER_MEDIAN_WINDOW 3 // samples, odd; 1 disables spike rejection
+#define FILTER_STEP_THRESHOLD 2.0 // grams off the estimate that count as a step; 0 disables step detection
+#define FILTER_STEP_CONFIRM 2 // consecutive samples beyond the threshold before the filter restarts
+#define FILTER_MEASUREMENT_NOISE 0.02 // g^2
+#define FILTER_PROCESS_NOISE 0.01 // g^2/s at rest
+#define FILTER_FLOW_NOISE 0.25 // extra process noise per (g/s)^2 of flow; 0 for a fixed Kalman filter
+
+// Stable weight: spread and slope over a sliding window of the weight history. The window has
+// to hold STABLE_MIN_SAMPLES at the idle rate (averaged reads, about 2 Hz at 10 SPS).
+#define STABLE_WINDOW 1500 // ms
+#define STABLE_MIN_SAMPLES 3
+#define STABLE_MAX_STDDEV 0.1 // g
+#define STABLE_MAX_SLOPE 0.2 // g/s
+#define STABLE_SETTLE_TIMEOUT 5000 // ms after the grinder stops before the offset is learned unsettled
+#define TARE_MAX_SPREAD 0.5 // g between the tare readings before the tare is cancelled
+
+// Calibration wizard (see calibration.cpp)
+#define CALIBRATION_MAX_POINTS 6 // known weights per calibration
+#define CALIBRATION_SAMPLES 6 // stable samples averaged per known weight
+#define CALIBRATION_DEFAULT_WEIGHT 100 // g, first weight offered
+#define CALIBRATION_WEIGHT_STEP 1 // g per encoder detent
+
+#define SCALE_SAMPLE_INTERVAL 100 // ms between HX711 samples (10 Hz)
+#define HX711_POLL_INTERVAL 1 // ms slept between HX711 ready checks; 0 only yields to equal priorities
+#define HX711_SPS 10 // conversion rate set by the board's RATE pin (10 or 80)
+#define HX711_CONVERSION_MS (1000 / HX711_SPS)
+// Longest wait for one conversion: two periods plus scheduling slack. A missed conversion and
+// the next one have to fit well inside SAFETY_HEARTBEAT_MS (checked in scale.cpp).
+#define HX711_READY_TIMEOUT_MS (2 * HX711_CONVERSION_MS + 50)
+#define DISPLAY_FRAME_INTERVAL 50 // ms between display frames
+
+// MQTT (broker host/port are stored in the "mqtt" preferences namespace)
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_QUEUE_SIZE 64 // records buffered in RAM while the broker is unreachable
+#define MQTT_TELEMETRY_HEADROOM 16 // queue slots telemetry may never fill, reserved for shot summaries
+#define MQTT_BURST_SIZE 16 // records flushed per burst
+#define MQTT_FLUSH_INTERVAL 2000 // ms between bursts
+#define MQTT_RECONNECT_INTERVAL 5000 // ms between broker reconnect attempts
+#define MQTT_TELEMETRY_DECIMATION 10 // publish every 10th weight sample (1 Hz at 10 Hz sampling)
+
+// Latency probes (see probe.hpp); build with -DPROBES_ENABLED=0 to compile them out
+#ifndef PROBES_ENABLED
+#define PROBES_ENABLED 1
+#endif
+
+// Task and heap statistics
+#define TASK_STATS_INTERVAL 5000 // ms between snapshots
+#define TASK_STATS_RING_SIZE 12 // snapshots kept (one minute at the default interval)
+#define TASK_STATS_MAX_TASKS 20 // tasks recorded per snapshot
+#define CPU_IDLE_GAP_US 20 // longest gap between idle hook calls still counted as idle (covers the tick interrupt)
+
+// Shot log (NVS namespace "shots")
+#define SHOT_LOG_BLOCKS 20 // blocks in the ring; the oldest block is dropped when it is full
+#define SHOT_LOG_BLOCK_SIZE 248 // bytes of records per block, about 60 shots
+#define SHOT_LOG_PAGE_MAX 50 // shots returned per page
+
+// Recipes (NVS namespace "recipes")
+#define RECIPE_COUNT 4
+#define RECIPE_NAME_LENGTH 12 // including the terminator
+#define RECIPE_SAVE_DELAY 3000 // ms without further edits before the recipe table is written
+
+// Dose accuracy quantiles, one set per recipe
+#define DOSE_STATS_SLOTS RECIPE_COUNT
+
+// OTA (credentials are stored in the "ota" preferences namespace)
+#define OTA_DEFAULT_USER "admin"
+
 // External User Variables
 extern volatile bool displayLock; // Add this declaration
 extern double scaleWeight;
@@ -83,13 +211,9 @@ extern int scaleStatus;
 extern double cupWeightEmpty;
 extern unsigned long startedGrindingAt;
 extern unsigned long finishedGrindingAt;
-extern double setWeight;
-extern double offset;
 extern bool scaleMode;
-extern bool grindMode;
 extern bool greset;
 extern int menuItemsCount;
-extern double setCupWeight;
 extern MenuItem menuItems[];
 extern int currentMenuItem;
 extern int currentSetting;
@@ -105,4 +229,5 @@ extern unsigned int shotCount;
 extern bool useButtonToGrind;
 extern bool showingTaringMessage;
 extern unsigned long taringMessageStartTime;
-extern bool manualGrindMode;
\ No newline at end of file
+extern bool manualGrindMode;
+extern volatile bool otaInProgress;
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// A known cup or portafilter and the recipe it starts
+struct __attribute__((packed)) CupEntry
+{
+    float weight;   // g, empty
+    uint8_t recipe; // recipe index
+};
+
+//Methods
+void setupCups();
+int cupMatch(double weight, bool &changed);
+void cupForget();
+bool cupRegister(double weight, int recipe);
+bool cupRemove(int index);
+int cupCount();
+CupEntry cupAt(int index);
+void cupsReset();
+void cupsPrint();
+String cupsJson();
@@ -12,5 +12,5 @@ void showModeMenu();
 void showConfigMenu();
 void wakeScreen();
 void showIpAddress();
-void showTaringMessage();
+bool showTaringMessage();
 void showModeChangeMessage(const char* mode, const char* status);
\ No newline at end of file
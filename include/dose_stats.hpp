@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Quantiles of the successful shots of one slot, estimated on the fly (see quantile.hpp)
+struct DoseStatsSummary
+{
+    uint32_t shots;
+    float error[3];     // |actual - target| in g: p50, p95, p99
+    float overshoot[3]; // g that landed after the relay was cut: p5, p50, p95
+    float time[3];      // grind time in s: p5, p50, p95
+};
+
+//Methods
+void setupDoseStats();
+void doseStatsRecord(int slot, double error, double overshoot, unsigned long grindTimeMs);
+DoseStatsSummary doseStatsSummary(int slot);
+void doseStatsReset();
+void doseStatsPrint();
+String doseStatsJson();
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stddef.h>
+
+// Weight filter pipeline: spike rejection, then step detection, then smoothing. Every stage
+// is a template parameter, so a stage that is switched off is a PassStage and compiles away.
+// No Arduino dependencies: tools/filter_bench.cpp replays recorded traces through it on a PC.
+
+// Leaves samples untouched and never reports a step
+class PassStage
+{
+    public:
+        template <typename... Args>
+        PassStage(Args...) {}
+        double update(double x, double = 0) { last = x; return x; }
+        bool step(double, double) { return false; }
+        void reset(double x) { last = x; }
+        double estimate() const { return last; }
+        double flowRate() const { return 0; }
+    private:
+        double last = 0;
+};
+
+// Median of the last N samples. Removes isolated spikes and costs (N - 1) / 2 samples of delay.
+template <size_t N>
+class MedianStage
+{
+    static_assert(N % 2 == 1, "MedianStage needs an odd window");
+
+    public:
+        double update(double x, double = 0)
+        {
+            window[next] = x;
+            next = (next + 1) % N;
+            if (count < N) {
+                count++;
+            }
+            double sorted[N];
+            for (size_t i = 0; i < count; i++) {
+                size_t j = i;
+                for (; j > 0 && sorted[j - 1] > window[i]; j--) {
+                    sorted[j] = sorted[j - 1];
+                }
+                sorted[j] = window[i];
+            }
+            return sorted[count / 2];
+        }
+        void reset(double x)
+        {
+            for (size_t i = 0; i < N; i++) {
+                window[i] = x;
+            }
+            count = N;
+        }
+    private:
+        double window[N];
+        size_t next = 0;
+        size_t count = 0;
+};
+
+// Reports a step once `confirm` consecutive samples are more than `threshold` grams away from
+// the smoothed estimate, e.g. a cup placed or lifted. The pipeline then restarts the smoother
+// at the new level instead of letting it crawl there.
+class StepStage
+{
+    public:
+        StepStage(double threshold, int confirm) : threshold(threshold), confirm(confirm) {}
+        bool step(double x, double estimate)
+        {
+            double distance = x - estimate;
+            if (distance > threshold || distance < -threshold) {
+                if (++outside >= confirm) {
+                    outside = 0;
+                    return true;
+                }
+            } else {
+                outside = 0;
+            }
+            return false;
+        }
+        void reset(double) { outside = 0; }
+    private:
+        double threshold;
+        int confirm;
+        int outside = 0;
+};
+
+// Scalar Kalman filter for a random-walk weight. The process noise grows with the square of
+// the current flow rate, so the estimate is very smooth at rest and keeps up while grinding.
+// With flowNoise 0 this is a plain fixed-noise Kalman filter.
+class AdaptiveKalmanStage
+{
+    public:
+        // Variances in g^2 (measurement) and g^2/s (process); flowNoise is in s
+        AdaptiveKalmanStage(double measurementNoise, double processNoise, double flowNoise)
+            : measurementNoise(measurementNoise), processNoise(processNoise), flowNoise(flowNoise) {}
+        double update(double z, double dt)
+        {
+            if (!primed) {
+                reset(z);
+                return x;
+            }
+            double previous = x;
+            p += (processNoise + flowNoise * flow * flow) * dt;
+            double k = p / (p + measurementNoise);
+            x += k * (z - x);
+            p *= 1 - k;
+            if (dt > 0) {
+                flow += FLOW_SMOOTHING * ((x - previous) / dt - flow);
+            }
+            return x;
+        }
+        void reset(double z)
+        {
+            x = z;
+            p = measurementNoise;
+            flow = 0;
+            primed = true;
+        }
+        double estimate() const { return x; }
+        double flowRate() const { return flow; } // g/s
+    private:
+        static constexpr double FLOW_SMOOTHING = 0.3;
+        double measurementNoise;
+        double processNoise;
+        double flowNoise;
+        double x = 0;
+        double p = 0;
+        double flow = 0;
+        bool primed = false;
+};
+
+template <typename Spike, typename Step, typename Smooth>
+class FilterPipeline
+{
+    public:
+        FilterPipeline(const Spike &spike, const Step &step, const Smooth &smooth)
+            : spike(spike), stepDetector(step), smooth(smooth) {}
+        // dt is the time since the previous sample in seconds
+        double update(double x, double dt)
+        {
+            x = spike.update(x);
+            if (stepDetector.step(x, smooth.estimate())) {
+                smooth.reset(x);
+            }
+            return smooth.update(x, dt);
+        }
+        // Restarts every stage at x, e.g. 0 after a tare
+        void reset(double x)
+        {
+            spike.reset(x);
+            stepDetector.reset(x);
+            smooth.reset(x);
+        }
+        double flowRate() const { return smooth.flowRate(); }
+    private:
+        Spike spike;
+        Step stepDetector;
+        Smooth smooth;
+};
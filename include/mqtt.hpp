@@ -0,0 +1,21 @@
+#pragma once
+
+#include "config.hpp"
+
+// Shot outcome reported with every shot summary
+#define GRIND_RESULT_OK 0
+#define GRIND_RESULT_CUP_REMOVED 1
+#define GRIND_RESULT_SCALE_NOT_READY 2
+#define GRIND_RESULT_MAX_TIME 3
+#define GRIND_RESULT_NO_FLOW 4
+#define GRIND_RESULT_ABORTED 5
+#define GRIND_RESULT_SAFETY 6
+
+//Methods
+void setupMqtt();
+bool mqttConfigure(const char *host, uint16_t port, bool telemetry);
+void mqttPrintStatus();
+String mqttStatusJson();
+void mqttPublishShot(double target, double actual, unsigned long grindTimeMs, double offsetUsed, int result);
+void mqttPublishWeight(double weight);
+const char *grindResultName(int result);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+
+//Methods
+void setupOtaEndpoint(AsyncWebServer &server);
+bool otaConfigure(const char *password);
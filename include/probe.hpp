@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Probe ids; names are listed in probe.cpp
+#define PROBE_HX711_WAIT 0    // wait_ready_timeout in updateScale
+#define PROBE_HX711_READ 1    // HX711 conversion(s) in updateScale
+#define PROBE_FILTER 2        // calibration, drift correction and the filter pipeline
+#define PROBE_DECISION 3      // one scaleStatusLoop iteration, without the idle delay
+#define PROBE_RELAY_LATENCY 4 // scheduled to actual relay-off edge
+#define PROBE_RELAY_SWITCH 5  // actuatorStart/Run/Stop
+#define PROBE_DISPLAY_SEND 6  // screen.sendBuffer
+#define PROBE_NVS_WRITE 7     // preferences writes on the grind path
+#define PROBE_SAMPLE_JITTER 8 // deviation of the sample period from SCALE_SAMPLE_INTERVAL while grinding
+#define PROBE_CUTOFF_ERROR 9  // |predicted cutoff - interpolated target crossing| per shot
+#define PROBE_COUNT 10
+
+// Bucket 0 counts samples under 1 us, bucket i samples in [2^(i-1), 2^i) us;
+// the last bucket also takes everything longer
+#define PROBE_BUCKETS 20
+
+// Timestamps are CCOUNT cycles of the calling core, so a start and its stop
+// (or a mark and its PROBE_SINCE_MARK) have to run on the same core
+static inline uint32_t probeNow() { return ESP.getCycleCount(); }
+
+//Methods
+void probeRecord(int id, uint32_t cycles);
+void probeMark(int id);
+void probeSinceMark(int id);
+void probeJitter(int id, uint32_t periodUs);
+void probeReset();
+void probePrintReport();
+String probeReportJson();
+
+#if PROBES_ENABLED
+
+// Records the time until stop() or the end of the enclosing scope, whichever comes first
+class ProbeScope
+{
+    public:
+        ProbeScope(int id) : id(id), start(probeNow()), done(false) {}
+        ~ProbeScope() { stop(); }
+        void stop()
+        {
+            if (!done) {
+                done = true;
+                probeRecord(id, probeNow() - start);
+            }
+        }
+    private:
+        int id;
+        uint32_t start;
+        bool done;
+};
+
+#define PROBE_START(var) uint32_t var = probeNow()
+#define PROBE_STOP(id, var) probeRecord((id), probeNow() - (var))
+#define PROBE_SCOPE(var, id) ProbeScope var(id)
+#define PROBE_SCOPE_END(var) var.stop()
+#define PROBE_MARK(id) probeMark(id)
+#define PROBE_SINCE_MARK(id) probeSinceMark(id)
+#define PROBE_JITTER(id, periodUs) probeJitter((id), (periodUs))
+#define PROBE_US(id, us) probeRecord((id), (uint32_t)(us) * getCpuFrequencyMhz())
+
+#else
+
+#define PROBE_START(var)
+#define PROBE_STOP(id, var)
+#define PROBE_SCOPE(var, id)
+#define PROBE_SCOPE_END(var)
+#define PROBE_MARK(id)
+#define PROBE_SINCE_MARK(id)
+#define PROBE_JITTER(id, periodUs)
+#define PROBE_US(id, us)
+
+#endif
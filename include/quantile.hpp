@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming estimate of M quantiles with the extended P² algorithm (Jain & Chlamtac;
+// Raatikainen): 2M + 3 markers follow the minimum, the maximum, each quantile and the
+// midpoints between them. An update is O(M) with no allocation and no stored samples, and
+// the whole state is the plain State struct, so it can be saved to flash as a blob.
+template <size_t M>
+class P2Quantiles
+{
+    public:
+        static const size_t MARKERS = 2 * M + 3;
+
+        struct State
+        {
+            uint32_t count;
+            float heights[MARKERS];
+            uint32_t positions[MARKERS]; // 1-based ranks; implicit while count < MARKERS
+        };
+
+        // quantiles must be ascending and within (0, 1)
+        P2Quantiles(const float (&quantiles)[M])
+        {
+            fractions[0] = 0;
+            for (size_t i = 0; i < M; i++) {
+                float previous = i == 0 ? 0 : quantiles[i - 1];
+                fractions[2 * i + 1] = (previous + quantiles[i]) / 2;
+                fractions[2 * i + 2] = quantiles[i];
+            }
+            fractions[MARKERS - 2] = (quantiles[M - 1] + 1) / 2;
+            fractions[MARKERS - 1] = 1;
+            reset();
+        }
+
+        void reset() { state = {}; }
+
+        void update(float x)
+        {
+            float *h = state.heights;
+            uint32_t *n = state.positions;
+            if (state.count < MARKERS) {
+                // Insertion sort of the first samples; they become the initial markers
+                size_t i = state.count++;
+                for (; i > 0 && h[i - 1] > x; i--) {
+                    h[i] = h[i - 1];
+                }
+                h[i] = x;
+                for (size_t j = 0; j < MARKERS; j++) {
+                    n[j] = j + 1;
+                }
+                return;
+            }
+
+            size_t k;
+            if (x < h[0]) {
+                h[0] = x;
+                k = 0;
+            } else if (x >= h[MARKERS - 1]) {
+                h[MARKERS - 1] = x;
+                k = MARKERS - 2;
+            } else {
+                for (k = 0; k < MARKERS - 2 && x >= h[k + 1]; k++) {
+                }
+            }
+            for (size_t i = k + 1; i < MARKERS; i++) {
+                n[i]++;
+            }
+            state.count++;
+
+            // Move the inner markers towards their desired ranks, one rank at a time
+            for (size_t i = 1; i < MARKERS - 1; i++) {
+                float d = 1 + (state.count - 1) * fractions[i] - n[i];
+                int step = 0;
+                if (d >= 1 && n[i + 1] - n[i] > 1) {
+                    step = 1;
+                } else if (d <= -1 && n[i] - n[i - 1] > 1) {
+                    step = -1;
+                }
+                if (step == 0) {
+                    continue;
+                }
+                float candidate = parabolic(i, step);
+                if (h[i - 1] < candidate && candidate < h[i + 1]) {
+                    h[i] = candidate;
+                } else {
+                    h[i] = linear(i, step);
+                }
+                n[i] += step;
+            }
+        }
+
+        // Estimate of quantiles[index]; exact (nearest rank) while fewer than MARKERS samples
+        float quantile(size_t index) const
+        {
+            if (state.count == 0) {
+                return 0;
+            }
+            float q = fractions[2 * index + 2];
+            if (state.count < MARKERS) {
+                size_t rank = (size_t)(q * (state.count - 1) + 0.5f);
+                return state.heights[rank];
+            }
+            return state.heights[2 * index + 2];
+        }
+
+        float min() const { return state.count ? state.heights[0] : 0; }
+        float max() const
+        {
+            if (state.count == 0) {
+                return 0;
+            }
+            return state.heights[state.count < MARKERS ? state.count - 1 : MARKERS - 1];
+        }
+        uint32_t count() const { return state.count; }
+
+        const State &save() const { return state; }
+        void restore(const State &saved) { state = saved; }
+
+    private:
+        float parabolic(size_t i, int d) const
+        {
+            const float *h = state.heights;
+            const uint32_t *n = state.positions;
+            float ni = n[i], nl = n[i - 1], nr = n[i + 1];
+            return h[i] + d / (nr - nl) *
+                ((ni - nl + d) * (h[i + 1] - h[i]) / (nr - ni) + (nr - ni - d) * (h[i] - h[i - 1]) / (ni - nl));
+        }
+
+        float linear(size_t i, int d) const
+        {
+            const float *h = state.heights;
+            const uint32_t *n = state.positions;
+            float other = (float)n[i + d] - (float)n[i];
+            return h[i] + d * (h[i + d] - h[i]) / other;
+        }
+
+        float fractions[MARKERS];
+        State state;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// One named set of grind settings. All RECIPE_COUNT recipes are kept in RAM and stored
+// together as a single blob, so the layout is packed and must only ever grow at the end.
+struct __attribute__((packed)) Recipe
+{
+    char name[RECIPE_NAME_LENGTH];
+    float dose;        // g, target weight
+    float cup;         // g, last cup registered for this recipe; detection uses cups.hpp
+    float offset;      // g, learned stop offset
+    float time;        // s, grind time for STOP_TIME
+    uint8_t grindMode; // relay drive: 1 = continuous, 0 = impulse
+    uint8_t stopMode;  // STOP_*
+};
+
+// The active recipe. Switching recipes only moves this pointer; nothing is written to flash.
+extern Recipe *recipe;
+
+//Methods
+void setupRecipes();
+bool recipeSelect(int index);
+bool recipeRequest(int index);
+int recipeRequested();
+void recipeApplyRequest();
+int recipeIndex();
+const Recipe &recipeAt(int index);
+void recipeChanged();
+void recipeFlush();
+void recipeCommitActive();
+void recipeReset();
+void recipePrint();
+String recipesJson();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Supervises the grinder independently of the grind logic. A periodic hardware timer interrupt
+// stops a running grinder once it has been on for SAFETY_MAX_ON_MS, or when the acquisition
+// or control task has not reported for SAFETY_HEARTBEAT_MS. Both tasks also feed the task
+// watchdog, which reboots the board if one of them wedges for good.
+
+// Supervised tasks
+#define SAFETY_ACQUISITION 0
+#define SAFETY_CONTROL 1
+#define SAFETY_TASKS 2
+
+// Why the supervisor stopped the grinder
+#define SAFETY_OK 0
+#define SAFETY_TRIP_ON_TIME 1
+#define SAFETY_TRIP_ACQUISITION 2
+#define SAFETY_TRIP_CONTROL 3
+
+//Methods
+void setupSafety();
+void safetyWatchTask();
+void safetyFeed();
+void safetyHeartbeat(int task);
+int safetyTrip();
+void safetyClear();
+const char *safetyTripName(int reason);
@@ -1,5 +1,26 @@
 #pragma once
 
+#include "stability.hpp"
+
+// Tare progress states
+#define TARE_IDLE 0
+#define TARE_RUNNING 1
+#define TARE_DONE 2
+#define TARE_FAILED 3
+
+struct TareProgress
+{
+    uint8_t state;
+    uint8_t samples;          // collected so far, out of TARE_MEASURES
+    unsigned long finishedAt; // millis() when the last tare completed or failed
+};
+
 //Methods
 void setupScale();
-bool tareScale();
\ No newline at end of file
+bool tareScale();
+TareProgress tareProgress();
+uint32_t requestGrinderStop();
+bool grinderStopped(uint32_t ticket);
+bool toggleSampleTrace();
+WeightStability scaleStability();
+void setCalibration(double factor, double curvature);
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// What started the shot
+#define SHOT_TRIGGER_CUP 0
+#define SHOT_TRIGGER_BUTTON 1
+
+// One decoded shot. Stored with 0.1 g target, 0.01 g error and offset, 0.1 s time resolution.
+struct ShotRecord
+{
+    uint32_t seq;         // shot number since the log was created
+    float target;         // g
+    float actual;         // g
+    uint32_t grindTimeMs;
+    float offset;         // g, offset the shot was ground with
+    uint8_t trigger;      // SHOT_TRIGGER_*
+    uint8_t result;       // GRIND_RESULT_*
+};
+
+//Methods
+void setupShotLog();
+void shotLogRecord(double target, double actual, unsigned long grindTimeMs, double offset, int trigger, int result);
+uint32_t shotLogTotal();
+size_t shotLogPage(uint32_t page, size_t pageSize, ShotRecord *out);
+String shotLogPageJson(uint32_t page, size_t pageSize);
+void shotLogPrintRecent(size_t count);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include <MathBuffer.h>
+
+// Result of the last stability evaluation
+struct WeightStability
+{
+    bool stable;               // Spread and slope over the window are within limits
+    double value;              // Window mean while stable, latest sample otherwise
+    double stdDev;             // g
+    double slope;              // g/s, least-squares fit over the window
+    unsigned long settledAt;   // millis() of the last unstable -> stable transition, 0 if never
+    unsigned long settleTimeMs; // How long the weight was moving before settledAt
+};
+
+// Decides whether the weight has settled from the spread and the trend of the samples in a
+// sliding window. Evaluate after every push to the history so transitions are timed per sample.
+class StabilityDetector
+{
+    public:
+        StabilityDetector(unsigned long windowMs, double maxStdDev, double maxSlope, size_t minSamples)
+            : windowMs(windowMs), maxStdDev(maxStdDev), maxSlope(maxSlope), minSamples(minSamples) {}
+
+        template <typename T, size_t S>
+        const WeightStability &update(MathBuffer<T, S> &history, unsigned long now)
+        {
+            // Sums for mean, variance and slope; time is relative to now to keep the terms small
+            double n = 0, sumT = 0, sumX = 0, sumTT = 0, sumTX = 0, sumXX = 0, latest = 0;
+            history.executeOnSamplesSince((int64_t)now - windowMs, [&](T value, int64_t ms) {
+                double t = (ms - (int64_t)now) / 1000.0;
+                if (n == 0) {
+                    latest = value;
+                }
+                n++;
+                sumT += t;
+                sumX += value;
+                sumTT += t * t;
+                sumTX += t * value;
+                sumXX += value * value;
+            });
+
+            bool wasStable = result.stable;
+            if (n < minSamples) {
+                result.stable = false;
+                result.value = latest;
+                result.stdDev = 0;
+                result.slope = 0;
+            } else {
+                double mean = sumX / n;
+                double variance = sumXX / n - mean * mean;
+                double spreadT = sumTT - sumT * sumT / n;
+                result.stdDev = variance > 0 ? sqrt(variance) : 0;
+                result.slope = spreadT > 0 ? (sumTX - sumT * sumX / n) / spreadT : 0;
+                result.stable = result.stdDev <= maxStdDev && fabs(result.slope) <= maxSlope;
+                result.value = result.stable ? mean : latest;
+            }
+
+            if (!result.stable && (wasStable || movingSince == 0)) {
+                movingSince = now;
+            } else if (result.stable && !wasStable) {
+                result.settledAt = now;
+                result.settleTimeMs = movingSince ? now - movingSince : 0;
+            }
+            return result;
+        }
+
+        const WeightStability &last() const { return result; }
+
+    private:
+        unsigned long windowMs;
+        double maxStdDev;
+        double maxSlope;
+        size_t minSamples;
+        unsigned long movingSince = 0;
+        WeightStability result = {};
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// One task in a snapshot
+struct TaskStatsEntry
+{
+    char name[16];
+    uint32_t stackFree; // bytes never used since the task started (high water mark)
+    int8_t core;        // pinned core, -1 when unpinned or unknown
+};
+
+struct TaskStatsSnapshot
+{
+    uint32_t at; // millis()
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    uint8_t cpuBusy[portNUM_PROCESSORS]; // percent of each core's time not spent idle since the previous snapshot
+    uint8_t taskCount;
+    TaskStatsEntry tasks[TASK_STATS_MAX_TASKS];
+};
+
+//Methods
+void setupTaskStats();
+bool taskStatsLatest(TaskStatsSnapshot &out);
+void taskStatsPrintLatest();
+String taskStatsJson();
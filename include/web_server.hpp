@@ -3,3 +3,5 @@
 
 // Function to initialize the web server
 void setupWebServer();
+void connectToWiFi();
+bool wifiConfigure(const char *ssid, const char *pass);
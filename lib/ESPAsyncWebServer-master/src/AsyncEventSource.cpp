@@ -19,11 +19,6 @@
 */
 #include "Arduino.h"
 #include "AsyncEventSource.h"
-#ifdef ESP32
-#if ESP_IDF_VERSION_MAJOR >= 5
-#include "rom/ets_sys.h"
-#endif
-#endif
 
 static String generateEventMessage(const char *message, const char *event, uint32_t id, uint32_t reconnect){
   String ev = "";
@@ -109,49 +104,52 @@ static String generateEventMessage(const char *message, const char *event, uint3
   return ev;
 }
 
-// Message
+// Payload
 
-AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
-: _data(nullptr), _len(len), _sent(0), _acked(0)
-{
-  _data = (uint8_t*)malloc(_len+1);
-  if(_data == nullptr){
-    _len = 0;
-  } else {
-    memcpy(_data, data, len);
-    _data[_len] = 0;
+static ASYNCWEB_POOL_LOCK_TYPE _ssePayloadLock = ASYNCWEB_POOL_LOCK_INIT;
+
+AsyncEventSourcePayload * AsyncEventSourcePayload::create(const char * data, size_t len){
+  void * mem = malloc(sizeof(AsyncEventSourcePayload) + len + 1);
+  if(mem == NULL)
+    return NULL;
+  AsyncEventSourcePayload * p = new (mem) AsyncEventSourcePayload(len);
+  char * buf = (char *)(p + 1);
+  memcpy(buf, data, len);
+  buf[len] = 0;
+  return p;
+}
+
+void AsyncEventSourcePayload::retain(){
+  ASYNCWEB_POOL_ENTER(_ssePayloadLock);
+  _refs++;
+  ASYNCWEB_POOL_EXIT(_ssePayloadLock);
+}
+
+void AsyncEventSourcePayload::release(){
+  ASYNCWEB_POOL_ENTER(_ssePayloadLock);
+  bool last = --_refs == 0;
+  ASYNCWEB_POOL_EXIT(_ssePayloadLock);
+  if(last){
+    this->~AsyncEventSourcePayload();
+    free(this);
   }
 }
 
+// Message
+
+AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
+: _payload(AsyncEventSourcePayload::create(data, len))
+{}
+
 AsyncEventSourceMessage::~AsyncEventSourceMessage() {
-     if(_data != NULL)
-        free(_data);
-}
-
-size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
-  (void)time;
-  // If the whole message is now acked...
-  if(_acked + len > _len){
-     // Return the number of extra bytes acked (they will be carried on to the next message)
-     const size_t extra = _acked + len - _len;
-     _acked = _len;
-     return extra;
-  }
-  // Return that no extra bytes left.
-  _acked += len;
-  return 0;
+  if(_payload != NULL)
+    _payload->release();
 }
 
-size_t AsyncEventSourceMessage::send(AsyncClient *client) {
-  const size_t len = _len - _sent;
-  if(client->space() < len){
-    return 0;
-  }
-  size_t sent = client->add((const char *)_data, len);
-  if(client->canSend())
-    client->send();
-  _sent += sent;
-  return sent; 
+AsyncEventSourcePayload * AsyncEventSourceMessage::take() {
+  AsyncEventSourcePayload * p = _payload;
+  _payload = NULL;
+  return p;
 }
 
 // Client
@@ -162,6 +160,10 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
   _client = request->client();
   _server = server;
   _lastId = 0;
+  _cursor = server->_ringSequence();
+  _skipped = 0;
+  _sending = NULL;
+  _sendingOffset = 0;
   if(request->hasHeader("Last-Event-ID"))
     _lastId = atoi(request->getHeader("Last-Event-ID")->value().c_str());
     
@@ -179,18 +181,21 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 
 AsyncEventSourceClient::~AsyncEventSourceClient(){
    _messageQueue.free();
+  if(_sending != NULL)
+    _sending->release();
   close();
 }
 
 void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
   if(dataMessage == NULL)
     return;
+  AsyncWebLockGuard l(_server->_lock);
   if(!connected()){
     delete dataMessage;
     return;
   }
   if(_messageQueue.length() >= SSE_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
+      _skipped++;
       delete dataMessage;
   } else {
       _messageQueue.add(dataMessage);
@@ -199,18 +204,14 @@ void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage)
     _runQueue();
 }
 
-void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
-  while(len && !_messageQueue.isEmpty()){
-    len = _messageQueue.front()->ack(len, time);
-    if(_messageQueue.front()->finished())
-      _messageQueue.remove(_messageQueue.front());
-  }
-
+void AsyncEventSourceClient::_onAck(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){
+  AsyncWebLockGuard l(_server->_lock);
   _runQueue();
 }
 
 void AsyncEventSourceClient::_onPoll(){
-  if(!_messageQueue.isEmpty()){
+  AsyncWebLockGuard l(_server->_lock);
+  if(_sending != NULL || !_messageQueue.isEmpty() || _cursor != _server->_ringSequence()){
     _runQueue();
   }
 }
@@ -221,6 +222,7 @@ void AsyncEventSourceClient::_onTimeout(uint32_t time __attribute__((unused))){
 }
 
 void AsyncEventSourceClient::_onDisconnect(){
+  AsyncWebLockGuard l(_server->_lock);
   _client = NULL;
   _server->_handleDisconnect(this);
 }
@@ -239,16 +241,64 @@ void AsyncEventSourceClient::send(const char *message, const char *event, uint32
   _queueMessage(new AsyncEventSourceMessage(ev.c_str(), ev.length()));
 }
 
+size_t AsyncEventSourceClient::packetsWaiting() const {
+  uint32_t behind = _server->_ringSequence() - _cursor;
+  return (_sending != NULL) + _messageQueue.length() + (behind > SSE_RING_SIZE ? 1 : behind);
+}
+
+// Called with the server lock held
 void AsyncEventSourceClient::_runQueue(){
-  while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
+  if(_client == NULL)
+    return;
+
+  uint32_t head = _server->_ringSequence();
+  if(head - _cursor > SSE_RING_SIZE){
+    _skipped += head - _cursor - 1;
+    _cursor = head - 1;
   }
 
-  for(auto i = _messageQueue.begin(); i != _messageQueue.end(); ++i)
-  {
-    if(!(*i)->sent())
-      (*i)->send(_client);
+  // Events are copied into the TCP buffer straight from their payload, as much as there
+  // is room for; the rest of one goes out on the next ack before anything else starts.
+  bool added = false;
+  while(true){
+    if(_sending == NULL){
+      // Messages written to this client alone go first, in order, then the broadcasts
+      // it has not seen yet
+      if(!_messageQueue.isEmpty()){
+        AsyncEventSourceMessage * m = _messageQueue.front();
+        _sending = m->take();
+        _messageQueue.remove(m);
+        if(_sending == NULL)
+          continue; // allocation failed, nothing to send
+      } else if(_cursor != head){
+        _sending = _server->_ringTake(_cursor++);
+        if(_sending == NULL){
+          _skipped++;
+          continue;
+        }
+      } else {
+        break;
+      }
+      _sendingOffset = 0;
+    }
+    size_t left = _sending->length() - _sendingOffset;
+    if(left){
+      size_t space = _client->space();
+      if(!space)
+        break;
+      size_t n = _client->add(_sending->data() + _sendingOffset, std::min(left, space));
+      if(!n)
+        break;
+      _sendingOffset += n;
+      added = true;
+      if(n < left)
+        break;
+    }
+    _sending->release();
+    _sending = NULL;
   }
+  if(added && _client->canSend())
+    _client->send();
 }
 
 
@@ -258,10 +308,33 @@ AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
-{}
+  , _ringHead(0)
+  , _ringLock(ASYNCWEB_POOL_LOCK_INIT)
+{
+  for(size_t i = 0; i < SSE_RING_SIZE; i++)
+    _ring[i] = NULL;
+}
 
 AsyncEventSource::~AsyncEventSource(){
   close();
+  for(size_t i = 0; i < SSE_RING_SIZE; i++){
+    if(_ring[i] != NULL)
+      _ring[i]->release();
+  }
+}
+
+// Returns the broadcast with sequence number seq with a reference held for the
+// caller, or NULL once it has been overwritten
+AsyncEventSourcePayload * AsyncEventSource::_ringTake(uint32_t seq){
+  AsyncEventSourcePayload * p = NULL;
+  ASYNCWEB_POOL_ENTER(_ringLock);
+  if(_ringHead - seq - 1 < SSE_RING_SIZE){
+    p = _ring[seq % SSE_RING_SIZE];
+    if(p != NULL)
+      p->retain();
+  }
+  ASYNCWEB_POOL_EXIT(_ringLock);
+  return p;
 }
 
 void AsyncEventSource::onConnect(ArEventHandlerFunction cb){
@@ -282,12 +355,16 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
-  _clients.add(client);
+  {
+    AsyncWebLockGuard l(_lock);
+    _clients.add(client);
+  }
   if(_connectcb)
     _connectcb(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
+  AsyncWebLockGuard l(_lock);
   _clients.remove(client);
 }
 
@@ -300,6 +377,7 @@ void AsyncEventSource::close(){
 
 // pmb fix
 size_t AsyncEventSource::avgPacketsWaiting() const {
+  AsyncWebLockGuard l(_lock);
   if(_clients.isEmpty())
     return 0;
   
@@ -316,18 +394,31 @@ size_t AsyncEventSource::avgPacketsWaiting() const {
   return ((aql) + (nConnectedClients/2))/(nConnectedClients); // round up
 }
 
+// The event is formatted and stored once; each client picks it up from the ring
 void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
+  String ev = generateEventMessage(message, event, id, reconnect);
+  AsyncEventSourcePayload * p = AsyncEventSourcePayload::create(ev.c_str(), ev.length());
+  if(p == NULL)
+    return;
 
+  ASYNCWEB_POOL_ENTER(_ringLock);
+  AsyncEventSourcePayload * old = _ring[_ringHead % SSE_RING_SIZE];
+  _ring[_ringHead % SSE_RING_SIZE] = p;
+  _ringHead++;
+  ASYNCWEB_POOL_EXIT(_ringLock);
+  if(old != NULL)
+    old->release();
 
-  String ev = generateEventMessage(message, event, id, reconnect);
+  AsyncWebLockGuard l(_lock);
   for(const auto &c: _clients){
-    if(c->connected()) {
-      c->write(ev.c_str(), ev.length());
+    if(c->connected() && c->_client->canSend()) {
+      c->_runQueue();
     }
   }
 }
 
 size_t AsyncEventSource::count() const {
+  AsyncWebLockGuard l(_lock);
   return _clients.count_if([](AsyncEventSourceClient *c){
     return c->connected();
   });
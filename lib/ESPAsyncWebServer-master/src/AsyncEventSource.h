@@ -31,6 +31,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "WebObjectPool.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -45,32 +46,58 @@
 #define DEFAULT_MAX_SSE_CLIENTS 4
 #endif
 
+// Broadcast events kept for clients that are still catching up. A client that falls
+// further behind skips to the newest event instead of receiving stale ones late.
+#ifndef SSE_RING_SIZE
+#ifdef ESP32
+#define SSE_RING_SIZE 8
+#else
+#define SSE_RING_SIZE 4
+#endif
+#endif
+
 class AsyncEventSource;
 class AsyncEventSourceResponse;
 class AsyncEventSourceClient;
 typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
 
-class AsyncEventSourceMessage {
+/*
+ * Formatted event, allocated once and shared by the ring and every client that still
+ * has to send it
+ * */
+
+class AsyncEventSourcePayload {
   private:
-    uint8_t * _data; 
     size_t _len;
-    size_t _sent;
-    //size_t _ack;
-    size_t _acked; 
+    uint16_t _refs;
+    AsyncEventSourcePayload(size_t len): _len(len), _refs(1) {}
+  public:
+    static AsyncEventSourcePayload * create(const char * data, size_t len);
+    void retain();
+    void release();
+    size_t length() const { return _len; }
+    const char * data() const { return (const char *)(this + 1); }
+};
+
+class AsyncEventSourceMessage {
+  private:
+    AsyncEventSourcePayload * _payload;
   public:
     AsyncEventSourceMessage(const char * data, size_t len);
     ~AsyncEventSourceMessage();
-    size_t ack(size_t len, uint32_t time __attribute__((unused)));
-    size_t send(AsyncClient *client);
-    bool finished(){ return _acked == _len; }
-    bool sent() { return _sent == _len; }
+    AsyncEventSourcePayload * take(); // hands the payload and its reference to the caller
 };
 
 class AsyncEventSourceClient {
+  friend class AsyncEventSource;
   private:
     AsyncClient *_client;
     AsyncEventSource *_server;
     uint32_t _lastId;
+    uint32_t _cursor; // sequence number of the next broadcast to send
+    uint32_t _skipped;
+    AsyncEventSourcePayload * _sending; // event being written, possibly over several acks
+    size_t _sendingOffset;
     LinkedList<AsyncEventSourceMessage *> _messageQueue;
     void _queueMessage(AsyncEventSourceMessage *dataMessage);
     void _runQueue();
@@ -86,7 +113,8 @@ class AsyncEventSourceClient {
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     bool connected() const { return (_client != NULL) && _client->connected(); }
     uint32_t lastId() const { return _lastId; }
-    size_t  packetsWaiting() const { return _messageQueue.length(); }
+    size_t  packetsWaiting() const;
+    uint32_t skipped() const { return _skipped; } // broadcasts dropped because the client fell behind
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
@@ -96,10 +124,17 @@ class AsyncEventSourceClient {
 };
 
 class AsyncEventSource: public AsyncWebHandler {
+  friend class AsyncEventSourceClient;
   private:
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    AsyncEventSourcePayload * _ring[SSE_RING_SIZE];
+    uint32_t _ringHead; // sequence number of the next broadcast
+    ASYNCWEB_POOL_LOCK_TYPE _ringLock;
+    // Held for the client list and every client's queue and cursor: send() runs in the
+    // caller's task, acks and polls in async_tcp
+    AsyncWebLock _lock;
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -112,6 +147,8 @@ class AsyncEventSource: public AsyncWebHandler {
     size_t  avgPacketsWaiting() const;
 
     //system callbacks (do not call)
+    uint32_t _ringSequence() const { return _ringHead; }
+    AsyncEventSourcePayload * _ringTake(uint32_t seq);
     void _addClient(AsyncEventSourceClient * client);
     void _handleDisconnect(AsyncEventSourceClient * client);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
@@ -20,6 +20,7 @@
 */
 #include "Arduino.h"
 #include "AsyncWebSocket.h"
+#include "WebObjectPool.h"
 
 #include <libb64/cencode.h>
 
@@ -68,12 +69,7 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
 
   if(len > space) len = space;
 
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
-  }
-
+  uint8_t buf[8];
   buf[0] = opcode & 0x0F;
   if(final)
     buf[0] |= 0x80;
@@ -90,10 +86,8 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   }
   if(client->add((const char *)buf, headLen) != headLen){
     //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
     return 0;
   }
-  free(buf);
 
   if(len){
     if(len && mask){
@@ -114,10 +108,59 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
 }
 
 
+/*
+ *    Payload slab
+ *    Message data comes from two fixed block pools; only payloads that fit neither
+ *    (or arrive while both are exhausted) are taken from the heap.
+ */
+
+static AsyncWebBlockPool<WS_PAYLOAD_SMALL_SIZE, WS_PAYLOAD_SMALL_COUNT> _wsSmallPayloads;
+static AsyncWebBlockPool<WS_PAYLOAD_LARGE_SIZE, WS_PAYLOAD_LARGE_COUNT> _wsLargePayloads;
+
+static volatile uint32_t _wsDropped = 0;
+
+static void webSocketDropped(uint32_t id, const char * what){
+  _wsDropped++;
+  ets_printf("ERROR: ws[%u] %s dropped (%u so far)\n", id, what, _wsDropped);
+}
+
+static uint8_t * webSocketPayloadAlloc(size_t size){
+  void * p = NULL;
+  if(size <= WS_PAYLOAD_SMALL_SIZE)
+    p = _wsSmallPayloads.alloc();
+  if(p == NULL && size <= WS_PAYLOAD_LARGE_SIZE)
+    p = _wsLargePayloads.alloc();
+  if(p == NULL)
+    p = malloc(size);
+  return (uint8_t*)p;
+}
+
+static void webSocketPayloadFree(uint8_t * p){
+  if(p == NULL)
+    return;
+  if(_wsSmallPayloads.owns(p))
+    _wsSmallPayloads.release(p);
+  else if(_wsLargePayloads.owns(p))
+    _wsLargePayloads.release(p);
+  else
+    free(p);
+}
+
+
 /*
  *    AsyncWebSocketMessageBuffer
  */
 
+static AsyncWebBlockPool<sizeof(AsyncWebSocketMessageBuffer), WS_POOL_BUFFERS> _wsBufferPool;
+
+void * AsyncWebSocketMessageBuffer::operator new(size_t size) noexcept {
+  return _wsBufferPool.allocOrHeap(size);
+}
+
+void AsyncWebSocketMessageBuffer::operator delete(void * ptr) {
+  _wsBufferPool.releaseAny(ptr);
+}
+
 
 
 AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer()
@@ -125,6 +168,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer()
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
 
 }
@@ -134,13 +178,14 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(uint8_t * data, size_t
   ,_len(size)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
 
   if (!data) {
     return; 
   }
 
-  _data = new uint8_t[_len + 1];
+  _data = webSocketPayloadAlloc(_len + 1);
 
   if (_data) {
     memcpy(_data, data, _len);
@@ -154,8 +199,9 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(size_t size)
   ,_len(size)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
-  _data = new uint8_t[_len + 1]; 
+  _data = webSocketPayloadAlloc(_len + 1); 
 
   if (_data) {
     _data[_len] = 0; 
@@ -168,14 +214,14 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const AsyncWebSocketMes
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
   _len = copy._len;
   _lock = copy._lock;
   _count = 0;
 
   if (_len) {
-    _data = new uint8_t[_len + 1]; 
-    _data[_len] = 0; 
+    _data = webSocketPayloadAlloc(_len + 1); 
   } 
 
   if (_data) {
@@ -190,6 +236,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
   ,_len(0)
   ,_lock(false)
   ,_count(0)
+  ,_next(nullptr)
 {
   _len = copy._len;
   _lock = copy._lock;
@@ -204,21 +251,15 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
 
 AsyncWebSocketMessageBuffer::~AsyncWebSocketMessageBuffer()
 {
-    if (_data) {
-      delete[] _data; 
-    }
+    webSocketPayloadFree(_data); 
 }
 
 bool AsyncWebSocketMessageBuffer::reserve(size_t size) 
 {
   _len = size; 
 
-  if (_data) {
-    delete[] _data;
-    _data = nullptr; 
-  }
-
-  _data = new uint8_t[_len + 1];
+  webSocketPayloadFree(_data);
+  _data = webSocketPayloadAlloc(_len + 1);
 
   if (_data) {
     _data[_len] = 0;
@@ -238,7 +279,7 @@ bool AsyncWebSocketMessageBuffer::reserve(size_t size)
 class AsyncWebSocketControl {
   private:
     uint8_t _opcode;
-    uint8_t *_data;
+    uint8_t _data[125]; // control payloads are capped at 125 bytes, so they are stored inline
     size_t _len;
     bool _mask;
     bool _finished;
@@ -251,19 +292,14 @@ class AsyncWebSocketControl {
   {
       if(data == NULL)
         _len = 0;
-      if(_len){
-        if(_len > 125)
-          _len = 125;
-        _data = (uint8_t*)malloc(_len);
-        if(_data == NULL)
-          _len = 0;
-        else memcpy(_data, data, len);
-      } else _data = NULL;
-    }
-    virtual ~AsyncWebSocketControl(){
-      if(_data != NULL)
-        free(_data);
+      if(_len > 125)
+        _len = 125;
+      if(_len)
+        memcpy(_data, data, _len);
     }
+    virtual ~AsyncWebSocketControl(){}
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * ptr);
     virtual bool finished() const { return _finished; }
     uint8_t opcode(){ return _opcode; }
     uint8_t len(){ return _len + 2; }
@@ -273,6 +309,35 @@ class AsyncWebSocketControl {
     }
 };
 
+static AsyncWebBlockPool<sizeof(AsyncWebSocketControl), WS_POOL_CONTROLS> _wsControlPool;
+
+// Control frames (close, ping, pong) must never be lost to an exhausted pool
+void * AsyncWebSocketControl::operator new(size_t size) noexcept {
+  return _wsControlPool.allocOrHeap(size);
+}
+
+void AsyncWebSocketControl::operator delete(void * ptr) {
+  _wsControlPool.releaseAny(ptr);
+}
+
+/*
+ * Message object pool
+ */
+
+static constexpr size_t webSocketMessageSize(){
+  return sizeof(AsyncWebSocketBasicMessage) > sizeof(AsyncWebSocketMultiMessage) ? sizeof(AsyncWebSocketBasicMessage) : sizeof(AsyncWebSocketMultiMessage);
+}
+
+static AsyncWebBlockPool<webSocketMessageSize(), WS_POOL_MESSAGES> _wsMessagePool;
+
+void * AsyncWebSocketMessage::operator new(size_t size) noexcept {
+  return _wsMessagePool.allocOrHeap(size);
+}
+
+void AsyncWebSocketMessage::operator delete(void * ptr) {
+  _wsMessagePool.releaseAny(ptr);
+}
+
 /*
  * Basic Buffered Message
  */
@@ -286,7 +351,7 @@ AsyncWebSocketBasicMessage::AsyncWebSocketBasicMessage(const char * data, size_t
 {
   _opcode = opcode & 0x07;
   _mask = mask;
-  _data = (uint8_t*)malloc(_len+1);
+  _data = webSocketPayloadAlloc(_len+1);
   if(_data == NULL){
     _len = 0;
     _status = WS_MSG_ERROR;
@@ -310,8 +375,7 @@ AsyncWebSocketBasicMessage::AsyncWebSocketBasicMessage(uint8_t opcode, bool mask
 
 
 AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
-  if(_data != NULL)
-    free(_data);
+  webSocketPayloadFree(_data);
 }
 
  void AsyncWebSocketBasicMessage::ack(size_t len, uint32_t time)  {
@@ -546,14 +610,22 @@ bool AsyncWebSocketClient::queueIsFull(){
 }
 
 void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
-  if(dataMessage == NULL)
+  if(dataMessage == NULL){
+    webSocketDropped(_clientId, "message (out of memory)");
     return;
+  }
   if(_status != WS_CONNECTED){
     delete dataMessage;
     return;
   }
+  if(dataMessage->finished()){
+    // A new message is only finished when its payload could not be allocated
+    webSocketDropped(_clientId, "message (no payload)");
+    delete dataMessage;
+    return;
+  }
   if(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES){
-      ets_printf("ERROR: Too many messages queued\n");
+      webSocketDropped(_clientId, "message (queue full)");
       delete dataMessage;
   } else {
       _messageQueue.add(dataMessage);
@@ -563,8 +635,10 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
 }
 
 void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
-  if(controlMessage == NULL)
+  if(controlMessage == NULL){
+    webSocketDropped(_clientId, "control frame (out of memory)");
     return;
+  }
   _controlQueue.add(controlMessage);
   if(_client->canSend())
     _runQueue();
@@ -706,11 +780,7 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
 size_t AsyncWebSocketClient::printf(const char *format, ...) {
   va_list arg;
   va_start(arg, format);
-  char* temp = new char[MAX_PRINTF_LEN];
-  if(!temp){
-    va_end(arg);
-    return 0;
-  }
+  char temp[MAX_PRINTF_LEN];
   char* buffer = temp;
   size_t len = vsnprintf(temp, MAX_PRINTF_LEN, format, arg);
   va_end(arg);
@@ -718,7 +788,6 @@ size_t AsyncWebSocketClient::printf(const char *format, ...) {
   if (len > (MAX_PRINTF_LEN - 1)) {
     buffer = new char[len + 1];
     if (!buffer) {
-   	  delete[] temp;
       return 0;
     }
     va_start(arg, format);
@@ -729,7 +798,6 @@ size_t AsyncWebSocketClient::printf(const char *format, ...) {
   if (buffer != temp) {
     delete[] buffer;
   }
-  delete[] temp;
   return len;
 }
 
@@ -857,12 +925,18 @@ AsyncWebSocket::AsyncWebSocket(const String& url)
   ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
   ,_cNextId(1)
   ,_enabled(true)
-  ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
+  ,_buffers(NULL)
 {
   _eventHandler = NULL;
 }
 
-AsyncWebSocket::~AsyncWebSocket(){}
+AsyncWebSocket::~AsyncWebSocket(){
+  while(_buffers){
+    AsyncWebSocketMessageBuffer * b = _buffers;
+    _buffers = b->_next;
+    delete b;
+  }
+}
 
 void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len){
   if(_eventHandler != NULL){
@@ -1019,17 +1093,12 @@ size_t AsyncWebSocket::printf(uint32_t id, const char *format, ...){
 
 size_t AsyncWebSocket::printfAll(const char *format, ...) {
   va_list arg;
-  char* temp = new char[MAX_PRINTF_LEN];
-  if(!temp){
-    return 0;
-  }
   va_start(arg, format);
-  size_t len = vsnprintf(temp, MAX_PRINTF_LEN, format, arg);
+  size_t len = vsnprintf(NULL, 0, format, arg);
   va_end(arg);
-  delete[] temp;
   
   AsyncWebSocketMessageBuffer * buffer = makeBuffer(len); 
-  if (!buffer) {
+  if (!buffer || !buffer->get()) {
     return 0;
   }
 
@@ -1057,17 +1126,12 @@ size_t AsyncWebSocket::printf_P(uint32_t id, PGM_P formatP, ...){
 
 size_t AsyncWebSocket::printfAll_P(PGM_P formatP, ...) {
   va_list arg;
-  char* temp = new char[MAX_PRINTF_LEN];
-  if(!temp){
-    return 0;
-  }
   va_start(arg, formatP);
-  size_t len = vsnprintf_P(temp, MAX_PRINTF_LEN, formatP, arg);
+  size_t len = vsnprintf_P(NULL, 0, formatP, arg);
   va_end(arg);
-  delete[] temp;
   
   AsyncWebSocketMessageBuffer * buffer = makeBuffer(len + 1); 
-  if (!buffer) {
+  if (!buffer || !buffer->get()) {
     return 0;
   }
 
@@ -1109,10 +1173,13 @@ void AsyncWebSocket::textAll(const String &message){
   textAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::textAll(const __FlashStringHelper *message){
-  for(const auto& c: _clients){
-    if(c->status() == WS_CONNECTED)
-      c->text(message);
-  }
+  PGM_P p = reinterpret_cast<PGM_P>(message);
+  size_t n = strlen_P(p);
+  AsyncWebSocketMessageBuffer * buffer = makeBuffer(n);
+  if(!buffer || !buffer->get())
+    return;
+  memcpy_P(buffer->get(), p, n);
+  textAll(buffer);
 }
 void AsyncWebSocket::binary(uint32_t id, const char * message){
   binary(id, message, strlen(message));
@@ -1144,10 +1211,11 @@ void AsyncWebSocket::binaryAll(const String &message){
   binaryAll(message.c_str(), message.length());
 }
 void AsyncWebSocket::binaryAll(const __FlashStringHelper *message, size_t len){
-  for(const auto& c: _clients){
-    if(c->status() == WS_CONNECTED)
-      c-> binary(message, len);
-  }
+  AsyncWebSocketMessageBuffer * buffer = makeBuffer(len);
+  if(!buffer || !buffer->get())
+    return;
+  memcpy_P(buffer->get(), message, len);
+  binaryAll(buffer);
  }
 
 const char * WS_STR_CONNECTION = "Connection";
@@ -1200,12 +1268,21 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
   request->send(response);
 }
 
+uint32_t AsyncWebSocket::dropped(){
+  return _wsDropped;
+}
+
+uint32_t AsyncWebSocket::spilled(){
+  return _wsMessagePool.spilled() + _wsControlPool.spilled() + _wsBufferPool.spilled();
+}
+
 AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(size_t size)
 {
   AsyncWebSocketMessageBuffer * buffer = new AsyncWebSocketMessageBuffer(size); 
   if (buffer) {
     AsyncWebLockGuard l(_lock);
-    _buffers.add(buffer);
+    buffer->_next = _buffers;
+    _buffers = buffer;
   }
   return buffer; 
 }
@@ -1216,7 +1293,8 @@ AsyncWebSocketMessageBuffer * AsyncWebSocket::makeBuffer(uint8_t * data, size_t
   
   if (buffer) {
     AsyncWebLockGuard l(_lock);
-    _buffers.add(buffer);
+    buffer->_next = _buffers;
+    _buffers = buffer;
   }
 
   return buffer; 
@@ -1226,9 +1304,14 @@ void AsyncWebSocket::_cleanBuffers()
 {
   AsyncWebLockGuard l(_lock);
 
-  for(AsyncWebSocketMessageBuffer * c: _buffers){
-    if(c && c->canDelete()){
-        _buffers.remove(c);
+  AsyncWebSocketMessageBuffer ** link = &_buffers;
+  while(*link){
+    AsyncWebSocketMessageBuffer * c = *link;
+    if(c->canDelete()){
+      *link = c->_next;
+      delete c;
+    } else {
+      link = &c->_next;
     }
   }
 }
@@ -46,6 +46,33 @@
 #define DEFAULT_MAX_WS_CLIENTS 4
 #endif
 
+// Fixed pools backing message, control and buffer objects and their payloads. The pools are
+// shared by all clients. Control frames get two slots per client; messages get one full
+// client queue (WS_MAX_QUEUED_MESSAGES * DEFAULT_MAX_WS_CLIENTS blocks would cost over 12 KB
+// of static RAM on the ESP32). Whatever does not fit spills to the heap rather than being
+// dropped. Payloads larger than WS_PAYLOAD_LARGE_SIZE always come from the heap.
+#ifndef WS_POOL_MESSAGES
+#define WS_POOL_MESSAGES WS_MAX_QUEUED_MESSAGES
+#endif
+#ifndef WS_POOL_CONTROLS
+#define WS_POOL_CONTROLS (2 * DEFAULT_MAX_WS_CLIENTS)
+#endif
+#ifndef WS_POOL_BUFFERS
+#define WS_POOL_BUFFERS WS_MAX_QUEUED_MESSAGES
+#endif
+#ifndef WS_PAYLOAD_SMALL_SIZE
+#define WS_PAYLOAD_SMALL_SIZE 64
+#endif
+#ifndef WS_PAYLOAD_SMALL_COUNT
+#define WS_PAYLOAD_SMALL_COUNT WS_MAX_QUEUED_MESSAGES
+#endif
+#ifndef WS_PAYLOAD_LARGE_SIZE
+#define WS_PAYLOAD_LARGE_SIZE 512
+#endif
+#ifndef WS_PAYLOAD_LARGE_COUNT
+#define WS_PAYLOAD_LARGE_COUNT DEFAULT_MAX_WS_CLIENTS
+#endif
+
 class AsyncWebSocket;
 class AsyncWebSocketResponse;
 class AsyncWebSocketClient;
@@ -86,8 +113,12 @@ class AsyncWebSocketMessageBuffer {
     size_t _len;
     bool _lock; 
     uint32_t _count;  
+    AsyncWebSocketMessageBuffer * _next; // intrusive link in AsyncWebSocket::_buffers
 
   public:
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * ptr);
+
     AsyncWebSocketMessageBuffer();
     AsyncWebSocketMessageBuffer(size_t size);
     AsyncWebSocketMessageBuffer(uint8_t * data, size_t size); 
@@ -116,6 +147,9 @@ class AsyncWebSocketMessage {
   public:
     AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR){}
     virtual ~AsyncWebSocketMessage(){}
+    // Library messages come from a shared pool; larger user subclasses and overflow use the heap
+    static void * operator new(size_t size) noexcept;
+    static void operator delete(void * ptr);
     virtual void ack(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){}
     virtual size_t send(AsyncClient *client __attribute__((unused))){ return 0; }
     virtual bool finished(){ return _status != WS_MSG_SENDING; }
@@ -261,6 +295,10 @@ class AsyncWebSocket: public AsyncWebHandler {
     bool availableForWrite(uint32_t id);
 
     size_t count() const;
+    // Frames lost by all sockets: queue full or out of memory
+    static uint32_t dropped();
+    // Pool objects that had to come from the heap instead
+    static uint32_t spilled();
     AsyncWebSocketClient * client(uint32_t id);
     bool hasClient(uint32_t id){ return client(id) != NULL; }
 
@@ -328,7 +366,7 @@ class AsyncWebSocket: public AsyncWebHandler {
     //  messagebuffer functions/objects. 
     AsyncWebSocketMessageBuffer * makeBuffer(size_t size = 0); 
     AsyncWebSocketMessageBuffer * makeBuffer(uint8_t * data, size_t size); 
-    LinkedList<AsyncWebSocketMessageBuffer *> _buffers;
+    AsyncWebSocketMessageBuffer * _buffers;
     void _cleanBuffers(); 
 
     AsyncWebSocketClientLinkedList getClients() const;
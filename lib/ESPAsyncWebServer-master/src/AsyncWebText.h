@@ -0,0 +1,133 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBTEXT_H_
+#define ASYNCWEBTEXT_H_
+
+#include "stddef.h"
+#include "stdlib.h"
+#include "string.h"
+#include "strings.h"
+#include "WString.h"
+
+/*
+ * Read-only view of a header or parameter name or value. The text is NUL-terminated,
+ * so c_str() can be handed on as is. A view into a request is only valid while the
+ * request lives; convert it to a String to keep it.
+ * */
+
+class AsyncWebText {
+  private:
+    const char *_data;
+    size_t _len;
+
+  public:
+    AsyncWebText(): _data(""), _len(0) {}
+    AsyncWebText(const char *data, size_t len): _data(data), _len(len) {}
+
+    const char *c_str() const { return _data; }
+    size_t length() const { return _len; }
+    bool isEmpty() const { return _len == 0; }
+    char operator[](size_t i) const { return i < _len ? _data[i] : 0; }
+    long toInt() const { return atol(_data); }
+    float toFloat() const { return atof(_data); }
+
+    bool equals(const char *str, size_t len) const { return len == _len && memcmp(_data, str, len) == 0; }
+    bool equals(const char *str) const { return equals(str, strlen(str)); }
+    bool equals(const String &str) const { return equals(str.c_str(), str.length()); }
+    bool equalsIgnoreCase(const char *str, size_t len) const { return len == _len && strncasecmp(_data, str, len) == 0; }
+    bool equalsIgnoreCase(const char *str) const { return equalsIgnoreCase(str, strlen(str)); }
+    bool equalsIgnoreCase(const String &str) const { return equalsIgnoreCase(str.c_str(), str.length()); }
+    bool startsWith(const char *prefix) const {
+      size_t len = strlen(prefix);
+      return len <= _len && memcmp(_data, prefix, len) == 0;
+    }
+
+    bool operator==(const char *str) const { return equals(str); }
+    bool operator==(const String &str) const { return equals(str); }
+    bool operator!=(const char *str) const { return !equals(str); }
+    bool operator!=(const String &str) const { return !equals(str); }
+
+    operator String() const {
+      String s;
+      s.concat(_data, _len);
+      return s;
+    }
+};
+
+inline bool operator==(const String &a, const AsyncWebText &b){ return b.equals(a); }
+inline bool operator!=(const String &a, const AsyncWebText &b){ return !b.equals(a); }
+
+inline String operator+(const String &a, const AsyncWebText &b){
+  String s(a);
+  s.concat(b.c_str(), b.length());
+  return s;
+}
+
+inline String operator+(const char *a, const AsyncWebText &b){
+  String s(a);
+  s.concat(b.c_str(), b.length());
+  return s;
+}
+
+/*
+ * Bump allocator for the text of one request. Names and values are written one after
+ * the other, each with a terminator, and the whole arena is dropped with the request.
+ * */
+
+template <size_t N>
+class AsyncWebArena {
+  private:
+    char _data[N];
+    size_t _used;
+
+  public:
+    static constexpr size_t capacity = N;
+
+    AsyncWebArena(): _used(0) {}
+    AsyncWebArena(const AsyncWebArena&) = delete;
+    AsyncWebArena& operator=(const AsyncWebArena&) = delete;
+
+    // Room for up to maxLen bytes at the end of the arena, or NULL when they do not fit.
+    // Write the text there and commit() it before the next reserve().
+    char *reserve(size_t maxLen){
+      return maxLen < N - _used ? _data + _used : NULL;
+    }
+
+    AsyncWebText commit(size_t len){
+      char *text = _data + _used;
+      text[len] = '\0';
+      _used += len + 1;
+      return AsyncWebText(text, len);
+    }
+
+    bool store(const char *text, size_t len, AsyncWebText &out){
+      char *p = reserve(len);
+      if(p == NULL)
+        return false;
+      memcpy(p, text, len);
+      out = commit(len);
+      return true;
+    }
+
+    size_t used() const { return _used; }
+};
+
+#endif /* ASYNCWEBTEXT_H_ */
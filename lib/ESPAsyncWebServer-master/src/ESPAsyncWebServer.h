@@ -27,6 +27,7 @@
 #include "FS.h"
 
 #include "StringArray.h"
+#include "AsyncWebText.h"
 
 #ifdef ESP32
 #include <WiFi.h>
@@ -46,6 +47,39 @@
 
 #define DEBUGF(...) //Serial.printf(__VA_ARGS__)
 
+// Per-request capacities; headers, params and path params are stored inline in the request.
+// The names and values of headers and params share one arena of WEBSERVER_ARENA_SIZE bytes.
+// A request with more headers or header text is answered with 431, a query that does not
+// fit with 414 and a form body with 413.
+#ifndef WEBSERVER_ARENA_SIZE
+#define WEBSERVER_ARENA_SIZE 1024
+#endif
+#ifndef WEBSERVER_MAX_HEADERS
+#define WEBSERVER_MAX_HEADERS 24
+#endif
+#ifndef WEBSERVER_MAX_PARAMS
+#define WEBSERVER_MAX_PARAMS 16
+#endif
+#ifndef WEBSERVER_MAX_PATH_PARAMS
+#define WEBSERVER_MAX_PATH_PARAMS 4
+#endif
+#ifndef WEBSERVER_MAX_INTERESTING_HEADERS
+#define WEBSERVER_MAX_INTERESTING_HEADERS 8
+#endif
+
+// Response send buffers; one is held per response while its body is being written
+#ifndef WEBSERVER_SEND_BUFFER_SIZE
+#define WEBSERVER_SEND_BUFFER_SIZE 1436
+#endif
+#ifndef WEBSERVER_SEND_BUFFERS
+#define WEBSERVER_SEND_BUFFERS 4
+#endif
+
+// Slots in the exact-route index (power of two, kept at most 3/4 full)
+#ifndef WEBSERVER_ROUTE_SLOTS
+#define WEBSERVER_ROUTE_SLOTS 32
+#endif
+
 class AsyncWebServer;
 class AsyncWebServerRequest;
 class AsyncWebServerResponse;
@@ -56,6 +90,7 @@ class AsyncWebHandler;
 class AsyncStaticWebHandler;
 class AsyncCallbackWebHandler;
 class AsyncResponseStream;
+class AsyncWebTemplate;
 
 #ifndef WEBSERVER_H
 typedef enum {
@@ -82,17 +117,17 @@ typedef std::function<void(void)> ArDisconnectHandler;
 
 class AsyncWebParameter {
   private:
-    String _name;
-    String _value;
+    AsyncWebText _name;
+    AsyncWebText _value;
     size_t _size;
     bool _isForm;
     bool _isFile;
 
   public:
 
-    AsyncWebParameter(const String& name, const String& value, bool form=false, bool file=false, size_t size=0): _name(name), _value(value), _size(size), _isForm(form), _isFile(file){}
-    const String& name() const { return _name; }
-    const String& value() const { return _value; }
+    AsyncWebParameter(const AsyncWebText& name, const AsyncWebText& value, bool form=false, bool file=false, size_t size=0): _name(name), _value(value), _size(size), _isForm(form), _isFile(file){}
+    const AsyncWebText& name() const { return _name; }
+    const AsyncWebText& value() const { return _value; }
     size_t size() const { return _size; }
     bool isPost() const { return _isForm; }
     bool isFile() const { return _isFile; }
@@ -100,26 +135,62 @@ class AsyncWebParameter {
 
 /*
  * HEADER :: Chainable object to hold the headers
+ * Response headers own their text (one allocation for name and value); request
+ * headers point into the request's arena.
  * */
 
 class AsyncWebHeader {
   private:
-    String _name;
-    String _value;
+    AsyncWebText _name;
+    AsyncWebText _value;
+    char *_text;
+
+    void _copy(const char *name, size_t nameLen, const char *value, size_t valueLen){
+      _text = (char*)malloc(nameLen + valueLen + 2);
+      if(_text == NULL)
+        return;
+      memcpy(_text, name, nameLen);
+      _text[nameLen] = '\0';
+      memcpy(_text + nameLen + 1, value, valueLen);
+      _text[nameLen + 1 + valueLen] = '\0';
+      _name = AsyncWebText(_text, nameLen);
+      _value = AsyncWebText(_text + nameLen + 1, valueLen);
+    }
 
   public:
-    AsyncWebHeader(const String& name, const String& value): _name(name), _value(value){}
-    AsyncWebHeader(const String& data): _name(), _value(){
+    AsyncWebHeader(const AsyncWebText& name, const AsyncWebText& value): _name(name), _value(value), _text(NULL){}
+    AsyncWebHeader(const String& name, const String& value): _text(NULL){
+      _copy(name.c_str(), name.length(), value.c_str(), value.length());
+    }
+    AsyncWebHeader(const char *name, const char *value): _text(NULL){
+      _copy(name, strlen(name), value, strlen(value));
+    }
+    AsyncWebHeader(const String& data): _text(NULL){
       if(!data) return;
       int index = data.indexOf(':');
       if (index < 0) return;
-      _name = data.substring(0, index);
-      _value = data.substring(index + 2);
+      size_t valueStart = (size_t)index + 2 < data.length() ? index + 2 : data.length();
+      _copy(data.c_str(), index, data.c_str() + valueStart, data.length() - valueStart);
+    }
+    AsyncWebHeader(AsyncWebHeader&& other): _name(other._name), _value(other._value), _text(other._text){
+      other._text = NULL;
     }
-    ~AsyncWebHeader(){}
-    const String& name() const { return _name; }
-    const String& value() const { return _value; }
-    String toString() const { return String(_name+": "+_value+"\r\n"); }
+    AsyncWebHeader& operator=(AsyncWebHeader&& other){
+      if(this != &other){
+        free(_text);
+        _name = other._name;
+        _value = other._value;
+        _text = other._text;
+        other._text = NULL;
+      }
+      return *this;
+    }
+    AsyncWebHeader(const AsyncWebHeader&) = delete;
+    AsyncWebHeader& operator=(const AsyncWebHeader&) = delete;
+    ~AsyncWebHeader(){ free(_text); }
+    const AsyncWebText& name() const { return _name; }
+    const AsyncWebText& value() const { return _value; }
+    String toString() const { return String(_name) + ": " + _value + "\r\n"; }
 };
 
 /*
@@ -141,7 +212,7 @@ class AsyncWebServerRequest {
     AsyncWebServer* _server;
     AsyncWebHandler* _handler;
     AsyncWebServerResponse* _response;
-    StringArray _interestingHeaders;
+    InlineList<String, WEBSERVER_MAX_INTERESTING_HEADERS> _interestingHeaders;
     ArDisconnectHandler _onDisconnectfn;
 
     String _temp;
@@ -163,9 +234,11 @@ class AsyncWebServerRequest {
     size_t _contentLength;
     size_t _parsedLength;
 
-    LinkedList<AsyncWebHeader *> _headers;
-    LinkedList<AsyncWebParameter *> _params;
-    LinkedList<String *> _pathParams;
+    AsyncWebArena<WEBSERVER_ARENA_SIZE> _arena;
+    InlineList<AsyncWebHeader, WEBSERVER_MAX_HEADERS> _headers;
+    InlineList<AsyncWebParameter, WEBSERVER_MAX_PARAMS> _params;
+    uint16_t _rejectCode; // 431, 414 or 413 once the arena or a list is full
+    InlineList<String, WEBSERVER_MAX_PATH_PARAMS> _pathParams;
 
     uint8_t _multiParseState;
     uint8_t _boundaryPosition;
@@ -186,15 +259,23 @@ class AsyncWebServerRequest {
     void _onDisconnect();
     void _onData(void *buf, size_t len);
 
-    void _addParam(AsyncWebParameter*);
+    bool _storeText(const char *text, size_t len, bool decode, AsyncWebText& out);
+    void _addParam(const AsyncWebText& name, const AsyncWebText& value, bool form=false, bool file=false, size_t size=0);
+    void _addParam(const String& name, const String& value, bool form=false, bool file=false, size_t size=0);
+    bool _isInterestingHeader(const char *name, size_t len) const;
+    AsyncWebHeader* _findHeader(const char *name, size_t len) const;
     void _addPathParam(const char *param);
 
-    bool _parseReqHead();
-    bool _parseReqHeader();
-    void _parseLine();
-    void _parsePlainPostChar(uint8_t data);
+    bool _parseReqHead(const char *line, size_t len);
+    bool _parseReqHeader(const char *line, size_t len);
+    void _parseLine(const char *line, size_t len);
+    void _parsePlainPost(const uint8_t *data, size_t len);
+    void _addPlainPostParam(const char *field, size_t len);
     void _parseMultipartPostByte(uint8_t data, bool last);
     void _addGetParams(const String& params);
+    void _addGetParams(const char *params, size_t len);
+    void _reject(uint16_t code);
+    String _urlDecode(const char *text, size_t len) const;
 
     void _handleUploadStart();
     void _handleUploadByte(uint8_t data, bool last);
@@ -242,6 +323,7 @@ class AsyncWebServerRequest {
     void sendChunked(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
     void send_P(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback=nullptr);
     void send_P(int code, const String& contentType, PGM_P content, AwsTemplateProcessor callback=nullptr);
+    void send(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback);
 
     AsyncWebServerResponse *beginResponse(int code, const String& contentType=String(), const String& content=String());
     AsyncWebServerResponse *beginResponse(FS &fs, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
@@ -252,6 +334,7 @@ class AsyncWebServerRequest {
     AsyncResponseStream *beginResponseStream(const String& contentType, size_t bufferSize=1460);
     AsyncWebServerResponse *beginResponse_P(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback=nullptr);
     AsyncWebServerResponse *beginResponse_P(int code, const String& contentType, PGM_P content, AwsTemplateProcessor callback=nullptr);
+    AsyncWebServerResponse *beginResponse(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback);
 
     size_t headers() const;                     // get header count
     bool hasHeader(const String& name) const;   // check if header exists
@@ -270,19 +353,19 @@ class AsyncWebServerRequest {
     AsyncWebParameter* getParam(size_t num) const;
 
     size_t args() const { return params(); }     // get arguments count
-    const String& arg(const String& name) const; // get request argument value by name
-    const String& arg(const __FlashStringHelper * data) const; // get request argument value by F(name)    
-    const String& arg(size_t i) const;           // get request argument value by number
-    const String& argName(size_t i) const;       // get request argument name by number
+    const AsyncWebText& arg(const String& name) const; // get request argument value by name
+    const AsyncWebText& arg(const __FlashStringHelper * data) const; // get request argument value by F(name)    
+    const AsyncWebText& arg(size_t i) const;           // get request argument value by number
+    const AsyncWebText& argName(size_t i) const;       // get request argument name by number
     bool hasArg(const char* name) const;         // check if argument exists
     bool hasArg(const __FlashStringHelper * data) const;         // check if F(argument) exists
 
     const String& ASYNCWEBSERVER_REGEX_ATTRIBUTE pathArg(size_t i) const;
 
-    const String& header(const char* name) const;// get request header value by name
-    const String& header(const __FlashStringHelper * data) const;// get request header value by F(name)    
-    const String& header(size_t i) const;        // get request header value by number
-    const String& headerName(size_t i) const;    // get request header name by number
+    const AsyncWebText& header(const char* name) const;// get request header value by name
+    const AsyncWebText& header(const __FlashStringHelper * data) const;// get request header value by F(name)    
+    const AsyncWebText& header(size_t i) const;        // get request header value by number
+    const AsyncWebText& headerName(size_t i) const;    // get request header name by number
     String urlDecode(const String& text) const;
 };
 
@@ -328,12 +411,16 @@ class AsyncWebRewrite {
  * */
 
 class AsyncWebHandler {
+  friend class AsyncWebServer;
   protected:
     ArRequestFilterFunction _filter;
     String _username;
     String _password;
+    uint16_t _order; // registration order, so indexed routes keep first-match semantics
+    AsyncWebServer* _server; // set while the handler is added, so a URI change re-indexes it
+    void _routeChanged();
   public:
-    AsyncWebHandler():_username(""), _password(""){}
+    AsyncWebHandler():_username(""), _password(""), _order(0), _server(NULL){}
     AsyncWebHandler& setFilter(ArRequestFilterFunction fn) { _filter = fn; return *this; }
     AsyncWebHandler& setAuthentication(const char *username, const char *password){  _username = String(username);_password = String(password); return *this; };
     bool filter(AsyncWebServerRequest *request){ return _filter == NULL || _filter(request); }
@@ -345,6 +432,9 @@ class AsyncWebHandler {
     virtual void handleUpload(AsyncWebServerRequest *request  __attribute__((unused)), const String& filename __attribute__((unused)), size_t index __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), bool final  __attribute__((unused))){}
     virtual void handleBody(AsyncWebServerRequest *request __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), size_t index __attribute__((unused)), size_t total __attribute__((unused))){}
     virtual bool isRequestHandlerTrivial(){return true;}
+    // Exact URI served by this handler, or NULL if only canHandle() can decide.
+    // Read when the handler is added to the server, and again after a URI change.
+    virtual const String* routeUri() const { return NULL; }
 };
 
 /*
@@ -393,14 +483,60 @@ class AsyncWebServerResponse {
 typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
 typedef std::function<void(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
 typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+typedef void (*ArRouteFunction)(AsyncWebServerRequest *request);
+
+/*
+ * ROUTE :: Static route that can live in a constexpr table; the URI hash is computed by the compiler
+ * */
+
+#define ASYNCWEB_ROUTE_HASH_SEED 2166136261UL
+
+constexpr uint32_t asyncWebRouteHashStep(uint32_t h, char c){
+  return (h ^ (uint8_t)c) * 16777619UL;
+}
+
+constexpr uint32_t asyncWebRouteHashFrom(uint32_t h, const char *uri){
+  return *uri ? asyncWebRouteHashFrom(asyncWebRouteHashStep(h, *uri), uri + 1) : h;
+}
+
+constexpr uint32_t asyncWebRouteHash(const char *uri){
+  return asyncWebRouteHashFrom(ASYNCWEB_ROUTE_HASH_SEED, uri);
+}
+
+struct AsyncWebRoute {
+  const char *uri;
+  WebRequestMethodComposite method;
+  ArRouteFunction onRequest;
+  uint32_t hash;
+  constexpr AsyncWebRoute(const char *u, WebRequestMethodComposite m, ArRouteFunction fn)
+    : uri(u), method(m), onRequest(fn), hash(asyncWebRouteHash(u)) {}
+};
 
 class AsyncWebServer {
+  friend class AsyncWebHandler;
   protected:
     AsyncServer _server;
     LinkedList<AsyncWebRewrite*> _rewrites;
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
 
+    // Handlers with an exact URI are found through an open-addressed index keyed on the
+    // URI hash; everything else (wildcards, regex, static files, sockets) stays in the
+    // ordered _wildcardHandlers list, which does not own its entries.
+    struct RouteSlot {
+      uint32_t hash;
+      AsyncWebHandler* handler;
+    };
+    RouteSlot _routes[WEBSERVER_ROUTE_SLOTS];
+    size_t _routeCount;
+    uint16_t _handlerCount;
+    LinkedList<AsyncWebHandler*> _wildcardHandlers;
+
+    void _indexHandler(AsyncWebHandler* handler, uint32_t hash);
+    void _clearRoutes();
+    void _reindexRoutes();
+    AsyncWebHandler* _findRoute(AsyncWebServerRequest *request);
+
   public:
     AsyncWebServer(uint16_t port);
     ~AsyncWebServer();
@@ -424,6 +560,12 @@ class AsyncWebServer {
     AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
     AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload);
     AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
+    AsyncCallbackWebHandler& on(const AsyncWebRoute& route);
+    template <size_t N>
+    void on(const AsyncWebRoute (&routes)[N]){
+      for(size_t i = 0; i < N; i++)
+        on(routes[i]);
+    }
 
     AsyncStaticWebHandler& serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cache_control = NULL);
 
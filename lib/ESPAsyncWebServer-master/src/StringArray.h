@@ -23,6 +23,8 @@
 
 #include "stddef.h"
 #include "WString.h"
+#include <new>
+#include <utility>
 
 template <typename T>
 class LinkedListNode {
@@ -188,6 +190,82 @@ public:
 };
 
 
+/*
+ * Case-folded FNV-1a hash, used to tag names so lookups compare integers
+ * before falling back to a string compare.
+ * */
+
+inline uint32_t asyncWebFoldHash(const char *str, size_t len){
+  uint32_t h = 2166136261UL;
+  for(size_t i = 0; i < len; i++){
+    char c = str[i];
+    if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    h = (h ^ (uint8_t)c) * 16777619UL;
+  }
+  return h;
+}
+
+inline uint32_t asyncWebFoldHash(const String& str){
+  return asyncWebFoldHash(str.c_str(), str.length());
+}
+
+/*
+ * Fixed-capacity list whose items are constructed in place inside the owning object,
+ * so adding an item never allocates a node. Each slot carries a 32 bit tag (usually
+ * asyncWebFoldHash of the item name). add() returns nullptr once the list is full.
+ * */
 
+template <typename T, size_t N>
+class InlineList {
+  private:
+    union Slot {
+      T value;
+      Slot(){}
+      ~Slot(){}
+    };
+    Slot _items[N];
+    uint32_t _tags[N];
+    size_t _count;
+
+  public:
+    typedef const T* ConstIterator;
+    static constexpr size_t capacity = N;
+
+    InlineList() : _count(0) {}
+    ~InlineList(){ free(); }
+    InlineList(const InlineList&) = delete;
+    InlineList& operator=(const InlineList&) = delete;
+
+    template <typename... Args>
+    T* add(uint32_t tag, Args&&... args){
+      if(_count == N)
+        return nullptr;
+      T* item = new (&_items[_count].value) T(std::forward<Args>(args)...);
+      _tags[_count++] = tag;
+      return item;
+    }
+    void erase(size_t i){
+      if(i >= _count)
+        return;
+      for(; i + 1 < _count; i++){
+        _items[i].value = std::move(_items[i + 1].value);
+        _tags[i] = _tags[i + 1];
+      }
+      _items[--_count].value.~T();
+    }
+    void free(){
+      while(_count)
+        _items[--_count].value.~T();
+    }
+
+    bool isEmpty() const { return _count == 0; }
+    size_t length() const { return _count; }
+    uint32_t tag(size_t i) const { return _tags[i]; }
+    T& operator[](size_t i){ return _items[i].value; }
+    const T& operator[](size_t i) const { return _items[i].value; }
+    const T* nth(size_t i) const { return i < _count ? &_items[i].value : nullptr; }
+    ConstIterator begin() const { return &_items[0].value; }
+    ConstIterator end() const { return &_items[0].value + _count; }
+};
 
 #endif /* STRINGARRAY_H_ */
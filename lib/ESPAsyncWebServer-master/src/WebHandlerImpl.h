@@ -77,6 +77,7 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
     void setUri(const String& uri){ 
       _uri = uri; 
       _isRegex = uri.startsWith("^") && uri.endsWith("$");
+      _routeChanged();
     }
     void setMethod(WebRequestMethodComposite method){ _method = method; }
     void onRequest(ArRequestHandlerFunction fn){ _onRequest = fn; }
@@ -146,6 +147,11 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
         _onBody(request, data, len, index, total);
     }
     virtual bool isRequestHandlerTrivial() override final {return _onRequest ? false : true;}
+    virtual const String* routeUri() const override final {
+      if(!_uri.length() || _isRegex || _uri.startsWith("/*.") || _uri.endsWith("*"))
+        return NULL;
+      return &_uri;
+    }
 };
 
 #endif /* ASYNCWEBSERVERHANDLERIMPL_H_ */
@@ -0,0 +1,124 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef WEBOBJECTPOOL_H_
+#define WEBOBJECTPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#define ASYNCWEB_POOL_LOCK_TYPE portMUX_TYPE
+#define ASYNCWEB_POOL_LOCK_INIT portMUX_INITIALIZER_UNLOCKED
+#define ASYNCWEB_POOL_ENTER(l) portENTER_CRITICAL(&(l))
+#define ASYNCWEB_POOL_EXIT(l) portEXIT_CRITICAL(&(l))
+#else
+// The ESP8266 runs the TCP callbacks and the sketch in the same context
+#define ASYNCWEB_POOL_LOCK_TYPE uint8_t
+#define ASYNCWEB_POOL_LOCK_INIT 0
+#define ASYNCWEB_POOL_ENTER(l) (void)(l)
+#define ASYNCWEB_POOL_EXIT(l) (void)(l)
+#endif
+
+/*
+ * Fixed-capacity pool of equally sized blocks.
+ * The storage is carved into a free list once, so alloc() and release() are O(1)
+ * and never touch the heap. alloc() returns NULL when the pool is exhausted;
+ * allocOrHeap() falls back to malloc() instead and counts the spill.
+ * */
+
+template <size_t BlockSize, size_t Capacity>
+class AsyncWebBlockPool {
+  private:
+    union Block {
+      Block *next;
+      uint8_t data[BlockSize];
+      max_align_t align;
+    };
+    Block _blocks[Capacity];
+    Block *_free;
+    size_t _used;
+    size_t _spilled;
+    ASYNCWEB_POOL_LOCK_TYPE _lock;
+
+  public:
+    static constexpr size_t blockSize = BlockSize;
+    static constexpr size_t capacity = Capacity;
+
+    AsyncWebBlockPool(): _free(nullptr), _used(0), _spilled(0), _lock(ASYNCWEB_POOL_LOCK_INIT) {
+      for(size_t i = Capacity; i > 0; i--){
+        _blocks[i - 1].next = _free;
+        _free = &_blocks[i - 1];
+      }
+    }
+
+    void *alloc(){
+      ASYNCWEB_POOL_ENTER(_lock);
+      Block *b = _free;
+      if(b){
+        _free = b->next;
+        _used++;
+      }
+      ASYNCWEB_POOL_EXIT(_lock);
+      return b;
+    }
+
+    void release(void *p){
+      if(!p) return;
+      Block *b = static_cast<Block *>(p);
+      ASYNCWEB_POOL_ENTER(_lock);
+      b->next = _free;
+      _free = b;
+      _used--;
+      ASYNCWEB_POOL_EXIT(_lock);
+    }
+
+    void *allocOrHeap(size_t size){
+      void *p = size <= BlockSize ? alloc() : NULL;
+      if(p == NULL){
+        ASYNCWEB_POOL_ENTER(_lock);
+        _spilled++;
+        ASYNCWEB_POOL_EXIT(_lock);
+        p = malloc(size);
+      }
+      return p;
+    }
+
+    // Releases a block from alloc() or allocOrHeap()
+    void releaseAny(void *p){
+      if(owns(p))
+        release(p);
+      else
+        free(p);
+    }
+
+    bool owns(const void *p) const {
+      const uint8_t *u = static_cast<const uint8_t *>(p);
+      return u >= (const uint8_t *)_blocks && u < (const uint8_t *)(_blocks + Capacity);
+    }
+
+    size_t used() const { return _used; }
+    size_t available() const { return Capacity - _used; }
+    size_t spilled() const { return _spilled; }
+};
+
+#endif /* WEBOBJECTPOOL_H_ */
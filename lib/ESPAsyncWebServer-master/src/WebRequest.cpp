@@ -27,6 +27,44 @@
 #endif
 
 static const String SharedEmptyString = String();
+static const AsyncWebText SharedEmptyText = AsyncWebText();
+
+static String spanToString(const char *str, size_t len){
+  String s;
+  s.concat(str, len);
+  return s;
+}
+
+static bool spanContainsIgnoreCase(const char *str, size_t len, const char *lit){
+  size_t litLen = strlen(lit);
+  for(size_t i = 0; i + litLen <= len; i++){
+    if(strncasecmp(str + i, lit, litLen) == 0)
+      return true;
+  }
+  return false;
+}
+
+// Decodes %XX and '+' into out, which needs room for len bytes; returns the decoded length
+static size_t urlDecodeTo(const char *text, size_t len, char *out){
+  char temp[] = "0x00";
+  size_t i = 0;
+  size_t n = 0;
+  while (i < len){
+    char decodedChar;
+    char encodedChar = text[i++];
+    if ((encodedChar == '%') && (i + 1 < len)){
+      temp[2] = text[i++];
+      temp[3] = text[i++];
+      decodedChar = strtol(temp, NULL, 16);
+    } else if (encodedChar == '+') {
+      decodedChar = ' ';
+    } else {
+      decodedChar = encodedChar;  // normal ascii char
+    }
+    out[n++] = decodedChar;
+  }
+  return n;
+}
 
 #define __is_param_char(c) ((c) && ((c) != '{') && ((c) != '[') && ((c) != '&') && ((c) != '='))
 
@@ -53,9 +91,7 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _expectingContinue(false)
   , _contentLength(0)
   , _parsedLength(0)
-  , _headers(LinkedList<AsyncWebHeader *>([](AsyncWebHeader *h){ delete h; }))
-  , _params(LinkedList<AsyncWebParameter *>([](AsyncWebParameter *p){ delete p; }))
-  , _pathParams(LinkedList<String *>([](String *p){ delete p; }))
+  , _rejectCode(0)
   , _multiParseState(0)
   , _boundaryPosition(0)
   , _itemStartIndex(0)
@@ -78,13 +114,6 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
 }
 
 AsyncWebServerRequest::~AsyncWebServerRequest(){
-  _headers.free();
-
-  _params.free();
-  _pathParams.free();
-
-  _interestingHeaders.free();
-
   if(_response != NULL){
     delete _response;
   }
@@ -103,24 +132,22 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
   while (true) {
 
   if(_parseState < PARSE_REQ_BODY){
-    // Find new line in buf
+    // Lines are parsed straight out of the packet; only a line that straddles
+    // a packet boundary is collected in _temp
     char *str = (char*)buf;
-    for (i = 0; i < len; i++) {
-      if (str[i] == '\n') {
-        break;
+    char *eol = (char*)memchr(str, '\n', len);
+    if (eol == NULL) {
+      _temp.concat(str, len);
+    } else {
+      i = eol - str;
+      if (_temp.length()) {
+        _temp.concat(str, i);
+        String line = _temp;
+        _temp = String();
+        _parseLine(line.c_str(), line.length());
+      } else {
+        _parseLine(str, i);
       }
-    }
-    if (i == len) { // No new line, just add the buffer in _temp
-      char ch = str[len-1];
-      str[len-1] = 0;
-      _temp.reserve(_temp.length()+len);
-      _temp.concat(str);
-      _temp.concat(ch);
-    } else { // Found new line - extract it and parse
-      str[i] = 0; // Terminate the string at the end of the line.
-      _temp.concat(str);
-      _temp.trim();
-      _parseLine();
       if (++i < len) {
         // Still have more buffer to process
         buf = str+i;
@@ -158,11 +185,7 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
         if(_handler) _handler->handleBody(this, (uint8_t*)buf, len, _parsedLength, _contentLength);
         _parsedLength += len;
       } else if(needParse) {
-        size_t i;
-        for(i=0; i<len; i++){
-          _parsedLength++;
-          _parsePlainPostChar(((uint8_t*)buf)[i]);
-        }
+        _parsePlainPost((uint8_t*)buf, len);
       } else {
         _parsedLength += len;
       }
@@ -170,7 +193,8 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
     if(_parsedLength == _contentLength){
       _parseState = PARSE_REQ_END;
       //check if authenticated before calling handleRequest and request auth instead
-      if(_handler) _handler->handleRequest(this);
+      if(_rejectCode) send(_rejectCode);
+      else if(_handler) _handler->handleRequest(this);
       else send(501);
     }
   }
@@ -178,12 +202,27 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
   }
 }
 
+bool AsyncWebServerRequest::_isInterestingHeader(const char *name, size_t len) const {
+  uint32_t hash = asyncWebFoldHash(name, len);
+  for(size_t i = 0; i < _interestingHeaders.length(); i++){
+    const String& h = _interestingHeaders[i];
+    if(_interestingHeaders.tag(i) == hash && h.length() == len && strncasecmp(h.c_str(), name, len) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
 void AsyncWebServerRequest::_removeNotInterestingHeaders(){
-  if (_interestingHeaders.containsIgnoreCase("ANY")) return; // nothing to do
-  for(const auto& header: _headers){
-      if(!_interestingHeaders.containsIgnoreCase(header->name().c_str())){
-        _headers.remove(header);
-      }
+  if (_isInterestingHeader("ANY", 3)) return; // nothing to do
+  size_t i = 0;
+  while(i < _headers.length()){
+    const AsyncWebText& name = _headers[i].name();
+    if(!_isInterestingHeader(name.c_str(), name.length())){
+      _headers.erase(i);
+    } else {
+      i++;
+    }
   }
 }
 
@@ -229,65 +268,104 @@ void AsyncWebServerRequest::_onDisconnect(){
   _server->_handleDisconnect(this);
 }
 
-void AsyncWebServerRequest::_addParam(AsyncWebParameter *p){
-  _params.add(p);
+// The first limit a request runs into decides the status it is answered with
+void AsyncWebServerRequest::_reject(uint16_t code){
+  if(!_rejectCode)
+    _rejectCode = code;
+}
+
+// Copies text into the arena, URL-decoding it on the way if asked to
+bool AsyncWebServerRequest::_storeText(const char *text, size_t len, bool decode, AsyncWebText& out){
+  char *p = _arena.reserve(len);
+  if(p == NULL)
+    return false;
+  if(decode){
+    len = urlDecodeTo(text, len, p);
+  } else {
+    memcpy(p, text, len);
+  }
+  out = _arena.commit(len);
+  return true;
+}
+
+void AsyncWebServerRequest::_addParam(const AsyncWebText& name, const AsyncWebText& value, bool form, bool file, size_t size){
+  if(_params.add(asyncWebFoldHash(name.c_str(), name.length()), name, value, form, file, size) == nullptr)
+    _reject(form ? 413 : 414);
+}
+
+void AsyncWebServerRequest::_addParam(const String& name, const String& value, bool form, bool file, size_t size){
+  AsyncWebText n, v;
+  if(!_storeText(name.c_str(), name.length(), false, n) || !_storeText(value.c_str(), value.length(), false, v)){
+    _reject(form ? 413 : 414);
+    return;
+  }
+  _addParam(n, v, form, file, size);
 }
 
 void AsyncWebServerRequest::_addPathParam(const char *p){
-  _pathParams.add(new String(p));
+  _pathParams.add(0, p);
 }
 
 void AsyncWebServerRequest::_addGetParams(const String& params){
-  size_t start = 0;
-  while (start < params.length()){
-    int end = params.indexOf('&', start);
-    if (end < 0) end = params.length();
-    int equal = params.indexOf('=', start);
-    if (equal < 0 || equal > end) equal = end;
-    String name = params.substring(start, equal);
-    String value = equal + 1 < end ? params.substring(equal + 1, end) : String();
-    _addParam(new AsyncWebParameter(urlDecode(name), urlDecode(value)));
-    start = end + 1;
+  _addGetParams(params.c_str(), params.length());
+}
+
+void AsyncWebServerRequest::_addGetParams(const char *params, size_t len){
+  const char *end = params + len;
+  while (params < end){
+    const char *amp = (const char*)memchr(params, '&', end - params);
+    if (amp == NULL) amp = end;
+    const char *equal = (const char*)memchr(params, '=', amp - params);
+    if (equal == NULL) equal = amp;
+    const char *v = equal + 1 < amp ? equal + 1 : amp;
+    AsyncWebText name, value;
+    if(!_storeText(params, equal - params, true, name) || !_storeText(v, amp - v, true, value)){
+      _reject(414);
+      return;
+    }
+    _addParam(name, value);
+    params = amp + 1;
   }
 }
 
-bool AsyncWebServerRequest::_parseReqHead(){
+bool AsyncWebServerRequest::_parseReqHead(const char *line, size_t len){
   // Split the head into method, url and version
-  int index = _temp.indexOf(' ');
-  String m = _temp.substring(0, index);
-  index = _temp.indexOf(' ', index+1);
-  String u = _temp.substring(m.length()+1, index);
-  _temp = _temp.substring(index+1);
-
-  if(m == "GET"){
+  const char *end = line + len;
+  const char *m = line;
+  const char *u = (const char*)memchr(line, ' ', len);
+  u = u ? u + 1 : end;
+  const char *v = (const char*)memchr(u, ' ', end - u);
+  const char *uEnd = v ? v : end;
+  v = v ? v + 1 : end;
+  size_t mLen = (u > m && u[-1] == ' ') ? u - m - 1 : u - m;
+
+  if(mLen == 3 && !strncmp(m, "GET", 3)){
     _method = HTTP_GET;
-  } else if(m == "POST"){
+  } else if(mLen == 4 && !strncmp(m, "POST", 4)){
     _method = HTTP_POST;
-  } else if(m == "DELETE"){
+  } else if(mLen == 6 && !strncmp(m, "DELETE", 6)){
     _method = HTTP_DELETE;
-  } else if(m == "PUT"){
+  } else if(mLen == 3 && !strncmp(m, "PUT", 3)){
     _method = HTTP_PUT;
-  } else if(m == "PATCH"){
+  } else if(mLen == 5 && !strncmp(m, "PATCH", 5)){
     _method = HTTP_PATCH;
-  } else if(m == "HEAD"){
+  } else if(mLen == 4 && !strncmp(m, "HEAD", 4)){
     _method = HTTP_HEAD;
-  } else if(m == "OPTIONS"){
+  } else if(mLen == 7 && !strncmp(m, "OPTIONS", 7)){
     _method = HTTP_OPTIONS;
   }
 
-  String g = String();
-  index = u.indexOf('?');
-  if(index > 0){
-    g = u.substring(index +1);
-    u = u.substring(0, index);
+  const char *q = (const char*)memchr(u, '?', uEnd - u);
+  if(q != NULL && q > u){
+    _url = _urlDecode(u, q - u);
+    _addGetParams(q + 1, uEnd - q - 1);
+  } else {
+    _url = _urlDecode(u, uEnd - u);
   }
-  _url = urlDecode(u);
-  _addGetParams(g);
 
-  if(!_temp.startsWith("HTTP/1.0"))
+  if(end - v < 8 || memcmp(v, "HTTP/1.0", 8) != 0)
     _version = 1;
 
-  _temp = String();
   return true;
 }
 
@@ -309,61 +387,102 @@ bool strContains(String src, String find, bool mindcase = true) {
   return false;
 }
 
-bool AsyncWebServerRequest::_parseReqHeader(){
-  int index = _temp.indexOf(':');
-  if(index){
-    String name = _temp.substring(0, index);
-    String value = _temp.substring(index + 2);
-    if(name.equalsIgnoreCase("Host")){
-      _host = value;
-    } else if(name.equalsIgnoreCase("Content-Type")){
-	  _contentType = value.substring(0, value.indexOf(';'));
-      if (value.startsWith("multipart/")){
-        _boundary = value.substring(value.indexOf('=')+1);
-        _boundary.replace("\"","");
-        _isMultipart = true;
-      }
-    } else if(name.equalsIgnoreCase("Content-Length")){
-      _contentLength = atoi(value.c_str());
-    } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
-      _expectingContinue = true;
-    } else if(name.equalsIgnoreCase("Authorization")){
-      if(value.length() > 5 && value.substring(0,5).equalsIgnoreCase("Basic")){
-        _authorization = value.substring(6);
-      } else if(value.length() > 6 && value.substring(0,6).equalsIgnoreCase("Digest")){
-        _isDigest = true;
-        _authorization = value.substring(7);
-      }
+// Name and value are copied into the arena once; the headers the request itself acts on are
+// read from those copies. A line without a colon is not a header and is skipped; older versions
+// stored it with the whole line as the name and all but its first character as the value.
+bool AsyncWebServerRequest::_parseReqHeader(const char *line, size_t len){
+  const char *colon = (const char*)memchr(line, ':', len);
+  if(colon == NULL || colon == line || _rejectCode)
+    return true;
+
+  size_t nameLen = colon - line;
+  size_t valueStart = nameLen + 2 < len ? nameLen + 2 : len;
+  AsyncWebText name, value;
+  if(!_storeText(line, nameLen, false, name) || !_storeText(line + valueStart, len - valueStart, false, value) ||
+     _headers.add(asyncWebFoldHash(line, nameLen), name, value) == nullptr){
+    _reject(431);
+    return true;
+  }
+
+  const char *v = value.c_str();
+  size_t vLen = value.length();
+  if(name.equalsIgnoreCase("Host")){
+    _host = value;
+  } else if(name.equalsIgnoreCase("Content-Type")){
+    const char *semicolon = (const char*)memchr(v, ';', vLen);
+    _contentType = spanToString(v, semicolon ? semicolon - v : vLen);
+    if (value.startsWith("multipart/")){
+      const char *equal = (const char*)memchr(v, '=', vLen);
+      const char *b = equal ? equal + 1 : v;
+      _boundary = spanToString(b, vLen - (b - v));
+      _boundary.replace("\"","");
+      _isMultipart = true;
+    }
+  } else if(name.equalsIgnoreCase("Content-Length")){
+    _contentLength = atoi(v);
+  } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
+    _expectingContinue = true;
+  } else if(name.equalsIgnoreCase("Authorization")){
+    if(vLen > 5 && strncasecmp(v, "Basic", 5) == 0){
+      _authorization = spanToString(v + 6, vLen - 6);
+    } else if(vLen > 6 && strncasecmp(v, "Digest", 6) == 0){
+      _isDigest = true;
+      _authorization = spanToString(v + 7, vLen - 7);
+    }
+  } else {
+    if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
+      // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
+      _reqconntype = RCT_WS;
     } else {
-      if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
-        // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
-        _reqconntype = RCT_WS;
-      } else {
-        if(name.equalsIgnoreCase("Accept") && strContains(value, "text/event-stream", false)){
-          // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
-          _reqconntype = RCT_EVENT;
-        }
+      if(name.equalsIgnoreCase("Accept") && spanContainsIgnoreCase(v, vLen, "text/event-stream")){
+        // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
+        _reqconntype = RCT_EVENT;
       }
     }
-    _headers.add(new AsyncWebHeader(name, value));
   }
-  _temp = String();
   return true;
 }
 
-void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
-  if(data && (char)data != '&')
-    _temp += (char)data;
-  if(!data || (char)data == '&' || _parsedLength == _contentLength){
-    String name = "body";
-    String value = _temp;
-    if(!_temp.startsWith("{") && !_temp.startsWith("[") && _temp.indexOf('=') > 0){
-      name = _temp.substring(0, _temp.indexOf('='));
-      value = _temp.substring(_temp.indexOf('=') + 1);
+void AsyncWebServerRequest::_parsePlainPost(const uint8_t *data, size_t len){
+  // Fields end at '&', NUL or the end of the body; only a field split across
+  // packets is collected in _temp
+  const char *str = (const char*)data;
+  while(len){
+    size_t n = 0;
+    while(n < len && str[n] && str[n] != '&') n++;
+    bool terminated = n < len;
+    _parsedLength += n + (terminated ? 1 : 0);
+    if(terminated || _parsedLength == _contentLength){
+      if(_temp.length()){
+        _temp.concat(str, n);
+        String field = _temp;
+        _temp = String();
+        _addPlainPostParam(field.c_str(), field.length());
+      } else {
+        _addPlainPostParam(str, n);
+      }
+    } else {
+      _temp.concat(str, n);
     }
-    _addParam(new AsyncWebParameter(urlDecode(name), urlDecode(value), true));
-    _temp = String();
+    if(terminated) n++;
+    str += n;
+    len -= n;
+  }
+}
+
+void AsyncWebServerRequest::_addPlainPostParam(const char *field, size_t len){
+  const char *equal = (const char*)memchr(field, '=', len);
+  AsyncWebText name("body", 4), value;
+  bool stored;
+  if(len && field[0] != '{' && field[0] != '[' && equal != NULL && equal > field){
+    stored = _storeText(field, equal - field, true, name) && _storeText(equal + 1, len - (equal - field) - 1, true, value);
+  } else {
+    stored = _storeText(field, len, true, value);
   }
+  if(stored)
+    _addParam(name, value, true);
+  else
+    _reject(413);
 }
 
 void AsyncWebServerRequest::_handleUploadByte(uint8_t data, bool last){
@@ -508,13 +627,13 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
     } else if(_boundaryPosition == _boundary.length() - 1){
       _multiParseState = DASH3_OR_RETURN2;
       if(!_itemIsFile){
-        _addParam(new AsyncWebParameter(_itemName, _itemValue, true));
+        _addParam(_itemName, _itemValue, true);
       } else {
         if(_itemSize){
           //check if authenticated before calling the upload
           if(_handler) _handler->handleUpload(this, _itemFilename, _itemSize - _itemBufferIndex, _itemBuffer, _itemBufferIndex, true);
           _itemBufferIndex = 0;
-          _addParam(new AsyncWebParameter(_itemName, _itemFilename, true, true, _itemSize));
+          _addParam(_itemName, _itemFilename, true, true, _itemSize);
         }
         free(_itemBuffer);
         _itemBuffer = NULL;
@@ -551,21 +670,34 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
   }
 }
 
-void AsyncWebServerRequest::_parseLine(){
+void AsyncWebServerRequest::_parseLine(const char *line, size_t len){
+  // Trim surrounding whitespace, including the trailing '\r'
+  while(len && isspace((unsigned char)line[0])){
+    line++;
+    len--;
+  }
+  while(len && isspace((unsigned char)line[len - 1]))
+    len--;
+
   if(_parseState == PARSE_REQ_START){
-    if(!_temp.length()){
+    if(!len){
       _parseState = PARSE_REQ_FAIL;
       _client->close();
     } else {
-      _parseReqHead();
+      _parseReqHead(line, len);
       _parseState = PARSE_REQ_HEADERS;
     }
     return;
   }
 
   if(_parseState == PARSE_REQ_HEADERS){
-    if(!_temp.length()){
+    if(!len){
       //end of headers
+      if(_rejectCode){
+        _parseState = PARSE_REQ_END;
+        send(_rejectCode);
+        return;
+      }
       _server->_rewriteRequest(this);
       _server->_attachHandler(this);
       _removeNotInterestingHeaders();
@@ -581,7 +713,7 @@ void AsyncWebServerRequest::_parseLine(){
         if(_handler) _handler->handleRequest(this);
         else send(501);
       }
-    } else _parseReqHeader();
+    } else _parseReqHeader(line, len);
   }
 }
 
@@ -590,60 +722,33 @@ size_t AsyncWebServerRequest::headers() const{
 }
 
 bool AsyncWebServerRequest::hasHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return true;
-    }
-  }
-  return false;
+  return getHeader(name) != nullptr;
 }
 
 bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = 0;
-  while (1) {
-    if (pgm_read_byte(p+n) == 0) break;
-      n += 1;
-  }
-  char * name = (char*) malloc(n+1);
-  name[n] = 0; 
-  if (name) {
-    for(size_t b=0; b<n; b++)
-      name[b] = pgm_read_byte(p++);    
-    bool result = hasHeader( String(name) ); 
-    free(name); 
-    return result; 
-  } else {
-    return false; 
-  }
+  return hasHeader(String(data));
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return h;
+  return _findHeader(name.c_str(), name.length());
+}
+
+AsyncWebHeader* AsyncWebServerRequest::_findHeader(const char *name, size_t len) const {
+  uint32_t hash = asyncWebFoldHash(name, len);
+  for(size_t i = 0; i < _headers.length(); i++){
+    if(_headers.tag(i) == hash && _headers[i].name().equalsIgnoreCase(name, len)){
+      return const_cast<AsyncWebHeader*>(&_headers[i]);
     }
   }
   return nullptr;
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * data) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p); 
-  char * name = (char*) malloc(n+1);
-  if (name) {
-    strcpy_P(name, p); 
-    AsyncWebHeader* result = getHeader( String(name)); 
-    free(name); 
-    return result; 
-  } else {
-    return nullptr; 
-  }
+  return getHeader(String(data));
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(size_t num) const {
-  auto header = _headers.nth(num);
-  return header ? *header : nullptr;
+  return const_cast<AsyncWebHeader*>(_headers.nth(num));
 }
 
 size_t AsyncWebServerRequest::params() const {
@@ -651,61 +756,35 @@ size_t AsyncWebServerRequest::params() const {
 }
 
 bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
-  for(const auto& p: _params){
-    if(p->name() == name && p->isPost() == post && p->isFile() == file){
-      return true;
-    }
-  }
-  return false;
+  return getParam(name, post, file) != nullptr;
 }
 
 bool AsyncWebServerRequest::hasParam(const __FlashStringHelper * data, bool post, bool file) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p);
-
-  char * name = (char*) malloc(n+1);
-  name[n] = 0; 
-  if (name) {
-    strcpy_P(name,p);    
-    bool result = hasParam( name, post, file); 
-    free(name); 
-    return result; 
-  } else {
-    return false; 
-  }
+  return hasParam(String(data), post, file);
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
-  for(const auto& p: _params){
-    if(p->name() == name && p->isPost() == post && p->isFile() == file){
-      return p;
+  uint32_t hash = asyncWebFoldHash(name);
+  for(size_t i = 0; i < _params.length(); i++){
+    const AsyncWebParameter& p = _params[i];
+    if(_params.tag(i) == hash && p.name() == name && p.isPost() == post && p.isFile() == file){
+      return const_cast<AsyncWebParameter*>(&p);
     }
   }
   return nullptr;
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(const __FlashStringHelper * data, bool post, bool file) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p);
-  char * name = (char*) malloc(n+1);
-  if (name) {
-    strcpy_P(name, p);   
-    AsyncWebParameter* result = getParam(name, post, file); 
-    free(name); 
-    return result; 
-  } else {
-    return nullptr; 
-  }
+  return getParam(String(data), post, file);
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(size_t num) const {
-  auto param = _params.nth(num);
-  return param ? *param : nullptr;
+  return const_cast<AsyncWebParameter*>(_params.nth(num));
 }
 
 void AsyncWebServerRequest::addInterestingHeader(const String& name){
-  if(!_interestingHeaders.containsIgnoreCase(name))
-    _interestingHeaders.add(name);
+  if(!_isInterestingHeader(name.c_str(), name.length()))
+    _interestingHeaders.add(asyncWebFoldHash(name), name);
 }
 
 void AsyncWebServerRequest::send(AsyncWebServerResponse *response){
@@ -768,6 +847,10 @@ AsyncWebServerResponse * AsyncWebServerRequest::beginResponse_P(int code, const
   return beginResponse_P(code, contentType, (const uint8_t *)content, strlen_P(content), callback);
 }
 
+AsyncWebServerResponse * AsyncWebServerRequest::beginResponse(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback){
+  return new AsyncTemplateResponse(code, contentType, page, callback);
+}
+
 void AsyncWebServerRequest::send(int code, const String& contentType, const String& content){
   send(beginResponse(code, contentType, content));
 }
@@ -804,6 +887,10 @@ void AsyncWebServerRequest::send_P(int code, const String& contentType, PGM_P co
   send(beginResponse_P(code, contentType, content, callback));
 }
 
+void AsyncWebServerRequest::send(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback){
+  send(beginResponse(code, contentType, page, callback));
+}
+
 void AsyncWebServerRequest::redirect(const String& url){
   AsyncWebServerResponse * response = beginResponse(302);
   response->addHeader("Location",url);
@@ -862,8 +949,10 @@ void AsyncWebServerRequest::requestAuthentication(const char * realm, bool isDig
 }
 
 bool AsyncWebServerRequest::hasArg(const char* name) const {
-  for(const auto& arg: _params){
-    if(arg->name() == name){
+  size_t len = strlen(name);
+  uint32_t hash = asyncWebFoldHash(name, len);
+  for(size_t i = 0; i < _params.length(); i++){
+    if(_params.tag(i) == hash && _params[i].name() == name){
       return true;
     }
   }
@@ -871,106 +960,70 @@ bool AsyncWebServerRequest::hasArg(const char* name) const {
 }
 
 bool AsyncWebServerRequest::hasArg(const __FlashStringHelper * data) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p); 
-  char * name = (char*) malloc(n+1);
-  if (name) {
-    strcpy_P(name, p);    
-    bool result = hasArg( name ); 
-    free(name); 
-    return result; 
-  } else {
-    return false; 
-  }
+  return hasArg(String(data).c_str());
 }
 
 
-const String& AsyncWebServerRequest::arg(const String& name) const {
-  for(const auto& arg: _params){
-    if(arg->name() == name){
-      return arg->value();
+const AsyncWebText& AsyncWebServerRequest::arg(const String& name) const {
+  uint32_t hash = asyncWebFoldHash(name);
+  for(size_t i = 0; i < _params.length(); i++){
+    if(_params.tag(i) == hash && _params[i].name() == name){
+      return _params[i].value();
     }
   }
-  return SharedEmptyString;
+  return SharedEmptyText;
 }
 
-const String& AsyncWebServerRequest::arg(const __FlashStringHelper * data) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p);
-  char * name = (char*) malloc(n+1);
-  if (name) {
-    strcpy_P(name, p);
-    const String & result = arg( String(name) ); 
-    free(name); 
-    return result; 
-  } else {
-    return SharedEmptyString;
-  }
-
+const AsyncWebText& AsyncWebServerRequest::arg(const __FlashStringHelper * data) const {
+  return arg(String(data));
 }
 
-const String& AsyncWebServerRequest::arg(size_t i) const {
+const AsyncWebText& AsyncWebServerRequest::arg(size_t i) const {
   return getParam(i)->value();
 }
 
-const String& AsyncWebServerRequest::argName(size_t i) const {
+const AsyncWebText& AsyncWebServerRequest::argName(size_t i) const {
   return getParam(i)->name();
 }
 
 const String& AsyncWebServerRequest::pathArg(size_t i) const {
   auto param = _pathParams.nth(i);
-  return param ? **param : SharedEmptyString;
+  return param ? *param : SharedEmptyString;
 }
 
-const String& AsyncWebServerRequest::header(const char* name) const {
-  AsyncWebHeader* h = getHeader(String(name));
-  return h ? h->value() : SharedEmptyString;
+const AsyncWebText& AsyncWebServerRequest::header(const char* name) const {
+  AsyncWebHeader* h = _findHeader(name, strlen(name));
+  return h ? h->value() : SharedEmptyText;
 }
 
-const String& AsyncWebServerRequest::header(const __FlashStringHelper * data) const {
-  PGM_P p = reinterpret_cast<PGM_P>(data);
-  size_t n = strlen_P(p); 
-  char * name = (char*) malloc(n+1);
-  if (name) {
-    strcpy_P(name, p);  
-    const String & result = header( (const char *)name ); 
-    free(name); 
-    return result; 
-  } else {
-    return SharedEmptyString; 
-  }
-};  
+const AsyncWebText& AsyncWebServerRequest::header(const __FlashStringHelper * data) const {
+  AsyncWebHeader* h = getHeader(String(data));
+  return h ? h->value() : SharedEmptyText;
+}
 
 
-const String& AsyncWebServerRequest::header(size_t i) const {
+const AsyncWebText& AsyncWebServerRequest::header(size_t i) const {
   AsyncWebHeader* h = getHeader(i);
-  return h ?  h->value() : SharedEmptyString;
+  return h ?  h->value() : SharedEmptyText;
 }
 
-const String& AsyncWebServerRequest::headerName(size_t i) const {
+const AsyncWebText& AsyncWebServerRequest::headerName(size_t i) const {
   AsyncWebHeader* h = getHeader(i);
-  return h ? h->name() : SharedEmptyString;
+  return h ? h->name() : SharedEmptyText;
 }
 
 String AsyncWebServerRequest::urlDecode(const String& text) const {
-  char temp[] = "0x00";
-  unsigned int len = text.length();
-  unsigned int i = 0;
+  return _urlDecode(text.c_str(), text.length());
+}
+
+String AsyncWebServerRequest::_urlDecode(const char *text, size_t len) const {
   String decoded = String();
-  decoded.reserve(len); // Allocate the string internal buffer - never longer from source text
-  while (i < len){
-    char decodedChar;
-    char encodedChar = text.charAt(i++);
-    if ((encodedChar == '%') && (i + 1 < len)){
-      temp[2] = text.charAt(i++);
-      temp[3] = text.charAt(i++);
-      decodedChar = strtol(temp, NULL, 16);
-    } else if (encodedChar == '+') {
-      decodedChar = ' ';
-    } else {
-      decodedChar = encodedChar;  // normal ascii char
-    }
-    decoded.concat(decodedChar);
+  char small[64];
+  char *buf = len <= sizeof(small) ? small : (char*)malloc(len);
+  if(buf != NULL){
+    decoded.concat(buf, urlDecodeTo(text, len, buf));
+    if(buf != small)
+      free(buf);
   }
   return decoded;
 }
@@ -42,6 +42,11 @@ class AsyncBasicResponse: public AsyncWebServerResponse {
 class AsyncAbstractResponse: public AsyncWebServerResponse {
   private:
     String _head;
+    size_t _headSent;
+    uint8_t* _sendBuffer;
+    size_t _sendStart; // _sendBuffer[_sendStart, _sendEnd) was read but not yet taken by the client
+    size_t _sendEnd;
+    bool _contentDone;
     // Data is inserted into cache at begin(). 
     // This is inefficient with vector, but if we use some other container, 
     // we won't be able to access it as contiguous array of bytes when reading from it,
@@ -53,10 +58,15 @@ class AsyncAbstractResponse: public AsyncWebServerResponse {
     AwsTemplateProcessor _callback;
   public:
     AsyncAbstractResponse(AwsTemplateProcessor callback=nullptr);
+    virtual ~AsyncAbstractResponse();
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return false; }
     virtual size_t _fillBuffer(uint8_t *buf __attribute__((unused)), size_t maxLen __attribute__((unused))) { return 0; }
+    // Whole content at a fixed address that stays valid until acked, or NULL when it has
+    // to go through _fillBuffer(); _consumeContent() reports bytes handed to the client
+    virtual const uint8_t* _stableContent() { return NULL; }
+    virtual void _consumeContent(size_t len __attribute__((unused))) {}
 };
 
 #ifndef TEMPLATE_PLACEHOLDER
@@ -116,6 +126,48 @@ class AsyncProgmemResponse: public AsyncAbstractResponse {
     AsyncProgmemResponse(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback=nullptr);
     bool _sourceValid() const { return true; }
     virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+    virtual const uint8_t* _stableContent() override;
+    virtual void _consumeContent(size_t len) override;
+};
+
+/*
+ * Template page kept in flash. Placeholder positions are found in one pass on the
+ * first serve and reused afterwards, so rendering only patches the known spots.
+ * */
+
+class AsyncWebTemplate {
+  public:
+    struct Placeholder {
+      size_t offset;   // position of the opening TEMPLATE_PLACEHOLDER
+      uint8_t length;  // including both placeholder characters; 2 is an escaped one
+    };
+  private:
+    const uint8_t * _content;
+    size_t _length;
+    bool _compiled;
+    std::vector<Placeholder> _placeholders;
+  public:
+    AsyncWebTemplate(const uint8_t * content, size_t len);
+    AsyncWebTemplate(PGM_P content);
+    void compile();
+    const uint8_t * content() const { return _content; }
+    size_t length() const { return _length; }
+    size_t placeholders() const { return _placeholders.size(); }
+    const Placeholder& placeholder(size_t i) const { return _placeholders[i]; }
+};
+
+class AsyncTemplateResponse: public AsyncAbstractResponse {
+  private:
+    AsyncWebTemplate& _page;
+    AwsTemplateProcessor _processor;
+    size_t _pos;
+    size_t _next;
+    String _value;
+    size_t _valueSent;
+  public:
+    AsyncTemplateResponse(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback);
+    bool _sourceValid() const { return true; }
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
 };
 
 class cbuf;
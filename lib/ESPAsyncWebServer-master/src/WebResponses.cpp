@@ -20,6 +20,7 @@
 */
 #include "ESPAsyncWebServer.h"
 #include "WebResponseImpl.h"
+#include "WebObjectPool.h"
 #include "cbuf.h"
 
 // Since ESP8266 does not link memchr by default, here's its implementation.
@@ -72,6 +73,7 @@ const char* AsyncWebServerResponse::_responseCodeToString(int code) {
     case 415: return "Unsupported Media Type";
     case 416: return "Requested range not satisfiable";
     case 417: return "Expectation Failed";
+    case 431: return "Request Header Fields Too Large";
     case 500: return "Internal Server Error";
     case 501: return "Not Implemented";
     case 502: return "Bad Gateway";
@@ -96,7 +98,7 @@ AsyncWebServerResponse::AsyncWebServerResponse()
   , _state(RESPONSE_SETUP)
 {
   for(auto header: DefaultHeaders::Instance()) {
-    _headers.add(new AsyncWebHeader(header->name(), header->value()));
+    _headers.add(new AsyncWebHeader(header->name().c_str(), header->value().c_str()));
   }
 }
 
@@ -244,7 +246,7 @@ size_t AsyncBasicResponse::_ack(AsyncWebServerRequest *request, size_t len, uint
  * Abstract Response
  * */
 
-AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _callback(callback)
+AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _headSent(0), _sendBuffer(NULL), _sendStart(0), _sendEnd(0), _contentDone(false), _callback(callback)
 {
   // In case of template processing, we're unable to determine real response size
   if(callback) {
@@ -261,6 +263,35 @@ void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request){
   _ack(request, 0, 0);
 }
 
+/*
+ * Send buffers
+ * Responses fill the TCP buffer through one fixed-size block that is held from the
+ * first content write until the body is done. Blocks come from a static pool; only
+ * when every block is in use is one taken from the heap.
+ * */
+
+static AsyncWebBlockPool<WEBSERVER_SEND_BUFFER_SIZE, WEBSERVER_SEND_BUFFERS> _sendBufferPool;
+
+static uint8_t * sendBufferAlloc(){
+  void * p = _sendBufferPool.alloc();
+  if(p == NULL)
+    p = malloc(WEBSERVER_SEND_BUFFER_SIZE);
+  return (uint8_t*)p;
+}
+
+static void sendBufferFree(uint8_t * p){
+  if(p == NULL)
+    return;
+  if(_sendBufferPool.owns(p))
+    _sendBufferPool.release(p);
+  else
+    free(p);
+}
+
+AsyncAbstractResponse::~AsyncAbstractResponse(){
+  sendBufferFree(_sendBuffer);
+}
+
 size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
   (void)time;
   if(!_sourceValid()){
@@ -269,91 +300,114 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
     return 0;
   }
   _ackedLength += len;
-  size_t space = request->client()->space();
+  AsyncClient *client = request->client();
+  size_t space = client->space();
+  size_t written = 0;
 
-  size_t headLen = _head.length();
   if(_state == RESPONSE_HEADERS){
-    if(space >= headLen){
-      _state = RESPONSE_CONTENT;
-      space -= headLen;
-    } else {
-      String out = _head.substring(0, space);
-      _head = _head.substring(space);
-      _writtenLength += request->client()->write(out.c_str(), out.length());
-      return out.length();
+    // The head is copied straight into the TCP buffer; _headSent remembers a partial write
+    size_t headLeft = _head.length() - _headSent;
+    size_t n = client->add(_head.c_str() + _headSent, std::min(space, headLeft));
+    _headSent += n;
+    written += n;
+    space -= n;
+    if(_headSent < _head.length()){
+      _writtenLength += written;
+      client->send();
+      return written;
     }
+    _head = String();
+    _headSent = 0;
+    _state = RESPONSE_CONTENT;
   }
 
   if(_state == RESPONSE_CONTENT){
-    size_t outLen;
-    if(_chunked){
-      if(space <= 8){
-        return 0;
-      }
-      outLen = space;
-    } else if(!_sendContentLength){
-      outLen = space;
-    } else {
-      outLen = ((_contentLength - _sentLength) > space)?space:(_contentLength - _sentLength);
-    }
-
-    uint8_t *buf = (uint8_t *)malloc(outLen+headLen);
-    if (!buf) {
-      // os_printf("_ack malloc %d failed\n", outLen+headLen);
-      return 0;
-    }
-
-    if(headLen){
-      memcpy(buf, _head.c_str(), _head.length());
-    }
-
-    size_t readLen = 0;
-
-    if(_chunked){
-      // HTTP 1.1 allows leading zeros in chunk length. Or spaces may be added.
-      // See RFC2616 sections 2, 3.6.1.
-      // -- OR NOT: There is nothing about spaces there, and it breaks Webkit browsers on iOS!
-      readLen = _fillBufferAndProcessTemplates(buf+headLen+6, outLen - 8);
-      if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
-          return 0;
+    // Sources that stay valid until acked (flash) are referenced, not copied
+    const uint8_t *direct = (_callback || _chunked || !_sendContentLength) ? NULL : _stableContent();
+
+    while(_state == RESPONSE_CONTENT){
+      // Bytes add() did not take last time go out before anything new is read
+      if(_sendStart < _sendEnd){
+        size_t n = client->add((const char*)_sendBuffer + _sendStart, std::min(space, _sendEnd - _sendStart));
+        _sendStart += n;
+        written += n;
+        space -= n;
+        if(_sendStart < _sendEnd)
+          break;
       }
-      outLen = sprintf((char*)buf+headLen, "%04x", readLen) + headLen;
-      // while(outLen < headLen + 4) buf[outLen++] = ' ';
-      buf[outLen++] = '\r';
-      buf[outLen++] = '\n';
-      outLen += readLen;
-      buf[outLen++] = '\r';
-      buf[outLen++] = '\n';
-    } else {
-      readLen = _fillBufferAndProcessTemplates(buf+headLen, outLen);
-      if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
-          return 0;
+      if(_contentDone || (_sendContentLength && !_chunked && _sentLength == _contentLength)){
+        _state = RESPONSE_WAIT_ACK;
+        sendBufferFree(_sendBuffer);
+        _sendBuffer = NULL;
+        break;
       }
-      outLen = readLen + headLen;
-    }
 
-    if(headLen){
-        _head = String();
-    }
+      size_t outLen;
+      if(_chunked){
+        if(space <= 8)
+          break;
+        outLen = std::min(space, (size_t)WEBSERVER_SEND_BUFFER_SIZE);
+      } else {
+        if(!space)
+          break;
+        outLen = _sendContentLength ? std::min(_contentLength - _sentLength, space) : space;
+        if(!direct)
+          outLen = std::min(outLen, (size_t)WEBSERVER_SEND_BUFFER_SIZE);
+      }
 
-    if(outLen){
-        _writtenLength += request->client()->write((const char*)buf, outLen);
-    }
+      if(direct){
+        size_t n = client->add((const char*)direct + _sentLength, outLen, 0);
+        if(!n)
+          break;
+        _consumeContent(n);
+        _sentLength += n;
+        written += n;
+        space -= n;
+        continue;
+      }
 
-    if(_chunked){
-        _sentLength += readLen;
-    } else {
-        _sentLength += outLen - headLen;
+      if(!_sendBuffer && !(_sendBuffer = sendBufferAlloc()))
+        break;
+      size_t readLen;
+      if(_chunked){
+        // HTTP 1.1 allows leading zeros in chunk length. Or spaces may be added.
+        // See RFC2616 sections 2, 3.6.1.
+        // -- OR NOT: There is nothing about spaces there, and it breaks Webkit browsers on iOS!
+        readLen = _fillBufferAndProcessTemplates(_sendBuffer+6, outLen - 8);
+        if(readLen == RESPONSE_TRY_AGAIN)
+          break;
+        sprintf((char*)_sendBuffer, "%04x", readLen);
+        _sendBuffer[4] = '\r';
+        _sendBuffer[5] = '\n';
+        _sendBuffer[6+readLen] = '\r';
+        _sendBuffer[7+readLen] = '\n';
+        _sendEnd = readLen + 8;
+        _contentDone = readLen == 0; // the empty chunk ends the body
+      } else {
+        readLen = _fillBufferAndProcessTemplates(_sendBuffer, outLen);
+        if(readLen == RESPONSE_TRY_AGAIN)
+          break;
+        if(!readLen){
+          // Without a length the source ending ends the body; with one, it came up short
+          // and the response cannot be completed
+          if(_sendContentLength)
+            _state = RESPONSE_FAILED;
+          _contentDone = true;
+          continue;
+        }
+        _sendEnd = readLen;
+      }
+      _sendStart = 0;
+      _sentLength += readLen;
     }
 
-    free(buf);
-
-    if((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) || (!_chunked && _sentLength == _contentLength)){
-      _state = RESPONSE_WAIT_ACK;
+    if(written){
+      _writtenLength += written;
+      client->send();
     }
-    return outLen;
+    if(_state == RESPONSE_FAILED)
+      client->close();
+    return written;
 
   } else if(_state == RESPONSE_WAIT_ACK){
     if(!_sendContentLength || _ackedLength >= _writtenLength){
@@ -397,7 +451,7 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
     // If closing placeholder is found:
     if(pTemplateEnd) {
       // prepare argument to callback
-      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
+      const size_t paramNameLength = std::min(sizeof(buf) - 1, (size_t)(pTemplateEnd - pTemplateStart - 1));
       if(paramNameLength) {
         memcpy(buf, pTemplateStart + 1, paramNameLength);
         buf[paramNameLength] = 0;
@@ -650,6 +704,14 @@ AsyncProgmemResponse::AsyncProgmemResponse(int code, const String& contentType,
   _readLength = 0;
 }
 
+const uint8_t * AsyncProgmemResponse::_stableContent(){
+  return _content;
+}
+
+void AsyncProgmemResponse::_consumeContent(size_t len){
+  _readLength += len;
+}
+
 size_t AsyncProgmemResponse::_fillBuffer(uint8_t *data, size_t len){
   size_t left = _contentLength - _readLength;
   if (left > len) {
@@ -663,6 +725,103 @@ size_t AsyncProgmemResponse::_fillBuffer(uint8_t *data, size_t len){
 }
 
 
+/*
+ * Precompiled Template Response
+ * */
+
+AsyncWebTemplate::AsyncWebTemplate(const uint8_t * content, size_t len)
+  : _content(content)
+  , _length(len)
+  , _compiled(false)
+{}
+
+AsyncWebTemplate::AsyncWebTemplate(PGM_P content)
+  : AsyncWebTemplate((const uint8_t *)content, strlen_P(content))
+{}
+
+// Same rules as _fillBufferAndProcessTemplates: the closing placeholder has to follow
+// within TEMPLATE_PARAM_NAME_LENGTH characters, otherwise the '%' is plain text
+void AsyncWebTemplate::compile(){
+  if(_compiled)
+    return;
+  _compiled = true;
+  size_t i = 0;
+  while(i < _length){
+    if(pgm_read_byte(_content + i) != TEMPLATE_PLACEHOLDER){
+      i++;
+      continue;
+    }
+    size_t limit = std::min(_length, i + TEMPLATE_PARAM_NAME_LENGTH + 2);
+    size_t j = i + 1;
+    while(j < limit && pgm_read_byte(_content + j) != TEMPLATE_PLACEHOLDER)
+      j++;
+    if(j == limit){
+      i++;
+      continue;
+    }
+    Placeholder p;
+    p.offset = i;
+    p.length = j - i + 1;
+    _placeholders.push_back(p);
+    i = j + 1;
+  }
+}
+
+AsyncTemplateResponse::AsyncTemplateResponse(int code, const String& contentType, AsyncWebTemplate& page, AwsTemplateProcessor callback)
+  : AsyncAbstractResponse()
+  , _page(page)
+  , _processor(callback)
+  , _pos(0)
+  , _next(0)
+  , _valueSent(0)
+{
+  _code = code;
+  _contentType = contentType;
+  // The rendered size is unknown up front
+  _contentLength = 0;
+  _sendContentLength = false;
+  _chunked = true;
+  _page.compile();
+}
+
+size_t AsyncTemplateResponse::_fillBuffer(uint8_t *data, size_t len){
+  size_t filled = 0;
+  while(filled < len){
+    // Rest of the last substituted value
+    if(_valueSent < _value.length()){
+      size_t n = std::min((size_t)_value.length() - _valueSent, len - filled);
+      memcpy(data + filled, _value.c_str() + _valueSent, n);
+      _valueSent += n;
+      filled += n;
+      continue;
+    }
+    // Literal span up to the next placeholder
+    size_t end = _next < _page.placeholders() ? _page.placeholder(_next).offset : _page.length();
+    if(_pos < end){
+      size_t n = std::min(end - _pos, len - filled);
+      memcpy_P(data + filled, _page.content() + _pos, n);
+      _pos += n;
+      filled += n;
+      continue;
+    }
+    if(_next >= _page.placeholders())
+      break;
+    const AsyncWebTemplate::Placeholder& p = _page.placeholder(_next++);
+    _pos = p.offset + p.length;
+    _valueSent = 0;
+    if(p.length == 2){
+      _value = String((char)TEMPLATE_PLACEHOLDER);
+    } else {
+      char name[TEMPLATE_PARAM_NAME_LENGTH + 1];
+      memcpy_P(name, _page.content() + p.offset + 1, p.length - 2);
+      name[p.length - 2] = 0;
+      _value = _processor ? _processor(String(name)) : String();
+    }
+  }
+  return filled;
+}
+
+
 /*
  * Response Stream (You can print/write/printf to it, up to the contentLen bytes)
  * */
@@ -34,7 +34,11 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
   : _server(port)
   , _rewrites(LinkedList<AsyncWebRewrite*>([](AsyncWebRewrite* r){ delete r; }))
   , _handlers(LinkedList<AsyncWebHandler*>([](AsyncWebHandler* h){ delete h; }))
+  , _routeCount(0)
+  , _handlerCount(0)
+  , _wildcardHandlers(LinkedList<AsyncWebHandler*>(nullptr))
 {
+  _clearRoutes();
   _catchAllHandler = new AsyncCallbackWebHandler();
   if(_catchAllHandler == NULL)
     return;
@@ -70,13 +74,91 @@ AsyncWebRewrite& AsyncWebServer::rewrite(const char* from, const char* to){
   return addRewrite(new AsyncWebRewrite(from, to));
 }
 
+static uint32_t routeHash(const String& uri){
+  uint32_t h = ASYNCWEB_ROUTE_HASH_SEED;
+  for(size_t i = 0; i < uri.length(); i++)
+    h = asyncWebRouteHashStep(h, uri[i]);
+  return h;
+}
+
 AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler){
+  const String* uri = handler->routeUri();
+  handler->_order = _handlerCount++;
+  handler->_server = this;
   _handlers.add(handler);
+  _indexHandler(handler, uri ? routeHash(*uri) : 0);
   return *handler;
 }
 
 bool AsyncWebServer::removeHandler(AsyncWebHandler *handler){
-  return _handlers.remove(handler);
+  if(!_handlers.remove(handler)) // deletes the handler
+    return false;
+  _reindexRoutes();
+  return true;
+}
+
+// Open addressing has no cheap delete or move; removals and URI changes are rare, so the
+// whole index is rebuilt from the handler list
+void AsyncWebServer::_reindexRoutes(){
+  _clearRoutes();
+  for(const auto& h: _handlers){
+    const String* uri = h->routeUri();
+    _indexHandler(h, uri ? routeHash(*uri) : 0);
+  }
+}
+
+void AsyncWebHandler::_routeChanged(){
+  if(_server)
+    _server->_reindexRoutes();
+}
+
+void AsyncWebServer::_clearRoutes(){
+  for(size_t i = 0; i < WEBSERVER_ROUTE_SLOTS; i++){
+    _routes[i].hash = 0;
+    _routes[i].handler = NULL;
+  }
+  _routeCount = 0;
+  _wildcardHandlers.free();
+}
+
+void AsyncWebServer::_indexHandler(AsyncWebHandler* handler, uint32_t hash){
+  if(!handler->routeUri() || _routeCount >= WEBSERVER_ROUTE_SLOTS * 3 / 4){
+    _wildcardHandlers.add(handler);
+    return;
+  }
+  size_t i = hash & (WEBSERVER_ROUTE_SLOTS - 1);
+  while(_routes[i].handler)
+    i = (i + 1) & (WEBSERVER_ROUTE_SLOTS - 1);
+  _routes[i].hash = hash;
+  _routes[i].handler = handler;
+  _routeCount++;
+}
+
+// An exact route matches the whole url or any prefix of it that is followed by '/',
+// so the url is hashed once and the index probed at each of those boundaries.
+// The earliest registered handler that accepts the request wins, as in the plain list.
+AsyncWebHandler* AsyncWebServer::_findRoute(AsyncWebServerRequest *request){
+  if(!_routeCount)
+    return NULL;
+  AsyncWebHandler* best = NULL;
+  const String& url = request->url();
+  size_t len = url.length();
+  uint32_t h = ASYNCWEB_ROUTE_HASH_SEED;
+  for(size_t i = 0; i <= len; i++){
+    if(i == len || (i > 0 && url[i] == '/')){
+      size_t slot = h & (WEBSERVER_ROUTE_SLOTS - 1);
+      while(_routes[slot].handler){
+        AsyncWebHandler* r = _routes[slot].handler;
+        if(_routes[slot].hash == h && (!best || r->_order < best->_order)
+          && r->filter(request) && r->canHandle(request))
+          best = r;
+        slot = (slot + 1) & (WEBSERVER_ROUTE_SLOTS - 1);
+      }
+    }
+    if(i < len)
+      h = asyncWebRouteHashStep(h, url[i]);
+  }
+  return best;
 }
 
 void AsyncWebServer::begin(){
@@ -112,13 +194,20 @@ void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
 }
 
 void AsyncWebServer::_attachHandler(AsyncWebServerRequest *request){
-  for(const auto& h: _handlers){
+  AsyncWebHandler* route = _findRoute(request);
+  for(const auto& h: _wildcardHandlers){
+    if (route && h->_order > route->_order)
+      break;
     if (h->filter(request) && h->canHandle(request)){
       request->setHandler(h);
       return;
     }
   }
-  
+  if (route){
+    request->setHandler(route);
+    return;
+  }
+
   request->addInterestingHeader("ANY");
   request->setHandler(_catchAllHandler);
 }
@@ -154,6 +243,18 @@ AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodCom
   return *handler;
 }
 
+AsyncCallbackWebHandler& AsyncWebServer::on(const AsyncWebRoute& route){
+  AsyncCallbackWebHandler* handler = new AsyncCallbackWebHandler();
+  handler->setUri(route.uri);
+  handler->setMethod(route.method);
+  handler->onRequest(route.onRequest);
+  handler->_order = _handlerCount++;
+  handler->_server = this;
+  _handlers.add(handler);
+  _indexHandler(handler, route.hash);
+  return *handler;
+}
+
 AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, ArRequestHandlerFunction onRequest){
   AsyncCallbackWebHandler* handler = new AsyncCallbackWebHandler();
   handler->setUri(uri);
@@ -182,7 +283,9 @@ void AsyncWebServer::onRequestBody(ArBodyHandlerFunction fn){
 
 void AsyncWebServer::reset(){
   _rewrites.free();
+  _clearRoutes();
   _handlers.free();
+  _handlerCount = 0;
   
   if (_catchAllHandler != NULL){
     _catchAllHandler->onRequest(NULL);
@@ -0,0 +1,267 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "actuator.hpp"
+#include "probe.hpp"
+#include "recipe.hpp"
+
+#define EDGE_RELEASE -1 // pin change only
+#define EDGE_STOP 0     // grinder stops at this edge
+#define EDGE_START 1    // grinder starts at this edge
+#define MAX_EDGES 4     // start release, stop press, stop release, and one spare
+
+// A relay edge due at esp_timer_get_time() == at
+struct RelayEdge
+{
+    int64_t at;
+    bool pin;    // true = relay on (pin LOW)
+    int8_t kind; // EDGE_*
+};
+
+// Shared between the callers and the timer interrupt, always under relayMux
+static RelayEdge edges[MAX_EDGES];
+static uint8_t edgeCount = 0;
+static volatile bool running = false; // grinder state as commanded, not the pin
+static volatile bool locked = false;  // set by the safety supervisor; no start until unlocked
+static int64_t startedAt = 0;         // µs of the last start edge
+static bool impulse = false;          // drive of the current run, latched at its start
+static bool pinOn = false;
+static int64_t releasedAt = 0;        // µs of the last relay-off edge
+static volatile int64_t stoppedAt = 0;
+static int64_t stopDeadline = 0;
+static hw_timer_t *relayTimer = nullptr;
+static portMUX_TYPE relayMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR applyEdge(const RelayEdge &edge, int64_t now)
+{
+    digitalWrite(GRINDER_ACTIVE_PIN, edge.pin ? LOW : HIGH);
+    pinOn = edge.pin;
+    if (!edge.pin) {
+        releasedAt = now;
+    }
+    if (edge.kind == EDGE_START) {
+        running = true;
+        startedAt = now;
+    } else if (edge.kind == EDGE_STOP) {
+        running = false;
+        stoppedAt = now;
+        stopDeadline = edge.at;
+    }
+}
+
+// Arms the timer for the earliest pending edge
+static void IRAM_ATTR armTimer(int64_t now)
+{
+    if (edgeCount == 0) {
+        timerAlarmDisable(relayTimer);
+        return;
+    }
+    int64_t wait = edges[0].at - now;
+    timerWrite(relayTimer, 0);
+    timerAlarmWrite(relayTimer, wait > 1 ? wait : 1, false);
+    timerAlarmEnable(relayTimer);
+}
+
+static void IRAM_ATTR onRelayTimer()
+{
+    portENTER_CRITICAL_ISR(&relayMux);
+    int64_t now = esp_timer_get_time();
+    uint8_t due = 0;
+    while (due < edgeCount && edges[due].at <= now) {
+        applyEdge(edges[due], now);
+        due++;
+    }
+    for (uint8_t i = due; i < edgeCount; i++) {
+        edges[i - due] = edges[i];
+    }
+    edgeCount -= due;
+    armTimer(now);
+    portEXIT_CRITICAL_ISR(&relayMux);
+}
+
+// Edges are queued in time order; callers only ever append later edges
+static void IRAM_ATTR queueEdge(int64_t at, bool pin, int8_t kind)
+{
+    if (edgeCount < MAX_EDGES) {
+        edges[edgeCount++] = {at, pin, kind};
+    }
+}
+
+// Drops a scheduled stop and everything after it
+static void dropStop()
+{
+    for (uint8_t i = 0; i < edgeCount; i++) {
+        if (edges[i].kind == EDGE_STOP) {
+            edgeCount = i;
+            return;
+        }
+    }
+}
+
+static void startNow(int64_t now)
+{
+    impulse = !recipe->grindMode;
+    applyEdge({now, true, EDGE_START}, now);
+    if (impulse) {
+        queueEdge(now + RELAY_IMPULSE_US, false, EDGE_RELEASE);
+    }
+}
+
+// Stops at `at`, or as soon after as the impulse switch can be pressed again
+static void IRAM_ATTR queueStop(int64_t at, int64_t now)
+{
+    if (!impulse) {
+        if (at <= now) {
+            applyEdge({now, false, EDGE_STOP}, now);
+        } else {
+            queueEdge(at, false, EDGE_STOP);
+        }
+        return;
+    }
+    // A second press needs the first one released for at least a press length
+    int64_t released = edgeCount > 0 ? edges[edgeCount - 1].at : releasedAt;
+    if (at < released + RELAY_IMPULSE_US) {
+        at = released + RELAY_IMPULSE_US;
+    }
+    if (at <= now && !pinOn) {
+        applyEdge({now, true, EDGE_STOP}, now);
+        queueEdge(now + RELAY_IMPULSE_US, false, EDGE_RELEASE);
+    } else {
+        queueEdge(at, true, EDGE_STOP);
+        queueEdge(at + RELAY_IMPULSE_US, false, EDGE_RELEASE);
+    }
+}
+
+// Runs the grinder until actuatorStop()
+void actuatorStart()
+{
+    PROBE_SCOPE(switchProbe, PROBE_RELAY_SWITCH);
+    portENTER_CRITICAL(&relayMux);
+    int64_t now = esp_timer_get_time();
+    dropStop();
+    if (!running && !locked) {
+        startNow(now);
+    }
+    armTimer(now);
+    portEXIT_CRITICAL(&relayMux);
+}
+
+// Runs the grinder for durationUs from now; the stop edge comes from the timer interrupt.
+// Also shortens or extends a run that is already going.
+void actuatorRun(uint32_t durationUs)
+{
+    PROBE_SCOPE(switchProbe, PROBE_RELAY_SWITCH);
+    portENTER_CRITICAL(&relayMux);
+    int64_t now = esp_timer_get_time();
+    dropStop();
+    if (locked) {
+        portEXIT_CRITICAL(&relayMux);
+        return;
+    }
+    if (!running) {
+        startNow(now);
+    }
+    queueStop(now + durationUs, now);
+    armTimer(now);
+    portEXIT_CRITICAL(&relayMux);
+}
+
+// Stops the grinder now. In continuous drive the relay drops before this returns.
+void actuatorStop()
+{
+    PROBE_SCOPE(switchProbe, PROBE_RELAY_SWITCH);
+    portENTER_CRITICAL(&relayMux);
+    int64_t now = esp_timer_get_time();
+    dropStop();
+    if (running) {
+        queueStop(now, now);
+    } else if (!impulse) {
+        applyEdge({now, false, EDGE_RELEASE}, now); // Make sure a held relay is off
+    }
+    armTimer(now);
+    portEXIT_CRITICAL(&relayMux);
+}
+
+// Moves the stop of a running grinder to delayUs from now. Unlike actuatorRun it never
+// starts the grinder, so a late call after the relay already dropped is harmless.
+bool actuatorStopIn(uint32_t delayUs)
+{
+    portENTER_CRITICAL(&relayMux);
+    bool armed = running;
+    if (armed) {
+        int64_t now = esp_timer_get_time();
+        dropStop();
+        queueStop(now + delayUs, now);
+        armTimer(now);
+    }
+    portEXIT_CRITICAL(&relayMux);
+    return armed;
+}
+
+bool actuatorRunning()
+{
+    return running;
+}
+
+// millis() of the last stop edge, 0 if the grinder has not run yet
+unsigned long actuatorStoppedAt()
+{
+    portENTER_CRITICAL(&relayMux);
+    int64_t at = stoppedAt;
+    portEXIT_CRITICAL(&relayMux);
+    return at ? (unsigned long)(at / 1000) : 0;
+}
+
+ActuatorStop actuatorLastStop()
+{
+    portENTER_CRITICAL(&relayMux);
+    ActuatorStop stop = {stopDeadline, stoppedAt};
+    portEXIT_CRITICAL(&relayMux);
+    return stop;
+}
+
+// µs the grinder has been running at `now`, 0 while it is stopped
+int64_t IRAM_ATTR actuatorOnTimeFromISR(int64_t now)
+{
+    portENTER_CRITICAL_ISR(&relayMux);
+    int64_t on = running ? now - startedAt : 0;
+    portEXIT_CRITICAL_ISR(&relayMux);
+    return on;
+}
+
+// Drops everything queued, stops the grinder and refuses to start it again until
+// actuatorUnlock(). Continuous drive stops at once; impulse drive releases a held press
+// and presses the grinder's stop switch RELAY_IMPULSE_US later.
+void IRAM_ATTR actuatorFailSafeFromISR()
+{
+    portENTER_CRITICAL_ISR(&relayMux);
+    int64_t now = esp_timer_get_time();
+    locked = true;
+    edgeCount = 0;
+    if (pinOn) {
+        applyEdge({now, false, EDGE_RELEASE}, now);
+    }
+    if (running) {
+        if (impulse) {
+            queueStop(now, now);
+        } else {
+            applyEdge({now, false, EDGE_STOP}, now);
+        }
+    }
+    armTimer(now);
+    portEXIT_CRITICAL_ISR(&relayMux);
+}
+
+void actuatorUnlock()
+{
+    locked = false;
+}
+
+void setupActuator()
+{
+    pinMode(GRINDER_ACTIVE_PIN, OUTPUT);
+    digitalWrite(GRINDER_ACTIVE_PIN, HIGH); // HIGH = Relay OFF = Grinder stopped
+    relayTimer = timerBegin(ACTUATOR_TIMER, 80, true); // 1 µs ticks from the 80 MHz APB clock
+    timerAttachInterrupt(relayTimer, &onRelayTimer, true);
+}
@@ -1,7 +1,15 @@
 #include "api_handler.hpp"
 #include "config.hpp"
-
-extern Preferences preferences;
+#include "ota.hpp"
+#include "probe.hpp"
+#include "task_stats.hpp"
+#include "auto_zero.hpp"
+#include "shot_log.hpp"
+#include "dose_stats.hpp"
+#include "recipe.hpp"
+#include "cups.hpp"
+#include "mqtt.hpp"
+#include "web_server.hpp"
 
 void setupApiEndpoints(AsyncWebServer& server) {
     // Serve Wi-Fi configuration page
@@ -15,11 +23,10 @@ void setupApiEndpoints(AsyncWebServer& server) {
         if (request->hasParam("ssid", true) && request->hasParam("password", true)) {
             String ssid = request->getParam("ssid", true)->value();
             String password = request->getParam("password", true)->value();
-
-            preferences.begin("wifi", false);
-            preferences.putString("ssid", ssid);
-            preferences.putString("password", password);
-            preferences.end();
+            if (!wifiConfigure(ssid.c_str(), password.c_str())) {
+                request->send(400, "text/plain", "Invalid Wi-Fi credentials");
+                return;
+            }
 
             request->send(200, "text/html", "<h1>Wi-Fi Saved. Restarting...</h1>");
             delay(3000);
@@ -28,4 +35,87 @@ void setupApiEndpoints(AsyncWebServer& server) {
             request->send(400, "text/plain", "Missing Wi-Fi credentials");
         }
     });
+
+    // Latency histograms of the hot-path probes
+    server.on("/api/probes", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", probeReportJson());
+    });
+
+    // Heap history and per-task stack/CPU usage
+    server.on("/api/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", taskStatsJson());
+    });
+
+    // Zero drift corrected since the last tare
+    server.on("/api/zero", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", autoZeroJson());
+    });
+
+    // Shot history, newest first: /api/shots?page=0&size=20
+    server.on("/api/shots", HTTP_GET, [](AsyncWebServerRequest *request) {
+        long page = request->hasParam("page") ? request->getParam("page")->value().toInt() : 0;
+        long size = request->hasParam("size") ? request->getParam("size")->value().toInt() : SHOT_LOG_PAGE_MAX;
+        request->send(200, "application/json", shotLogPageJson(page > 0 ? page : 0, size > 0 ? size : 0));
+    });
+
+    // Dose error, overshoot and grind time quantiles per recipe
+    server.on("/api/dose", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", doseStatsJson());
+    });
+
+    // All recipes and the active one
+    server.on("/api/recipes", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", recipesJson());
+    });
+
+    // Selects a recipe without writing to flash: /api/recipe?index=1. The control loop applies
+    // it once the scale is empty; until then the answer lists it as "requested".
+    server.on("/api/recipe", HTTP_POST, [](AsyncWebServerRequest *request) {
+        long index = request->hasParam("index") ? request->getParam("index")->value().toInt() : -1;
+        if (!recipeRequest(index)) {
+            request->send(409, "text/plain", "Unknown recipe or shot running");
+            return;
+        }
+        request->send(202, "application/json", recipesJson());
+    });
+
+    // Known cups, lightest first, with the recipe each one starts
+    server.on("/api/cups", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", cupsJson());
+    });
+
+    // Forgets a cup: /api/cup/remove?index=2
+    server.on("/api/cup/remove", HTTP_POST, [](AsyncWebServerRequest *request) {
+        long index = request->hasParam("index") ? request->getParam("index")->value().toInt() : -1;
+        if (!cupRemove(index)) {
+            request->send(400, "text/plain", "Unknown cup");
+            return;
+        }
+        request->send(200, "application/json", cupsJson());
+    });
+
+    // Broker settings and publisher state
+    server.on("/api/mqtt", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", mqttStatusJson());
+    });
+
+    // Sets the broker, applied without a reboot: /api/mqtt?host=192.168.1.10&port=1883&telemetry=1
+    // An empty host disables the publisher.
+    server.on("/api/mqtt", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("host")) {
+            request->send(400, "text/plain", "Missing host");
+            return;
+        }
+        String host = request->getParam("host")->value();
+        long port = request->hasParam("port") ? request->getParam("port")->value().toInt() : MQTT_DEFAULT_PORT;
+        bool telemetry = request->hasParam("telemetry") && request->getParam("telemetry")->value().toInt() != 0;
+        if (port <= 0 || port > 65535 || !mqttConfigure(host.c_str(), port, telemetry)) {
+            request->send(400, "text/plain", "Invalid host or port");
+            return;
+        }
+        request->send(202, "text/plain", "Broker settings stored");
+    });
+
+    // Authenticated firmware upload
+    setupOtaEndpoint(server);
 }
@@ -0,0 +1,96 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "auto_zero.hpp"
+
+// Written by the acquisition task only; the copy for readers is taken under the lock
+static AutoZeroStats stats = {};
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Starts from a fresh zero; call whenever the load cell offset is set
+void autoZeroReset()
+{
+    portENTER_CRITICAL(&statsMux);
+    stats = {};
+    stats.tareAt = millis();
+    portEXIT_CRITICAL(&statsMux);
+}
+
+// Nudges the zero towards a stable near-zero reading. Only while the caller reports the
+// scale idle (no grind, relay off, no menu) and at most AUTO_ZERO_STEP per AUTO_ZERO_INTERVAL,
+// so a real dose put on the scale is never tracked away.
+void autoZeroUpdate(const WeightStability &stability, bool idle, unsigned long now)
+{
+    if (!idle || !stability.stable || stats.saturated) {
+        return;
+    }
+    if (ABS(stability.value) > AUTO_ZERO_BAND || ABS(stability.value) < AUTO_ZERO_DEADBAND) {
+        return; // Something is on the scale, or the zero is already good enough
+    }
+    if (now - stats.tareAt < TARE_MIN_INTERVAL || now - stats.lastCorrectionAt < AUTO_ZERO_INTERVAL) {
+        return;
+    }
+
+    double step = stability.value * AUTO_ZERO_GAIN;
+    if (step > AUTO_ZERO_STEP) {
+        step = AUTO_ZERO_STEP;
+    } else if (step < -AUTO_ZERO_STEP) {
+        step = -AUTO_ZERO_STEP;
+    }
+
+    portENTER_CRITICAL(&statsMux);
+    stats.drift += step;
+    if (ABS(stats.drift) > stats.maxDrift) {
+        stats.maxDrift = ABS(stats.drift);
+    }
+    if (ABS(stats.drift) >= AUTO_ZERO_MAX_DRIFT) {
+        stats.saturated = true;
+    }
+    stats.corrections++;
+    stats.lastCorrectionAt = now;
+    portEXIT_CRITICAL(&statsMux);
+
+    if (stats.saturated) {
+        Serial.printf("[AutoZero] Drift reached %.2f g, tracking paused until the next tare\n", stats.drift);
+    }
+}
+
+double autoZeroDrift()
+{
+    return stats.drift;
+}
+
+AutoZeroStats autoZeroStats()
+{
+    portENTER_CRITICAL(&statsMux);
+    AutoZeroStats copy = stats;
+    portEXIT_CRITICAL(&statsMux);
+    return copy;
+}
+
+// Average drift per hour since the last tare
+static double driftRate(const AutoZeroStats &s)
+{
+    double hours = (millis() - s.tareAt) / 3600000.0;
+    return hours > 0 ? s.drift / hours : 0;
+}
+
+void autoZeroPrintStats()
+{
+    AutoZeroStats s = autoZeroStats();
+    Serial.printf("[AutoZero] drift %.3f g (max %.3f, %.3f g/h) | %lu corrections, last %lu ms ago | tared %lu s ago%s\n",
+                  s.drift, s.maxDrift, driftRate(s), (unsigned long)s.corrections,
+                  s.lastCorrectionAt ? (unsigned long)(millis() - s.lastCorrectionAt) : 0UL,
+                  (unsigned long)((millis() - s.tareAt) / 1000), s.saturated ? " | SATURATED" : "");
+}
+
+String autoZeroJson()
+{
+    AutoZeroStats s = autoZeroStats();
+    char json[192];
+    snprintf(json, sizeof(json),
+             "{\"drift\":%.3f,\"max_drift\":%.3f,\"drift_per_hour\":%.3f,\"corrections\":%lu,\"last_correction_at\":%lu,\"tare_at\":%lu,\"saturated\":%s}",
+             s.drift, s.maxDrift, driftRate(s), (unsigned long)s.corrections, (unsigned long)s.lastCorrectionAt,
+             (unsigned long)s.tareAt, s.saturated ? "true" : "false");
+    return json;
+}
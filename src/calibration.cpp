@@ -0,0 +1,174 @@
+#include <Arduino.h>
+
+#include "config.hpp"
+#include "calibration.hpp"
+
+// Shared between the UI (control task) and updateScale (acquisition task). The UI only
+// requests captures; all HX711 access stays in updateScale, which feeds samples in.
+static CalibrationStatus status = {};
+static long pointCounts[CALIBRATION_MAX_POINTS];
+static double pointGrams[CALIBRATION_MAX_POINTS];
+static double captureSum = 0;
+static portMUX_TYPE calibrationMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Starts a new calibration; the caller tares first, so the zero point is the tare itself
+void calibrationBegin()
+{
+    portENTER_CRITICAL(&calibrationMux);
+    status = {};
+    status.state = CALIBRATION_READY;
+    status.weight = CALIBRATION_DEFAULT_WEIGHT;
+    portEXIT_CRITICAL(&calibrationMux);
+}
+
+void calibrationCancel()
+{
+    portENTER_CRITICAL(&calibrationMux);
+    status.state = CALIBRATION_IDLE;
+    portEXIT_CRITICAL(&calibrationMux);
+}
+
+void calibrationAdjustWeight(double delta)
+{
+    portENTER_CRITICAL(&calibrationMux);
+    if (status.state == CALIBRATION_READY) {
+        status.weight += delta;
+        if (status.weight < 0) {
+            status.weight = 0;
+        }
+    }
+    portEXIT_CRITICAL(&calibrationMux);
+}
+
+// Asks the acquisition task to record the weight on the scale as status.weight
+bool calibrationCapture()
+{
+    bool started = false;
+    portENTER_CRITICAL(&calibrationMux);
+    if (status.state == CALIBRATION_READY && status.weight > 0 && status.points < CALIBRATION_MAX_POINTS) {
+        status.state = CALIBRATION_CAPTURING;
+        status.progress = 0;
+        captureSum = 0;
+        started = true;
+    }
+    portEXIT_CRITICAL(&calibrationMux);
+    return started;
+}
+
+// Called by updateScale with every sample (counts above the tare offset). Only stable samples
+// count; any movement restarts the capture so a swinging weight is never recorded.
+void calibrationFeed(long counts, bool stable)
+{
+    if (status.state != CALIBRATION_CAPTURING) {
+        return;
+    }
+    portENTER_CRITICAL(&calibrationMux);
+    if (status.state == CALIBRATION_CAPTURING) {
+        if (!stable) {
+            status.progress = 0;
+            captureSum = 0;
+        } else {
+            captureSum += counts;
+            if (++status.progress >= CALIBRATION_SAMPLES) {
+                pointCounts[status.points] = lround(captureSum / status.progress);
+                pointGrams[status.points] = status.weight;
+                status.points++;
+                status.state = CALIBRATION_READY;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&calibrationMux);
+}
+
+static double fitted(double counts, double a, double b)
+{
+    return counts * (a + b * counts);
+}
+
+// Least-squares fit of grams = a * c + b * c^2 through the tare. One weight gives the plain
+// linear factor; two or more also fit the curvature, which is dropped again if it would make
+// the curve turn around within 1.5x the heaviest weight.
+static bool fit(const long *counts, const double *grams, int n, double &a, double &b)
+{
+    // Counts are scaled down so the fourth powers stay well inside double precision
+    const double unit = 1e4;
+    double s11 = 0, s12 = 0, s22 = 0, t1 = 0, t2 = 0, maxX = 0;
+    for (int i = 0; i < n; i++) {
+        double x = counts[i] / unit;
+        s11 += x * x;
+        s12 += x * x * x;
+        s22 += x * x * x * x;
+        t1 += grams[i] * x;
+        t2 += grams[i] * x * x;
+        if (fabs(x) > fabs(maxX)) {
+            maxX = x;
+        }
+    }
+    if (s11 <= 0) {
+        return false;
+    }
+    a = t1 / s11;
+    b = 0;
+    double det = s11 * s22 - s12 * s12;
+    if (n >= 2 && fabs(det) > 1e-12 * s11 * s22) {
+        double qa = (t1 * s22 - t2 * s12) / det;
+        double qb = (s11 * t2 - s12 * t1) / det;
+        // Slope at the far end must keep the sign of the slope at zero
+        if ((qa + 2 * qb * 1.5 * maxX) * qa > 0) {
+            a = qa;
+            b = qb;
+        }
+    }
+    a /= unit;
+    b /= unit * unit;
+    double factor = 1 / a;
+    return ABS(factor) >= 100 && ABS(factor) <= 10000;
+}
+
+// Fits the captured points and reports the residuals. On success the result is in
+// calibrationStatus().factor and .curvature for the caller to apply.
+bool calibrationFinish()
+{
+    long counts[CALIBRATION_MAX_POINTS];
+    double grams[CALIBRATION_MAX_POINTS];
+    portENTER_CRITICAL(&calibrationMux);
+    int n = status.state == CALIBRATION_READY ? status.points : 0;
+    memcpy(counts, pointCounts, sizeof(counts));
+    memcpy(grams, pointGrams, sizeof(grams));
+    portEXIT_CRITICAL(&calibrationMux);
+    if (n == 0) {
+        return false;
+    }
+
+    double a, b;
+    bool ok = fit(counts, grams, n, a, b);
+    double maxResidual = 0;
+    Serial.printf("[Calibration] %d point(s), %s\n", n, ok ? (b != 0 ? "quadratic fit" : "linear fit") : "fit rejected");
+    for (int i = 0; i < n; i++) {
+        double residual = fitted(counts[i], a, b) - grams[i];
+        if (ABS(residual) > maxResidual) {
+            maxResidual = ABS(residual);
+        }
+        Serial.printf("[Calibration]   %8.2f g  %9ld counts  residual %+.3f g\n", grams[i], counts[i], residual);
+    }
+
+    portENTER_CRITICAL(&calibrationMux);
+    status.state = ok ? CALIBRATION_DONE : CALIBRATION_FAILED;
+    status.factor = 1 / a;
+    status.curvature = b;
+    status.maxResidual = maxResidual;
+    portEXIT_CRITICAL(&calibrationMux);
+    if (ok) {
+        Serial.printf("[Calibration] factor %.2f counts/g, curvature %.3e g/count^2, max residual %.3f g\n",
+                      1 / a, b, maxResidual);
+    }
+    return ok;
+}
+
+CalibrationStatus calibrationStatus()
+{
+    portENTER_CRITICAL(&calibrationMux);
+    CalibrationStatus copy = status;
+    portEXIT_CRITICAL(&calibrationMux);
+    return copy;
+}
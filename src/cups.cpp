@@ -0,0 +1,223 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <utility>
+
+#include "config.hpp"
+#include "cups.hpp"
+#include "recipe.hpp"
+
+// Known cups, sorted by weight, stored as one blob ("table") in the "cups" NVS namespace.
+// Matching is a binary search run by the control loop on a stable weight, never per sample,
+// so its cost does not depend on how many cups are known.
+
+static CupEntry cups[CUP_REGISTRY_SIZE];
+static uint8_t count = 0;
+static int matched = -1; // cup recognised on the current plateau
+static portMUX_TYPE cupsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void writeTable()
+{
+    CupEntry copy[CUP_REGISTRY_SIZE];
+    portENTER_CRITICAL(&cupsMux);
+    uint8_t n = count;
+    memcpy(copy, cups, n * sizeof(CupEntry));
+    portEXIT_CRITICAL(&cupsMux);
+
+    Preferences store;
+    store.begin("cups", false);
+    if (n > 0) {
+        store.putBytes("table", copy, n * sizeof(CupEntry));
+    } else {
+        store.remove("table");
+    }
+    store.end();
+}
+
+// Index of the closest cup within CUP_DETECTION_TOLERANCE of weight, or -1; caller holds cupsMux
+static int closest(double weight)
+{
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cups[mid].weight < weight) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // cups[lo - 1] < weight <= cups[lo]
+    int best = -1;
+    for (int i = lo - 1; i <= lo; i++) {
+        if (i >= 0 && i < count && ABS(cups[i].weight - weight) < CUP_DETECTION_TOLERANCE &&
+            (best < 0 || ABS(cups[i].weight - weight) < ABS(cups[best].weight - weight))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Adds a cup, or moves one that lies within the tolerance; caller holds cupsMux
+static bool insert(float weight, uint8_t recipe)
+{
+    int existing = closest(weight);
+    if (existing >= 0) {
+        cups[existing] = {weight, recipe};
+        // Keep the order if the weight moved past a neighbour
+        while (existing > 0 && cups[existing - 1].weight > weight) {
+            std::swap(cups[existing - 1], cups[existing]);
+            existing--;
+        }
+        while (existing < count - 1 && cups[existing + 1].weight < weight) {
+            std::swap(cups[existing + 1], cups[existing]);
+            existing++;
+        }
+        return true;
+    }
+    if (count == CUP_REGISTRY_SIZE) {
+        return false;
+    }
+    int i = count++;
+    for (; i > 0 && cups[i - 1].weight > weight; i--) {
+        cups[i] = cups[i - 1];
+    }
+    cups[i] = {weight, recipe};
+    return true;
+}
+
+// Loads the registry. Without one, each recipe's cup weight is registered for that recipe,
+// so the cup set up with older firmware keeps starting the first recipe.
+void setupCups()
+{
+    Preferences store;
+    store.begin("cups", true);
+    size_t length = store.getBytesLength("table");
+    if (length > 0 && length <= sizeof(cups) && length % sizeof(CupEntry) == 0) {
+        store.getBytes("table", cups, length);
+        count = length / sizeof(CupEntry);
+    }
+    store.end();
+
+    if (count == 0) {
+        for (int i = 0; i < RECIPE_COUNT; i++) {
+            float weight = recipeAt(i).cup;
+            portENTER_CRITICAL(&cupsMux);
+            if (weight > CUP_DETECTION_TOLERANCE && closest(weight) < 0) {
+                insert(weight, i);
+            }
+            portEXIT_CRITICAL(&cupsMux);
+        }
+        writeTable();
+    }
+    Serial.printf("[Cup] %u known cups\n", count);
+}
+
+// Matches a stable weight against the registry and returns the recognised cup, or -1.
+// The nearest cup within CUP_DETECTION_TOLERANCE wins, but a cup that is already recognised
+// stays so until the weight leaves its tolerance by CUP_MATCH_HYSTERESIS or another cup is
+// closer by that much. changed is set when the result differs from the previous call.
+int cupMatch(double weight, bool &changed)
+{
+    portENTER_CRITICAL(&cupsMux);
+    int nearest = closest(weight);
+    int result = nearest;
+    if (matched >= 0 && matched < count) {
+        double held = ABS(cups[matched].weight - weight);
+        bool kept = held < CUP_DETECTION_TOLERANCE + CUP_MATCH_HYSTERESIS;
+        if (kept && (nearest < 0 || ABS(cups[nearest].weight - weight) + CUP_MATCH_HYSTERESIS > held)) {
+            result = matched;
+        }
+    }
+    changed = result != matched;
+    matched = result;
+    portEXIT_CRITICAL(&cupsMux);
+    return result;
+}
+
+// Ends the current plateau: the next cupMatch() reports whatever cup it finds as changed, so
+// the same cup lifted and put back selects its recipe again
+void cupForget()
+{
+    portENTER_CRITICAL(&cupsMux);
+    matched = -1;
+    portEXIT_CRITICAL(&cupsMux);
+}
+
+// Registers the cup on the scale for a recipe; false if the registry is full
+bool cupRegister(double weight, int recipe)
+{
+    if (weight <= CUP_DETECTION_TOLERANCE || recipe < 0 || recipe >= RECIPE_COUNT) {
+        return false;
+    }
+    portENTER_CRITICAL(&cupsMux);
+    bool added = insert(weight, recipe);
+    matched = -1; // Indices may have moved
+    portEXIT_CRITICAL(&cupsMux);
+    if (added) {
+        writeTable();
+    }
+    return added;
+}
+
+bool cupRemove(int index)
+{
+    portENTER_CRITICAL(&cupsMux);
+    bool valid = index >= 0 && index < count;
+    if (valid) {
+        for (int i = index; i < count - 1; i++) {
+            cups[i] = cups[i + 1];
+        }
+        count--;
+        matched = -1;
+    }
+    portEXIT_CRITICAL(&cupsMux);
+    if (valid) {
+        writeTable();
+    }
+    return valid;
+}
+
+int cupCount()
+{
+    return count;
+}
+
+CupEntry cupAt(int index)
+{
+    portENTER_CRITICAL(&cupsMux);
+    CupEntry entry = index >= 0 && index < count ? cups[index] : CupEntry{0, 0};
+    portEXIT_CRITICAL(&cupsMux);
+    return entry;
+}
+
+// Forgets all cups but the default one, which starts the first recipe
+void cupsReset()
+{
+    portENTER_CRITICAL(&cupsMux);
+    count = 0;
+    matched = -1;
+    insert(CUP_WEIGHT, 0);
+    portEXIT_CRITICAL(&cupsMux);
+    writeTable();
+}
+
+void cupsPrint()
+{
+    for (int i = 0; i < cupCount(); i++) {
+        CupEntry cup = cupAt(i);
+        Serial.printf("[Cup] %2d %6.1fg -> %s\n", i, cup.weight, recipeAt(cup.recipe).name);
+    }
+}
+
+String cupsJson()
+{
+    String json = "[";
+    char buf[96];
+    for (int i = 0; i < cupCount(); i++) {
+        CupEntry cup = cupAt(i);
+        snprintf(buf, sizeof(buf), "%s{\"weight\":%.1f,\"recipe\":%u,\"name\":\"%s\"}",
+                 i ? "," : "", cup.weight, cup.recipe, recipeAt(cup.recipe).name);
+        json += buf;
+    }
+    json += "]";
+    return json;
+}
@@ -4,11 +4,25 @@
 #include <U8g2lib.h>
 
 #include "config.hpp"
+#include "display.hpp"
 #include "rotary.hpp"
 #include "web_server.hpp"
+#include "probe.hpp"
+#include "calibration.hpp"
+#include "scale.hpp"
+#include "dose_stats.hpp"
+#include "recipe.hpp"
 
 U8G2_SSD1306_128X64_NONAME_F_HW_I2C screen(U8G2_R0, /* reset=*/ U8X8_PIN_NONE, /* clock=*/ OLED_SCL, /* data=*/ OLED_SDA);
 TaskHandle_t DisplayTask;
+
+// Pushes the frame buffer to the OLED; the I2C transfer is the slow part of every redraw
+static void sendScreenBuffer()
+{
+  PROBE_START(sendStart);
+  screen.sendBuffer();
+  PROBE_STOP(PROBE_DISPLAY_SEND, sendStart);
+}
 extern String currentIPAddress;
 
 // Time in milliseconds after which the display sleeps (10 seconds)
@@ -36,7 +50,7 @@ void showErrorMessage(const char* message) {
   CenterPrintToScreen("ERROR", 0);
   screen.setFont(u8g2_font_7x13_tr);
   CenterPrintToScreen(message, 24);
-  screen.sendBuffer();
+  sendScreenBuffer();
 }
 bool screenJustWoke = false;
 
@@ -79,15 +93,16 @@ void showIPAddress() {
 // Menu items for user interface
 int currentMenuItem = 0;      // Index of the current menu item
 int currentSetting;           // Index of the current setting being adjusted
-int menuItemsCount = 5;       // Total number of main menu items
+int menuItemsCount = 6;       // Total number of main menu items
 
 // Main menu items
-MenuItem menuItems[5] = {
+MenuItem menuItems[6] = {
     {0, false, "Exit", 0},
-    {1, false, "Mode", 0},
-    {2, false, "Offset", 0.1, &offset},
-    {3, false, "Info Menu", 0},
-    {4, false, "Configuration", 0}
+    {1, false, "Recipe", 0},
+    {2, false, "Mode", 0},
+    {3, false, "Offset", 0.1},
+    {4, false, "Info Menu", 0},
+    {5, false, "Configuration", 0}
 };
 
 // Mode submenu items
@@ -99,15 +114,16 @@ MenuItem modeMenuItems[3] = {
 };
 
 // Configuration submenu items
-int configMenuItemsCount = 7;
-MenuItem configMenuItems[7] = {
+int configMenuItemsCount = 8;
+MenuItem configMenuItems[8] = {
     {0, false, "Calibrate", 0},
-    {1, false, "Cup weight", 1, &setCupWeight},
+    {1, false, "Cup weight", 1},
     {2, false, "Scale Mode", 0},
     {3, false, "Grinding Mode", 0},
     {4, false, "Grind Trigger", 0},
-    {5, false, "Reset", 0},
-    {6, false, "Back", 0}
+    {5, false, "Stop Mode", 0},
+    {6, false, "Reset", 0},
+    {7, false, "Back", 0}
 };
 
 // Submenu tracking variables
@@ -120,7 +136,7 @@ void wakeScreen() {
     screenJustWoke = true; // Indicate that the screen just woke up
     scaleStatus = STATUS_EMPTY;
     screen.clearBuffer();
-    screen.sendBuffer();
+    sendScreenBuffer();
 }
 
 // Function to display the menu with previous, current, and next items
@@ -145,7 +161,7 @@ void showMenu()
   LeftPrintActiveToScreen(current.menuName, 35); // Highlight the current menu item
   LeftPrintToScreen(next.menuName, 51);          // Print the next menu item
 
-  screen.sendBuffer(); // Send the buffer to the display
+  sendScreenBuffer(); // Send the buffer to the display
 }
 
 // Function to display the mode submenu
@@ -169,7 +185,7 @@ void showModeMenu()
   LeftPrintActiveToScreen(current.menuName, 35);
   LeftPrintToScreen(next.menuName, 51);
 
-  screen.sendBuffer();
+  sendScreenBuffer();
 }
 
 // Function to display the configuration submenu
@@ -193,7 +209,7 @@ void showConfigMenu()
   LeftPrintActiveToScreen(current.menuName, 35);
   LeftPrintToScreen(next.menuName, 51);
 
-  screen.sendBuffer();
+  sendScreenBuffer();
 }
 
 void showGrindTriggerMenu() {
@@ -212,7 +228,7 @@ void showGrindTriggerMenu() {
 
   // Display instructions
   LeftPrintToScreen("Press button to toggle", 50);
-  screen.sendBuffer();
+  sendScreenBuffer();
 }
 
 
@@ -225,9 +241,9 @@ void showOffsetMenu()
   screen.setFont(u8g2_font_7x14B_tf);           // Set the font for the menu title
   CenterPrintToScreen("Adjust offset", 0);      // Print the menu title
   screen.setFont(u8g2_font_7x13_tr);            // Set the font for the offset value
-  snprintf(buf, sizeof(buf), "%3.2fg", offset); // Format the offset value
+  snprintf(buf, sizeof(buf), "%3.2fg", recipe->offset); // Format the offset value
   CenterPrintToScreen(buf, 28);                 // Print the offset value
-  screen.sendBuffer();                          // Send the buffer to the display
+  sendScreenBuffer();                          // Send the buffer to the display
 }
 
 // Function to display the scale mode menu
@@ -248,7 +264,7 @@ void showScaleModeMenu()
     LeftPrintActiveToScreen("GBW", 19);  // Highlight active item
     LeftPrintToScreen("Scale only", 35); // Print inactive item
   }
-  screen.sendBuffer(); // Send the buffer to the display
+  sendScreenBuffer(); // Send the buffer to the display
 }
 
 // Function to display the grind mode menu
@@ -260,7 +276,7 @@ void showGrindModeMenu()
   CenterPrintToScreen("Set Grinder", 0);      // Print the menu title
   CenterPrintToScreen("Start/Stop Mode", 19); // Print the subtitle
   screen.setFont(u8g2_font_7x13_tr);          // Set the font for the menu items
-  if (grindMode)
+  if (recipe->grindMode)
   {
     LeftPrintActiveToScreen("Continuous", 35); // Highlight active item
     LeftPrintToScreen("Impulse", 51);          // Print inactive item
@@ -270,7 +286,56 @@ void showGrindModeMenu()
     LeftPrintToScreen("Continuous", 35);    // Print inactive item
     LeftPrintActiveToScreen("Impulse", 51); // Highlight active item
   }
-  screen.sendBuffer(); // Send the buffer to the display
+  sendScreenBuffer(); // Send the buffer to the display
+}
+
+// Function to display the stop strategy menu
+void showStopModeMenu()
+{
+  screen.clearBuffer();
+  screen.setFontPosTop();
+  screen.setFont(u8g2_font_7x14B_tf);  // Set the font for the menu title
+  CenterPrintToScreen("Stop Mode", 0); // Print the menu title
+  screen.setFont(u8g2_font_7x13_tr);   // Set the font for the menu items
+  const char *items[3] = {"Weight", "Time", "Weight + top-up"};
+  for (int i = 0; i < 3; i++)
+  {
+    if (i == recipe->stopMode)
+    {
+      LeftPrintActiveToScreen(items[i], 19 + 16 * i); // Highlight active item
+    }
+    else
+    {
+      LeftPrintToScreen(items[i], 19 + 16 * i); // Print inactive item
+    }
+  }
+  sendScreenBuffer(); // Send the buffer to the display
+}
+
+// Function to display the recipe menu with the previous, active, and next recipe
+void showRecipeMenu()
+{
+  char buf[24];
+  int index = recipeIndex();
+  screen.clearBuffer();
+  screen.setFontPosTop();
+  screen.setFont(u8g2_font_7x14B_tf); // Set the font for the menu title
+  CenterPrintToScreen("Recipe", 0);   // Print the menu title
+  screen.setFont(u8g2_font_7x13_tr);  // Set the font for the recipes
+  for (int row = -1; row <= 1; row++)
+  {
+    const Recipe &r = recipeAt((index + row + RECIPE_COUNT) % RECIPE_COUNT);
+    snprintf(buf, sizeof(buf), "%-10s %4.1fg", r.name, r.dose);
+    if (row == 0)
+    {
+      LeftPrintActiveToScreen(buf, 35); // Highlight the active recipe
+    }
+    else
+    {
+      LeftPrintToScreen(buf, 35 + 16 * row);
+    }
+  }
+  sendScreenBuffer(); // Send the buffer to the display
 }
 
 // Function to display the cup weight adjustment menu
@@ -286,7 +351,7 @@ void showCupMenu()
   CenterPrintToScreen(buf, 19);                      // Print the scale weight
   LeftPrintToScreen("Place cup on scale", 35);       // Print instructions
   LeftPrintToScreen("and press button", 51);         // Print instructions
-  screen.sendBuffer();                               // Send the buffer to the display
+  sendScreenBuffer();                               // Send the buffer to the display
 }
 
 void showCupWeightSetScreen(double cupWeight)
@@ -298,23 +363,60 @@ void showCupWeightSetScreen(double cupWeight)
   CenterPrintToScreen("Cup Weight Set:", 0);
   snprintf(buf, sizeof(buf), "%3.1fg", cupWeight);
   CenterPrintToScreen(buf, 20); // Center the message on the screen
+  screen.setFont(u8g2_font_7x13_tr);
+  snprintf(buf, sizeof(buf), "starts %s", recipe->name);
+  CenterPrintToScreen(buf, 40); // The recipe this cup selects
 
-  screen.sendBuffer();
+  sendScreenBuffer();
   delay(2000); // Block for 2 seconds to ensure the screen stays visible
 }
 
-// Function to display the calibration menu
+// Function to display the calibration wizard
 void showCalibrationMenu()
 {
+  char buf[32];
+  CalibrationStatus cal = calibrationStatus();
+
   screen.clearBuffer();
   screen.setFontPosTop();
   screen.setFont(u8g2_font_7x14B_tf);           // Set the font for the menu title
   CenterPrintToScreen("Calibration", 0);        // Print the menu title
   screen.setFont(u8g2_font_7x13_tr);            // Set the font for the instructions
-  CenterPrintToScreen("Place 100g weight", 19); // Print instructions
-  CenterPrintToScreen("on scale and", 35);      // Print instructions
-  CenterPrintToScreen("press button", 51);      // Print instructions
-  screen.sendBuffer();                          // Send the buffer to the display
+  if (cal.state == CALIBRATION_CAPTURING)
+  {
+    snprintf(buf, sizeof(buf), "Reading %.0fg", cal.weight);
+    CenterPrintToScreen(buf, 19);
+    snprintf(buf, sizeof(buf), "%d/%d", cal.progress, CALIBRATION_SAMPLES);
+    CenterPrintToScreen(cal.progress ? buf : "Hold still", 35);
+  }
+  else if (cal.state == CALIBRATION_DONE)
+  {
+    snprintf(buf, sizeof(buf), "Saved, %d point%s", cal.points, cal.points == 1 ? "" : "s");
+    CenterPrintToScreen(buf, 19);
+    snprintf(buf, sizeof(buf), "Max error %.2fg", cal.maxResidual);
+    CenterPrintToScreen(buf, 35);
+    CenterPrintToScreen("press button", 51);
+  }
+  else if (cal.state == CALIBRATION_FAILED)
+  {
+    CenterPrintToScreen("Fit rejected", 19);
+    CenterPrintToScreen("Nothing saved", 35);
+    CenterPrintToScreen("press button", 51);
+  }
+  else if (cal.weight > 0)
+  {
+    snprintf(buf, sizeof(buf), "Place %.0fg weight", cal.weight);
+    CenterPrintToScreen(buf, 19);
+    snprintf(buf, sizeof(buf), "%d recorded", cal.points);
+    CenterPrintToScreen(buf, 35);
+    CenterPrintToScreen("press button", 51);
+  }
+  else
+  {
+    CenterPrintToScreen("Turn to 0g:", 19);
+    CenterPrintToScreen(cal.points ? "press to save" : "press to cancel", 35);
+  }
+  sendScreenBuffer();                          // Send the buffer to the display
 }
 
 // Function to display the reset menu
@@ -335,7 +437,7 @@ void showResetMenu()
     LeftPrintToScreen("Confirm", 19);      // Print inactive item
     LeftPrintActiveToScreen("Cancel", 35); // Highlight active item
   }
-  screen.sendBuffer(); // Send the buffer to the display
+  sendScreenBuffer(); // Send the buffer to the display
 }
 
 void showInfoMenu() {
@@ -358,8 +460,17 @@ void showInfoMenu() {
     snprintf(buf, sizeof(buf), "Shot Count: %u", shotCount);
     LeftPrintToScreen(buf, 48);
 
+    // Dose error p50/p95/p99 for the active recipe
+    DoseStatsSummary dose = doseStatsSummary(recipeIndex());
+    if (dose.shots > 0) {
+        snprintf(buf, sizeof(buf), "Err %.2f/%.2f/%.2f", dose.error[0], dose.error[1], dose.error[2]);
+    } else {
+        snprintf(buf, sizeof(buf), "Err: no shots yet");
+    }
+    LeftPrintToScreen(buf, 16);
+
     // Send buffer to the display
-    screen.sendBuffer();
+    sendScreenBuffer();
 
     // No unnecessary delays or clearing here
 }
@@ -399,6 +510,14 @@ void showSetting()
   {
     showGrindTriggerMenu();
   }
+  else if (currentSetting == 9)
+  {
+    showStopModeMenu();
+  }
+  else if (currentSetting == 10)
+  {
+    showRecipeMenu();
+  }
 
 }
 
@@ -420,12 +539,19 @@ void updateDisplay(void *parameter)
     screen.clearBuffer(); // Clear the display buffer
     if (millis() - lastSignificantWeightChangeAt > sleepTime)
     {
-      screen.sendBuffer(); // Send the buffer to the display to "sleep"
+      sendScreenBuffer(); // Send the buffer to the display to "sleep"
       delay(100);
       scaleStatus = STATUS_EMPTY;
       continue;
     }
 
+    if (showingTaringMessage)
+    {
+      showingTaringMessage = showTaringMessage(); // Sends the buffer itself
+      vTaskDelay(DISPLAY_FRAME_INTERVAL / portTICK_PERIOD_MS);
+      continue;
+    }
+
     if (scaleLastUpdatedAt == 0)
     {
       screen.setFontPosTop();
@@ -457,7 +583,7 @@ void updateDisplay(void *parameter)
         screen.setFontPosCenter();
         screen.setFont(u8g2_font_7x14B_tf);
         screen.setCursor(84, 32);
-        snprintf(buf, sizeof(buf), "%3.1fg", setWeight);
+        snprintf(buf, sizeof(buf), "%3.1fg", recipe->dose);
         screen.print(buf);
 
         screen.setFontPosBottom();
@@ -469,7 +595,7 @@ void updateDisplay(void *parameter)
       {
         screen.setFontPosTop();
         screen.setFont(u8g2_font_7x13_tr);
-        CenterPrintToScreen("Weight:", 0);
+        CenterPrintToScreen(recipe->name, 0);
 
         screen.setFont(u8g2_font_7x14B_tf);
         screen.setFontPosCenter();
@@ -480,7 +606,11 @@ void updateDisplay(void *parameter)
         screen.setFont(u8g2_font_7x13_tf);
         screen.setFontPosCenter();
         screen.setCursor(5, 50);
-        snprintf(buf2, sizeof(buf2), "Set: %3.1fg", setWeight);
+        if (recipe->stopMode == STOP_TIME && !scaleMode) {
+          snprintf(buf2, sizeof(buf2), "Set: %3.1fs", recipe->time);
+        } else {
+          snprintf(buf2, sizeof(buf2), "Set: %3.1fg", recipe->dose);
+        }
         LeftPrintToScreen(buf2, 50);
         
         // Show mode indicator on the right side
@@ -520,7 +650,7 @@ void updateDisplay(void *parameter)
         screen.setFontPosCenter();
         screen.setFont(u8g2_font_7x14B_tf);
         screen.setCursor(84, 32);
-        snprintf(buf, sizeof(buf), "%3.1fg", setWeight);
+        snprintf(buf, sizeof(buf), "%3.1fg", recipe->dose);
         screen.print(buf);
 
         screen.setFontPosBottom();
@@ -551,7 +681,8 @@ void updateDisplay(void *parameter)
         continue;       // Skip the rest of the update logic
       }
     }
-    screen.sendBuffer(); // Send the buffer to the display
+    sendScreenBuffer(); // Send the buffer to the display
+    vTaskDelay(DISPLAY_FRAME_INTERVAL / portTICK_PERIOD_MS); // Cap the frame rate so lower-priority tasks on this core get to run
   }
 }
 
@@ -569,21 +700,44 @@ void setupDisplay()
       "Display",     /* Name of the task */
       10000,         /* Stack size in words */
       NULL,          /* Task input parameter */
-      0,             /* Priority of the task */
+      UI_TASK_PRIORITY, /* Priority of the task */
       &DisplayTask,  /* Task handle */
-      1);            /* Core where the task should run */
+      UI_TASK_CORE); /* Core where the task should run */
 }
 
-// Function to show taring message
-void showTaringMessage()
+// Function to show the tare progress; returns false once the outcome has been shown long enough
+bool showTaringMessage()
 {
+  char buf[32];
+  TareProgress tare = tareProgress();
+  bool finished = tare.state != TARE_RUNNING && tare.finishedAt >= taringMessageStartTime;
+
   screen.clearBuffer();
   screen.setFontPosTop();
   screen.setFont(u8g2_font_7x14B_tf);           // Set the font for the message
-  CenterPrintToScreen("Taring...", 20);         // Print the taring message
-  screen.setFont(u8g2_font_7x13_tr);            // Set smaller font
-  CenterPrintToScreen("Please wait", 40);       // Print additional message
-  screen.sendBuffer();                          // Send the buffer to the display
+  if (!finished)
+  {
+    CenterPrintToScreen("Taring...", 20);       // Print the taring message
+    screen.setFont(u8g2_font_7x13_tr);          // Set smaller font
+    snprintf(buf, sizeof(buf), "%d/%d", tare.samples, TARE_MEASURES);
+    CenterPrintToScreen(buf, 40);               // Print the progress
+    screen.drawFrame(14, 56, 100, 6);
+    screen.drawBox(14, 56, 100 * tare.samples / TARE_MEASURES, 6);
+  }
+  else if (tare.state == TARE_DONE)
+  {
+    CenterPrintToScreen("Tared", 20);
+  }
+  else
+  {
+    CenterPrintToScreen("Tare failed", 20);
+    screen.setFont(u8g2_font_7x13_tr);          // Set smaller font
+    CenterPrintToScreen("Please try again", 40);
+  }
+  sendScreenBuffer();                          // Send the buffer to the display
+
+  unsigned long hold = tare.state == TARE_DONE ? 500 : 2000;
+  return !finished || millis() - tare.finishedAt < hold;
 }
 
 // Function to show mode change message
@@ -595,5 +749,5 @@ void showModeChangeMessage(const char* mode, const char* status)
   CenterPrintToScreen(mode, 20);                // Print the mode
   screen.setFont(u8g2_font_7x13_tr);            // Set smaller font
   CenterPrintToScreen(status, 40);              // Print the status
-  screen.sendBuffer();                          // Send the buffer to the display
+  sendScreenBuffer();                          // Send the buffer to the display
 }
@@ -0,0 +1,140 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "config.hpp"
+#include "dose_stats.hpp"
+#include "probe.hpp"
+#include "quantile.hpp"
+#include "recipe.hpp"
+
+static const float errorQuantiles[3] = {0.5f, 0.95f, 0.99f};
+static const float spreadQuantiles[3] = {0.05f, 0.5f, 0.95f};
+
+// One set of sketches per slot; a slot is a recipe index
+struct DoseSketches
+{
+    P2Quantiles<3> error{errorQuantiles};
+    P2Quantiles<3> overshoot{spreadQuantiles};
+    P2Quantiles<3> time{spreadQuantiles};
+};
+
+// What is stored per slot in the "doseStats" namespace
+struct DoseSketchState
+{
+    P2Quantiles<3>::State error;
+    P2Quantiles<3>::State overshoot;
+    P2Quantiles<3>::State time;
+};
+
+static DoseSketches sketches[DOSE_STATS_SLOTS];
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// NVS key of a slot; keyed by index so renaming a recipe keeps its statistics
+static String slotKey(int slot)
+{
+    return "r" + String(slot);
+}
+
+// Restores the sketches saved after the last shot of each slot
+void setupDoseStats()
+{
+    Preferences store;
+    if (!store.begin("doseStats", true)) {
+        return;
+    }
+    for (int slot = 0; slot < DOSE_STATS_SLOTS; slot++) {
+        DoseSketchState saved;
+        if (store.getBytes(slotKey(slot).c_str(), &saved, sizeof(saved)) == sizeof(saved)) {
+            sketches[slot].error.restore(saved.error);
+            sketches[slot].overshoot.restore(saved.overshoot);
+            sketches[slot].time.restore(saved.time);
+        }
+    }
+    store.end();
+}
+
+// Adds a successful shot; O(1) per sketch, then the slot's 228 bytes are saved
+void doseStatsRecord(int slot, double error, double overshoot, unsigned long grindTimeMs)
+{
+    if (slot < 0 || slot >= DOSE_STATS_SLOTS) {
+        return;
+    }
+    DoseSketchState state;
+    portENTER_CRITICAL(&statsMux);
+    DoseSketches &s = sketches[slot];
+    s.error.update(ABS(error));
+    s.overshoot.update(overshoot);
+    s.time.update(grindTimeMs / 1000.0f);
+    state.error = s.error.save();
+    state.overshoot = s.overshoot.save();
+    state.time = s.time.save();
+    portEXIT_CRITICAL(&statsMux);
+
+    PROBE_START(nvsStart);
+    Preferences store;
+    store.begin("doseStats", false);
+    store.putBytes(slotKey(slot).c_str(), &state, sizeof(state));
+    store.end();
+    PROBE_STOP(PROBE_NVS_WRITE, nvsStart);
+}
+
+DoseStatsSummary doseStatsSummary(int slot)
+{
+    DoseStatsSummary summary = {};
+    if (slot < 0 || slot >= DOSE_STATS_SLOTS) {
+        return summary;
+    }
+    portENTER_CRITICAL(&statsMux);
+    const DoseSketches &s = sketches[slot];
+    summary.shots = s.error.count();
+    for (size_t i = 0; i < 3; i++) {
+        summary.error[i] = s.error.quantile(i);
+        summary.overshoot[i] = s.overshoot.quantile(i);
+        summary.time[i] = s.time.quantile(i);
+    }
+    portEXIT_CRITICAL(&statsMux);
+    return summary;
+}
+
+void doseStatsReset()
+{
+    portENTER_CRITICAL(&statsMux);
+    for (int slot = 0; slot < DOSE_STATS_SLOTS; slot++) {
+        sketches[slot].error.reset();
+        sketches[slot].overshoot.reset();
+        sketches[slot].time.reset();
+    }
+    portEXIT_CRITICAL(&statsMux);
+
+    Preferences store;
+    store.begin("doseStats", false);
+    store.clear();
+    store.end();
+}
+
+void doseStatsPrint()
+{
+    for (int slot = 0; slot < DOSE_STATS_SLOTS; slot++) {
+        DoseStatsSummary s = doseStatsSummary(slot);
+        Serial.printf("[DoseStats] %-11s %lu shots | error p50 %.2f p95 %.2f p99 %.2f g | overshoot p5 %+.2f p50 %+.2f p95 %+.2f g | time p5 %.1f p50 %.1f p95 %.1f s\n",
+                      recipeAt(slot).name, (unsigned long)s.shots, s.error[0], s.error[1], s.error[2],
+                      s.overshoot[0], s.overshoot[1], s.overshoot[2], s.time[0], s.time[1], s.time[2]);
+    }
+}
+
+String doseStatsJson()
+{
+    String json = "{";
+    char buf[256];
+    for (int slot = 0; slot < DOSE_STATS_SLOTS; slot++) {
+        DoseStatsSummary s = doseStatsSummary(slot);
+        snprintf(buf, sizeof(buf),
+                 "%s\"%s\":{\"shots\":%lu,\"error\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},"
+                 "\"overshoot\":{\"p5\":%.3f,\"p50\":%.3f,\"p95\":%.3f},\"time\":{\"p5\":%.2f,\"p50\":%.2f,\"p95\":%.2f}}",
+                 slot ? "," : "", recipeAt(slot).name, (unsigned long)s.shots, s.error[0], s.error[1], s.error[2],
+                 s.overshoot[0], s.overshoot[1], s.overshoot[2], s.time[0], s.time[1], s.time[2]);
+        json += buf;
+    }
+    json += "}";
+    return json;
+}
@@ -1,17 +1,24 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <PubSubClient.h>
 #include <ESPAsyncWebServer.h>
 
 #include "display.hpp"
 #include "scale.hpp"
 #include "config.hpp"
 #include "web_server.hpp"
+#include "mqtt.hpp"
+#include "probe.hpp"
+#include "task_stats.hpp"
+#include "auto_zero.hpp"
+#include "shot_log.hpp"
+#include "dose_stats.hpp"
+#include "recipe.hpp"
+#include "cups.hpp"
+#include "ota.hpp"
 
 // Definitions of global variables (memory allocated here)
 Preferences preferences;             // Preferences object
 HX711 loadcell;                      // HX711 load cell object
-SimpleKalmanFilter kalmanFilter(0.02, 0.02, 0.01); // Kalman filter for weight smoothing
 
 TaskHandle_t ScaleTask = nullptr;    // Initialize task handles to nullptr
 TaskHandle_t ScaleStatusTask = nullptr;
@@ -30,9 +37,80 @@ void setup() {
     // Setup other components
     setupDisplay();
     setupScale();
-    // setupWebServer(); // Disabled
+    setupMqtt();
+    setupTaskStats();
+    setupShotLog();
+    setupDoseStats();
+    setupWebServer();
 }
 
 void loop() {
+    // Serial console: 'p' prints the latency probes, 'r' resets them, 's' prints task and heap stats,
+    // 't' toggles the raw sample trace, 'z' prints the auto-zero drift, 'h' prints the last shots,
+    // 'q' prints the dose accuracy quantiles, 'n' switches to the next recipe, 'c' lists the known cups,
+    // 'm' prints the MQTT state; "m <host>[:<port>] [telemetry]" sets the broker, "m off" disables it,
+    // "w <ssid> <password>" stores the Wi-Fi network and restarts, "w off" forgets it,
+    // "o <password>" stores the firmware update password (after a restart), "o off" disables updates
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == 'p') {
+            probePrintReport();
+        } else if (c == 'r') {
+            probeReset();
+            Serial.println("[Probe] Reset");
+        } else if (c == 's') {
+            taskStatsPrintLatest();
+        } else if (c == 't') {
+            Serial.printf("[Trace] Sample trace %s\n", toggleSampleTrace() ? "on" : "off");
+        } else if (c == 'z') {
+            autoZeroPrintStats();
+        } else if (c == 'h') {
+            shotLogPrintRecent(10);
+        } else if (c == 'q') {
+            doseStatsPrint();
+        } else if (c == 'n') {
+            int next = (recipeIndex() + 1) % RECIPE_COUNT;
+            if (recipeRequest(next)) {
+                Serial.printf("[Recipe] Switching to %s once the scale is empty\n", recipeAt(next).name);
+            } else {
+                Serial.println("[Recipe] Not switched during a shot");
+            }
+        } else if (c == 'c') {
+            cupsPrint();
+        } else if (c == 'm') {
+            String line = Serial.readStringUntil('\n');
+            line.trim();
+            if (line.length() > 0) {
+                char host[64] = "";
+                unsigned int port = MQTT_DEFAULT_PORT;
+                char option[16] = "";
+                if (sscanf(line.c_str(), "%63[^: ]:%u %15s", host, &port, option) < 2) {
+                    sscanf(line.c_str(), "%63[^: ] %15s", host, option);
+                }
+                mqttConfigure(strcmp(host, "off") == 0 ? "" : host, port, strcmp(option, "telemetry") == 0);
+            } else {
+                mqttPrintStatus();
+            }
+        } else if (c == 'w') {
+            String line = Serial.readStringUntil('\n');
+            line.trim();
+            // The password is the last word, so the SSID may contain spaces
+            int split = line.lastIndexOf(' ');
+            String ssid = line == "off" ? "" : split > 0 ? line.substring(0, split) : line;
+            String pass = line == "off" || split <= 0 ? "" : line.substring(split + 1);
+            ssid.trim();
+            if (line.length() > 0 && wifiConfigure(ssid.c_str(), pass.c_str())) {
+                Serial.println("Restarting...");
+                delay(100);
+                ESP.restart();
+            }
+        } else if (c == 'o') {
+            String line = Serial.readStringUntil('\n');
+            line.trim();
+            if (line.length() > 0) {
+                otaConfigure(line == "off" ? "" : line.c_str());
+            }
+        }
+    }
     delay(1000);
 }
@@ -0,0 +1,389 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+#include "config.hpp"
+#include "mqtt.hpp"
+#include "web_server.hpp"
+
+#define MQTT_RECORD_SHOT 0
+#define MQTT_RECORD_WEIGHT 1
+
+// One queued message; formatted into JSON only when it is flushed
+struct MqttRecord
+{
+    uint8_t type;
+    uint8_t result;
+    uint32_t at;          // millis() when the record was queued
+    uint32_t grindTimeMs;
+    float target;
+    float actual;         // shot weight, or the sample for weight records
+    float offsetUsed;
+};
+
+TaskHandle_t MqttTask = nullptr;
+
+static WiFiClient wifiClient;
+static PubSubClient mqttClient(wifiClient);
+
+static volatile bool mqttEnabled = false;   // Broker configured, publisher task running
+static volatile bool mqttTelemetry = false; // Publish decimated weight samples
+static volatile bool reconfigure = false;   // Settings changed; the MQTT task reloads them
+static volatile bool brokerConnected = false; // Last state seen by the MQTT task, for the status reports
+static char mqttHost[64];                   // PubSubClient keeps a pointer to this
+static portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t mqttPort = MQTT_DEFAULT_PORT;
+static char clientId[24];
+static char shotTopic[48];
+static char weightTopic[48];
+
+// Bounded ring shared between the scale tasks (producers) and the MQTT task (consumer).
+// Producers never block: a full queue drops the new record and counts it.
+static MqttRecord queue[MQTT_QUEUE_SIZE];
+static size_t queueHead = 0;  // oldest record
+static size_t queueCount = 0;
+static unsigned long droppedRecords = 0;
+static portMUX_TYPE queueMux = portMUX_INITIALIZER_UNLOCKED;
+
+const char *grindResultName(int result)
+{
+    switch (result)
+    {
+    case GRIND_RESULT_OK:
+        return "ok";
+    case GRIND_RESULT_CUP_REMOVED:
+        return "cup_removed";
+    case GRIND_RESULT_SCALE_NOT_READY:
+        return "scale_not_ready";
+    case GRIND_RESULT_MAX_TIME:
+        return "max_time";
+    case GRIND_RESULT_NO_FLOW:
+        return "no_flow";
+    case GRIND_RESULT_ABORTED:
+        return "aborted";
+    case GRIND_RESULT_SAFETY:
+        return "safety";
+    }
+    return "unknown";
+}
+
+static bool enqueue(const MqttRecord &record)
+{
+    bool queued = false;
+    portENTER_CRITICAL(&queueMux);
+    // Telemetry may not use the last slots so an outage can never crowd out shot summaries
+    size_t limit = record.type == MQTT_RECORD_WEIGHT ? MQTT_QUEUE_SIZE - MQTT_TELEMETRY_HEADROOM : MQTT_QUEUE_SIZE;
+    if (queueCount < limit) {
+        queue[(queueHead + queueCount) % MQTT_QUEUE_SIZE] = record;
+        queueCount++;
+        queued = true;
+    } else {
+        droppedRecords++;
+    }
+    portEXIT_CRITICAL(&queueMux);
+    return queued;
+}
+
+// Copies up to maxCount of the oldest records without removing them
+static size_t peekQueue(MqttRecord *out, size_t maxCount)
+{
+    portENTER_CRITICAL(&queueMux);
+    size_t n = queueCount < maxCount ? queueCount : maxCount;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = queue[(queueHead + i) % MQTT_QUEUE_SIZE];
+    }
+    portEXIT_CRITICAL(&queueMux);
+    return n;
+}
+
+// Removes records once the broker has accepted them
+static void popQueue(size_t n)
+{
+    portENTER_CRITICAL(&queueMux);
+    queueHead = (queueHead + n) % MQTT_QUEUE_SIZE;
+    queueCount -= n;
+    portEXIT_CRITICAL(&queueMux);
+}
+
+void mqttPublishShot(double target, double actual, unsigned long grindTimeMs, double offsetUsed, int result)
+{
+    if (!mqttEnabled) {
+        return;
+    }
+    MqttRecord record;
+    record.type = MQTT_RECORD_SHOT;
+    record.result = result;
+    record.at = millis();
+    record.grindTimeMs = grindTimeMs;
+    record.target = target;
+    record.actual = actual;
+    record.offsetUsed = offsetUsed;
+    enqueue(record);
+}
+
+void mqttPublishWeight(double weight)
+{
+    static unsigned int sampleCounter = 0;
+    if (!mqttEnabled || !mqttTelemetry) {
+        return;
+    }
+    if (++sampleCounter < MQTT_TELEMETRY_DECIMATION) {
+        return;
+    }
+    sampleCounter = 0;
+
+    MqttRecord record;
+    record.type = MQTT_RECORD_WEIGHT;
+    record.result = 0;
+    record.at = millis();
+    record.grindTimeMs = 0;
+    record.target = 0;
+    record.actual = weight;
+    record.offsetUsed = 0;
+    enqueue(record);
+}
+
+// Publishes one burst. Shot summaries go out one message each (retained, so a monitor that
+// connects late still sees the last shot); consecutive weight samples are packed into a single
+// array message. Records are only dropped from the queue once publish() succeeded.
+// PubSubClient only publishes at QoS 0, so "succeeded" means handed to the TCP stack: a record
+// is safe across an outage while it waits in the queue, but the burst in flight when the
+// connection drops can be lost.
+static void flushQueue()
+{
+    MqttRecord burst[MQTT_BURST_SIZE];
+    char payload[512];
+    size_t count = peekQueue(burst, MQTT_BURST_SIZE);
+    size_t sent = 0;
+
+    while (sent < count) {
+        const MqttRecord &first = burst[sent];
+        size_t consumed = 1;
+        bool ok;
+        if (first.type == MQTT_RECORD_SHOT) {
+            snprintf(payload, sizeof(payload),
+                     "{\"at\":%lu,\"target\":%.2f,\"actual\":%.2f,\"time\":%.2f,\"offset\":%.2f,\"result\":\"%s\"}",
+                     (unsigned long)first.at, first.target, first.actual, first.grindTimeMs / 1000.0,
+                     first.offsetUsed, grindResultName(first.result));
+            ok = mqttClient.publish(shotTopic, payload, true);
+        } else {
+            int len = snprintf(payload, sizeof(payload), "{\"samples\":[");
+            consumed = 0;
+            while (sent + consumed < count && burst[sent + consumed].type == MQTT_RECORD_WEIGHT &&
+                   len < (int)sizeof(payload) - 32) {
+                const MqttRecord &sample = burst[sent + consumed];
+                len += snprintf(payload + len, sizeof(payload) - len, "%s[%lu,%.1f]",
+                                consumed ? "," : "", (unsigned long)sample.at, sample.actual);
+                consumed++;
+            }
+            snprintf(payload + len, sizeof(payload) - len, "]}");
+            ok = mqttClient.publish(weightTopic, payload);
+        }
+        if (!ok) {
+            break; // Broker went away mid-burst; keep the rest for the next attempt
+        }
+        sent += consumed;
+    }
+    if (sent > 0) {
+        popQueue(sent);
+    }
+}
+
+// A broker host is a name or address: printable, no spaces, nothing that would need escaping in
+// the status JSON
+static bool validHost(const char *host)
+{
+    size_t len = strnlen(host, sizeof(mqttHost));
+    if (len >= sizeof(mqttHost)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = host[i];
+        if (c <= ' ' || c > '~' || c == '"' || c == '\\') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the broker settings from the "mqtt" namespace. Uses its own Preferences handle so it
+// can run on the MQTT task while other tasks use the global one.
+static void loadSettings()
+{
+    char host[sizeof(mqttHost)] = "";
+    Preferences store;
+    store.begin("mqtt", true);
+    store.getString("host", host, sizeof(host));
+    uint16_t port = store.getUShort("port", MQTT_DEFAULT_PORT);
+    mqttTelemetry = store.getBool("telemetry", false);
+    store.end();
+    if (!validHost(host)) {
+        Serial.println("[MQTT] Stored broker host is invalid, ignoring it");
+        host[0] = '\0';
+    }
+
+    portENTER_CRITICAL(&settingsMux);
+    memcpy(mqttHost, host, sizeof(mqttHost));
+    mqttPort = port;
+    portEXIT_CRITICAL(&settingsMux);
+}
+
+// Copies the broker address for the status reports, which run on other tasks
+static uint16_t copySettings(char *host, size_t size)
+{
+    portENTER_CRITICAL(&settingsMux);
+    strlcpy(host, mqttHost, size);
+    uint16_t port = mqttPort;
+    portEXIT_CRITICAL(&settingsMux);
+    return port;
+}
+
+// Applies settings stored by mqttConfigure(). Records still queued go to the new broker.
+static void applySettings()
+{
+    reconfigure = false;
+    mqttClient.disconnect();
+    loadSettings();
+    mqttEnabled = mqttHost[0] != '\0';
+    if (mqttEnabled) {
+        mqttClient.setServer(mqttHost, mqttPort);
+        Serial.printf("[MQTT] Broker set to %s:%u\n", mqttHost, mqttPort);
+    } else {
+        Serial.println("[MQTT] Publisher disabled");
+    }
+}
+
+static bool reconnect()
+{
+    if (mqttClient.connected()) {
+        return true;
+    }
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+    Serial.printf("[MQTT] Connecting to %s:%u...\n", mqttHost, mqttPort);
+    if (mqttClient.connect(clientId)) {
+        Serial.println("[MQTT] Connected");
+        return true;
+    }
+    Serial.printf("[MQTT] Connect failed, state %d\n", mqttClient.state());
+    return false;
+}
+
+// Task that owns the network side; runs on NETWORK_TASK_CORE so broker stalls never delay the scale tasks
+void mqttLoop(void *parameter)
+{
+    (void)parameter;
+    unsigned long lastReconnectAttempt = 0;
+    unsigned long lastFlushAt = 0;
+
+    if (WiFi.status() != WL_CONNECTED) {
+        connectToWiFi();
+    }
+
+    for (;;) {
+        if (reconfigure) {
+            applySettings();
+            lastReconnectAttempt = millis() - MQTT_RECONNECT_INTERVAL;
+        }
+        if (!mqttEnabled) {
+            // No broker configured; wait for mqttConfigure()
+        } else if (!mqttClient.connected()) {
+            if (millis() - lastReconnectAttempt >= MQTT_RECONNECT_INTERVAL) {
+                lastReconnectAttempt = millis();
+                reconnect();
+            }
+        } else {
+            mqttClient.loop();
+            // Flush in bursts, or straight away once the queue is filling up
+            if (millis() - lastFlushAt >= MQTT_FLUSH_INTERVAL || queueCount >= MQTT_BURST_SIZE) {
+                lastFlushAt = millis();
+                flushQueue();
+            }
+        }
+        brokerConnected = mqttEnabled && mqttClient.connected();
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
+}
+
+// Reads the broker settings and starts the publisher task. Without a configured host
+// nothing is started and the publish calls return immediately.
+void setupMqtt()
+{
+    loadSettings();
+
+    if (mqttHost[0] == '\0') {
+        Serial.println("[MQTT] No broker configured, publisher disabled");
+        return;
+    }
+
+    uint32_t chipId = (uint32_t)(ESP.getEfuseMac() >> 24);
+    snprintf(clientId, sizeof(clientId), "openGBW-%06lx", (unsigned long)(chipId & 0xFFFFFF));
+    snprintf(shotTopic, sizeof(shotTopic), "opengbw/%s/shot", clientId + 8);
+    snprintf(weightTopic, sizeof(weightTopic), "opengbw/%s/weight", clientId + 8);
+
+    mqttClient.setServer(mqttHost, mqttPort);
+    mqttClient.setBufferSize(768);
+    mqttClient.setSocketTimeout(2);
+    mqttEnabled = true;
+
+    xTaskCreatePinnedToCore(mqttLoop, "MQTT", 8192, NULL, NETWORK_TASK_PRIORITY, &MqttTask, NETWORK_TASK_CORE);
+}
+
+// Stores new broker settings (an empty host disables the publisher) and applies them without a
+// reboot: a running publisher task picks them up on its next pass, otherwise the task is started.
+// Returns false, storing nothing, if the host is not a plain name or address.
+bool mqttConfigure(const char *host, uint16_t port, bool telemetry)
+{
+    if (!validHost(host)) {
+        Serial.println("[MQTT] Invalid broker host");
+        return false;
+    }
+    Preferences store;
+    store.begin("mqtt", false);
+    store.putString("host", host);
+    store.putUShort("port", port ? port : MQTT_DEFAULT_PORT);
+    store.putBool("telemetry", telemetry);
+    store.end();
+    Serial.printf("[MQTT] Broker settings stored: %s\n", host[0] ? host : "disabled");
+
+    if (MqttTask == nullptr) {
+        setupMqtt();
+    } else {
+        reconfigure = true;
+    }
+    return true;
+}
+
+void mqttPrintStatus()
+{
+    portENTER_CRITICAL(&queueMux);
+    size_t queued = queueCount;
+    unsigned long dropped = droppedRecords;
+    portEXIT_CRITICAL(&queueMux);
+    if (!mqttEnabled) {
+        Serial.println("[MQTT] No broker configured");
+        return;
+    }
+    char host[sizeof(mqttHost)];
+    uint16_t port = copySettings(host, sizeof(host));
+    Serial.printf("[MQTT] %s:%u %s, telemetry %s, %u queued, %lu dropped\n", host, port,
+                  brokerConnected ? "connected" : "disconnected", mqttTelemetry ? "on" : "off",
+                  (unsigned)queued, dropped);
+}
+
+String mqttStatusJson()
+{
+    portENTER_CRITICAL(&queueMux);
+    size_t queued = queueCount;
+    unsigned long dropped = droppedRecords;
+    portEXIT_CRITICAL(&queueMux);
+    char host[sizeof(mqttHost)];
+    uint16_t port = copySettings(host, sizeof(host));
+    char buf[192];
+    snprintf(buf, sizeof(buf), "{\"enabled\":%s,\"host\":\"%s\",\"port\":%u,\"telemetry\":%s,\"connected\":%s,\"queued\":%u,\"dropped\":%lu}",
+             mqttEnabled ? "true" : "false", mqttEnabled ? host : "", port,
+             mqttTelemetry ? "true" : "false", brokerConnected ? "true" : "false",
+             (unsigned)queued, dropped);
+    return String(buf);
+}
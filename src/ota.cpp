@@ -0,0 +1,235 @@
+#include <Arduino.h>
+#include <Update.h>
+#include "mbedtls/sha256.h"
+
+#include "config.hpp"
+#include "ota.hpp"
+#include "scale.hpp"
+
+volatile bool otaInProgress = false;
+
+// Only one upload is flashed at a time; later ones are answered with 409
+static AsyncWebServerRequest *otaRequest = nullptr;
+static mbedtls_sha256_context otaHash;
+static bool otaHashing = false;
+static uint8_t otaExpected[32];
+static const char *otaError = nullptr;
+static size_t otaWritten = 0;
+static bool otaRebootPending = false;
+static uint32_t otaStopTicket = 0;
+static String otaUser;
+static String otaPassword;
+
+static bool parseSha256(const String &hex, uint8_t *out)
+{
+    if (hex.length() != 64) {
+        return false;
+    }
+    for (int i = 0; i < 64; i++) {
+        if (!isxdigit((unsigned char)hex[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 32; i++) {
+        char byte[3] = {hex[2 * i], hex[2 * i + 1], 0};
+        out[i] = (uint8_t)strtoul(byte, nullptr, 16);
+    }
+    return true;
+}
+
+static void hashStart()
+{
+    otaHashing = true;
+    mbedtls_sha256_init(&otaHash);
+#if ESP_IDF_VERSION_MAJOR < 5
+    mbedtls_sha256_starts_ret(&otaHash, 0);
+#else
+    mbedtls_sha256_starts(&otaHash, 0);
+#endif
+}
+
+static void hashUpdate(const uint8_t *data, size_t len)
+{
+#if ESP_IDF_VERSION_MAJOR < 5
+    mbedtls_sha256_update_ret(&otaHash, data, len);
+#else
+    mbedtls_sha256_update(&otaHash, data, len);
+#endif
+}
+
+static void hashFinish(uint8_t *digest)
+{
+#if ESP_IDF_VERSION_MAJOR < 5
+    mbedtls_sha256_finish_ret(&otaHash, digest);
+#else
+    mbedtls_sha256_finish(&otaHash, digest);
+#endif
+    mbedtls_sha256_free(&otaHash);
+    otaHashing = false;
+}
+
+static void hashDiscard()
+{
+    if (otaHashing) {
+        mbedtls_sha256_free(&otaHash);
+        otaHashing = false;
+    }
+}
+
+static void otaFail(const char *error)
+{
+    if (otaError == nullptr) {
+        otaError = error;
+    }
+    if (Update.isRunning()) {
+        Update.abort();
+    }
+    hashDiscard();
+    Serial.printf("[OTA] Update failed: %s\n", error);
+}
+
+// Runs when the uploading connection closes, whatever the outcome. A verified image
+// reboots into the new partition; anything else releases the scale again.
+static void otaDisconnected(AsyncWebServerRequest *request)
+{
+    if (request != otaRequest) {
+        return;
+    }
+    if (otaRebootPending) {
+        Serial.println("[OTA] Rebooting into new firmware");
+        delay(100);
+        ESP.restart();
+    }
+    if (Update.isRunning()) {
+        Update.abort();
+    }
+    hashDiscard();
+    otaRequest = nullptr;
+    otaInProgress = false;
+    Serial.println("[OTA] Scale released");
+}
+
+// Filter of the /update handler, run as soon as a request's headers are in and before any of
+// its body. An authenticated upload claims the update here and asks the control task to stop
+// the relay, so the stop is confirmed by the time the first chunk arrives.
+static bool claimUpdate(AsyncWebServerRequest *request)
+{
+    if (request->method() != HTTP_POST || otaRequest != nullptr ||
+        !request->authenticate(otaUser.c_str(), otaPassword.c_str())) {
+        return true;
+    }
+    otaRequest = request;
+    otaError = nullptr;
+    otaWritten = 0;
+    request->onDisconnect([request]() { otaDisconnected(request); });
+    // The grind state machine is paused until the update is over. The control task
+    // stops the relay and fails a running shot.
+    otaInProgress = true;
+    otaStopTicket = requestGrinderStop();
+    return true;
+}
+
+// Multipart chunks are hashed and written to the inactive OTA partition as they arrive;
+// nothing is buffered beyond the chunk the web server hands over
+static void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+    if (index == 0 && request == otaRequest) {
+        AsyncWebHeader *sha = request->getHeader("X-Firmware-SHA256");
+        if (sha == nullptr || !parseSha256(sha->value(), otaExpected)) {
+            otaFail("missing or malformed X-Firmware-SHA256 header");
+            return;
+        }
+
+        // Flashing starts only once the control task has stopped the grinder; never wait for it here
+        if (!grinderStopped(otaStopTicket)) {
+            otaFail("grinder did not stop in time, try again");
+            return;
+        }
+
+        if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
+            otaFail(Update.errorString());
+            return;
+        }
+        hashStart();
+        Serial.printf("[OTA] Receiving %s\n", filename.c_str());
+    }
+    if (request != otaRequest || otaError != nullptr) {
+        return;
+    }
+
+    hashUpdate(data, len);
+    if (Update.write(data, len) != len) {
+        otaFail(Update.errorString());
+        return;
+    }
+    otaWritten += len;
+
+    if (final) {
+        uint8_t digest[32];
+        hashFinish(digest);
+        if (memcmp(digest, otaExpected, sizeof(digest)) != 0) {
+            otaFail("SHA-256 mismatch");
+            return;
+        }
+        // Only now is the new partition marked bootable
+        if (!Update.end(true)) {
+            otaFail(Update.errorString());
+            return;
+        }
+        Serial.printf("[OTA] %u bytes written and verified\n", (unsigned int)otaWritten);
+    }
+}
+
+static void handleUpdateRequest(AsyncWebServerRequest *request)
+{
+    if (otaRequest == nullptr) {
+        request->send(400, "text/plain", "No firmware uploaded");
+    } else if (request != otaRequest) {
+        request->send(409, "text/plain", "Another update is in progress");
+    } else if (otaError != nullptr) {
+        request->send(400, "text/plain", String("Update failed: ") + otaError);
+    } else if (!Update.isFinished()) {
+        otaFail("upload incomplete");
+        request->send(400, "text/plain", "Update failed: upload incomplete");
+    } else {
+        otaRebootPending = true;
+        request->send(200, "text/plain", "Update verified. Rebooting...");
+    }
+}
+
+// Stores the password /update asks for (an empty one disables the endpoint). The web server
+// picks it up on the next start.
+bool otaConfigure(const char *password)
+{
+    size_t len = strlen(password);
+    if (len > 0 && len < 8) {
+        Serial.println("[OTA] Password needs at least 8 characters");
+        return false;
+    }
+    Preferences store;
+    store.begin("ota", false);
+    store.putString("password", password);
+    store.end();
+    Serial.printf("[OTA] Password %s, applies after a restart\n", len > 0 ? "stored" : "cleared");
+    return true;
+}
+
+// Registers POST /update. The endpoint is only enabled once a password is stored in the
+// "ota" preferences namespace.
+void setupOtaEndpoint(AsyncWebServer &server)
+{
+    Preferences store;
+    store.begin("ota", true);
+    otaUser = store.getString("user", OTA_DEFAULT_USER);
+    otaPassword = store.getString("password", "");
+    store.end();
+
+    if (otaPassword.length() == 0) {
+        Serial.println("[OTA] No password configured, /update disabled");
+        return;
+    }
+
+    server.on("/update", HTTP_POST, handleUpdateRequest, handleUpload)
+        .setAuthentication(otaUser.c_str(), otaPassword.c_str())
+        .setFilter(claimUpdate);
+}
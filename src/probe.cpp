@@ -0,0 +1,171 @@
+#include "probe.hpp"
+
+#if PROBES_ENABLED
+
+struct ProbeStats
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t buckets[PROBE_BUCKETS];
+};
+
+static const char *probeNames[PROBE_COUNT] = {
+    "hx711_wait",
+    "hx711_read",
+    "filter",
+    "decision",
+    "relay_latency",
+    "relay_switch",
+    "display_send",
+    "nvs_write",
+    "sample_jitter",
+    "cutoff_error",
+};
+
+static ProbeStats probes[PROBE_COUNT];
+static uint32_t probeMarks[PROBE_COUNT];
+static bool probeMarked[PROBE_COUNT];
+static portMUX_TYPE probeMux = portMUX_INITIALIZER_UNLOCKED;
+
+void probeRecord(int id, uint32_t cycles)
+{
+    uint32_t us = cycles / getCpuFrequencyMhz();
+    int bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= PROBE_BUCKETS) {
+        bucket = PROBE_BUCKETS - 1;
+    }
+
+    portENTER_CRITICAL(&probeMux);
+    ProbeStats &p = probes[id];
+    if (p.count == 0 || us < p.minUs) {
+        p.minUs = us;
+    }
+    if (us > p.maxUs) {
+        p.maxUs = us;
+    }
+    p.count++;
+    p.totalUs += us;
+    p.buckets[bucket]++;
+    portEXIT_CRITICAL(&probeMux);
+}
+
+void probeMark(int id)
+{
+    probeMarks[id] = probeNow();
+    probeMarked[id] = true;
+}
+
+// Records the time since the last probeMark() of this id, once per mark
+void probeSinceMark(int id)
+{
+    if (probeMarked[id]) {
+        probeMarked[id] = false;
+        probeRecord(id, probeNow() - probeMarks[id]);
+    }
+}
+
+// Records how far the time since the previous mark is off the nominal period, then marks again
+void probeJitter(int id, uint32_t periodUs)
+{
+    uint32_t now = probeNow();
+    if (probeMarked[id]) {
+        int32_t deviation = (int32_t)(now - probeMarks[id]) - (int32_t)(periodUs * getCpuFrequencyMhz());
+        probeRecord(id, deviation < 0 ? -deviation : deviation);
+    }
+    probeMarks[id] = now;
+    probeMarked[id] = true;
+}
+
+void probeReset()
+{
+    portENTER_CRITICAL(&probeMux);
+    memset(probes, 0, sizeof(probes));
+    portEXIT_CRITICAL(&probeMux);
+}
+
+static void probeSnapshot(ProbeStats *out)
+{
+    portENTER_CRITICAL(&probeMux);
+    memcpy(out, probes, sizeof(probes));
+    portEXIT_CRITICAL(&probeMux);
+}
+
+// Upper bound of a bucket in microseconds
+static uint32_t bucketLimit(int bucket)
+{
+    return 1UL << bucket;
+}
+
+void probePrintReport()
+{
+    ProbeStats snapshot[PROBE_COUNT];
+    probeSnapshot(snapshot);
+
+    Serial.println("[Probe] name            count      min      avg      max (us)");
+    for (int i = 0; i < PROBE_COUNT; i++) {
+        const ProbeStats &p = snapshot[i];
+        Serial.printf("[Probe] %-14s %7lu %8lu %8lu %8lu\n", probeNames[i], (unsigned long)p.count,
+                      (unsigned long)p.minUs, (unsigned long)(p.count ? p.totalUs / p.count : 0),
+                      (unsigned long)p.maxUs);
+        if (p.count == 0) {
+            continue;
+        }
+        Serial.print("        ");
+        for (int b = 0; b < PROBE_BUCKETS; b++) {
+            if (p.buckets[b]) {
+                Serial.printf(" <%luus:%lu", (unsigned long)bucketLimit(b), (unsigned long)p.buckets[b]);
+            }
+        }
+        Serial.println();
+    }
+}
+
+String probeReportJson()
+{
+    ProbeStats snapshot[PROBE_COUNT];
+    probeSnapshot(snapshot);
+
+    String json = "{\"bucket_limits_us\":[";
+    for (int b = 0; b < PROBE_BUCKETS; b++) {
+        json += b ? "," : "";
+        json += bucketLimit(b);
+    }
+    json += "],\"probes\":[";
+    for (int i = 0; i < PROBE_COUNT; i++) {
+        const ProbeStats &p = snapshot[i];
+        char head[160];
+        snprintf(head, sizeof(head), "%s{\"name\":\"%s\",\"count\":%lu,\"min_us\":%lu,\"avg_us\":%lu,\"max_us\":%lu,\"buckets\":[",
+                 i ? "," : "", probeNames[i], (unsigned long)p.count, (unsigned long)p.minUs,
+                 (unsigned long)(p.count ? p.totalUs / p.count : 0), (unsigned long)p.maxUs);
+        json += head;
+        for (int b = 0; b < PROBE_BUCKETS; b++) {
+            json += b ? "," : "";
+            json += p.buckets[b];
+        }
+        json += "]}";
+    }
+    json += "]}";
+    return json;
+}
+
+#else
+
+void probeRecord(int id, uint32_t cycles) {}
+void probeMark(int id) {}
+void probeSinceMark(int id) {}
+void probeJitter(int id, uint32_t periodUs) {}
+void probeReset() {}
+
+void probePrintReport()
+{
+    Serial.println("[Probe] Instrumentation compiled out (PROBES_ENABLED 0)");
+}
+
+String probeReportJson()
+{
+    return "{\"probes\":[]}";
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "config.hpp"
+#include "probe.hpp"
+#include "recipe.hpp"
+
+// The whole table is one blob ("table") in the "recipes" NVS namespace; "active" holds the
+// index restored at boot. Edits only mark the table dirty, and the control loop writes it
+// once the user has stopped turning the knob for RECIPE_SAVE_DELAY. Selecting a recipe
+// writes nothing; the index is persisted along with the next shot.
+
+static const char *defaultNames[RECIPE_COUNT] = {"Espresso", "Filter", "Recipe 3", "Recipe 4"};
+
+static Recipe table[RECIPE_COUNT];
+Recipe *recipe = &table[0];
+static uint8_t savedActive = 0;
+static volatile bool dirty = false;
+static volatile unsigned long changedAt = 0;
+static int requested = -1; // selection asked for by another task, applied by the control loop
+static portMUX_TYPE recipeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void setDefaults(Recipe &r, int index)
+{
+    memset(&r, 0, sizeof(r));
+    strlcpy(r.name, defaultNames[index], sizeof(r.name));
+    r.dose = COFFEE_DOSE_WEIGHT;
+    r.cup = CUP_WEIGHT;
+    r.offset = COFFEE_DOSE_OFFSET;
+    r.time = COFFEE_GRIND_TIME;
+    r.grindMode = DEFAULT_GRIND_MODE;
+    r.stopMode = DEFAULT_STOP_MODE;
+}
+
+static void writeTable()
+{
+    Recipe copy[RECIPE_COUNT];
+    portENTER_CRITICAL(&recipeMux);
+    memcpy(copy, table, sizeof(copy));
+    dirty = false;
+    portEXIT_CRITICAL(&recipeMux);
+    uint8_t active = recipeIndex();
+
+    PROBE_START(nvsStart);
+    Preferences store;
+    store.begin("recipes", false);
+    store.putBytes("table", copy, sizeof(copy));
+    if (active != savedActive) {
+        store.putUChar("active", active);
+        savedActive = active;
+    }
+    store.end();
+    PROBE_STOP(PROBE_NVS_WRITE, nvsStart);
+}
+
+// Loads the table. On the first boot after the update the first recipe takes over the single
+// set of settings older firmware kept in the "scale" namespace.
+void setupRecipes()
+{
+    Preferences store;
+    store.begin("recipes", false);
+    bool loaded = store.getBytes("table", table, sizeof(table)) == sizeof(table);
+    savedActive = store.getUChar("active", 0);
+    store.end();
+    if (savedActive >= RECIPE_COUNT) {
+        savedActive = 0;
+    }
+
+    if (!loaded) {
+        for (int i = 0; i < RECIPE_COUNT; i++) {
+            setDefaults(table[i], i);
+        }
+        Preferences legacy;
+        if (legacy.begin("scale", true)) {
+            Recipe &r = table[0];
+            r.dose = legacy.getDouble("setWeight", r.dose);
+            r.cup = legacy.getDouble("cup", r.cup);
+            r.offset = legacy.getDouble("offset", r.offset);
+            r.time = legacy.getDouble("setTime", r.time);
+            r.grindMode = legacy.getBool("grindMode", r.grindMode);
+            r.stopMode = legacy.getInt("stopMode", r.stopMode);
+            legacy.end();
+        }
+        writeTable();
+    }
+    for (int i = 0; i < RECIPE_COUNT; i++) {
+        table[i].name[RECIPE_NAME_LENGTH - 1] = '\0';
+    }
+    recipe = &table[savedActive];
+    Serial.printf("[Recipe] %s: %.1fg, offset %.2fg\n", recipe->name, recipe->dose, recipe->offset);
+}
+
+// Makes `index` the active recipe. Refused during a shot, whose target and offset learning
+// belong to the recipe it was started with. Control task only; other tasks use recipeRequest().
+bool recipeSelect(int index)
+{
+    if (index < 0 || index >= RECIPE_COUNT ||
+        scaleStatus == STATUS_GRINDING_IN_PROGRESS || scaleStatus == STATUS_GRINDING_FINISHED) {
+        return false;
+    }
+    recipe = &table[index];
+    return true;
+}
+
+// Asks the control loop to select `index` the next time the scale is empty. A later request
+// replaces one that has not been applied yet. Refused for an unknown index or during a shot.
+bool recipeRequest(int index)
+{
+    if (index < 0 || index >= RECIPE_COUNT ||
+        scaleStatus == STATUS_GRINDING_IN_PROGRESS || scaleStatus == STATUS_GRINDING_FINISHED) {
+        return false;
+    }
+    portENTER_CRITICAL(&recipeMux);
+    requested = index;
+    portEXIT_CRITICAL(&recipeMux);
+    return true;
+}
+
+// The selection waiting for the control loop, or -1
+int recipeRequested()
+{
+    portENTER_CRITICAL(&recipeMux);
+    int index = requested;
+    portEXIT_CRITICAL(&recipeMux);
+    return index;
+}
+
+// Called by the control loop in STATUS_EMPTY
+void recipeApplyRequest()
+{
+    portENTER_CRITICAL(&recipeMux);
+    int index = requested;
+    requested = -1;
+    portEXIT_CRITICAL(&recipeMux);
+    if (index >= 0 && recipeSelect(index)) {
+        Serial.printf("[Recipe] Selected %s\n", recipe->name);
+    }
+}
+
+int recipeIndex()
+{
+    return recipe - table;
+}
+
+const Recipe &recipeAt(int index)
+{
+    return table[index >= 0 && index < RECIPE_COUNT ? index : 0];
+}
+
+// Call after changing a field of the active recipe
+void recipeChanged()
+{
+    changedAt = millis();
+    dirty = true;
+}
+
+// Called by the control loop; writes the table once the edits have settled
+void recipeFlush()
+{
+    if (!dirty || millis() - changedAt < RECIPE_SAVE_DELAY || scaleStatus == STATUS_GRINDING_IN_PROGRESS) {
+        return;
+    }
+    writeTable();
+}
+
+// Persists the active index. Called after a shot, which writes to flash anyway.
+void recipeCommitActive()
+{
+    uint8_t active = recipeIndex();
+    if (active == savedActive) {
+        return;
+    }
+    Preferences store;
+    store.begin("recipes", false);
+    store.putUChar("active", active);
+    store.end();
+    savedActive = active;
+}
+
+// Restores every recipe to the defaults and selects the first one
+void recipeReset()
+{
+    portENTER_CRITICAL(&recipeMux);
+    for (int i = 0; i < RECIPE_COUNT; i++) {
+        setDefaults(table[i], i);
+    }
+    portEXIT_CRITICAL(&recipeMux);
+    recipe = &table[0];
+    writeTable();
+}
+
+static const char *stopModeName(uint8_t mode)
+{
+    return mode == STOP_TIME ? "time" : mode == STOP_WEIGHT_TOPUP ? "topup" : "weight";
+}
+
+void recipePrint()
+{
+    for (int i = 0; i < RECIPE_COUNT; i++) {
+        const Recipe &r = table[i];
+        Serial.printf("[Recipe] %c%d %-11s %5.1fg  cup %5.1fg  offset %+.2fg  %4.1fs  %s  %s\n",
+                      &r == recipe ? '*' : ' ', i, r.name, r.dose, r.cup, r.offset, r.time,
+                      r.grindMode ? "continuous" : "impulse", stopModeName(r.stopMode));
+    }
+}
+
+String recipesJson()
+{
+    String json = "{\"active\":" + String(recipeIndex());
+    int pending = recipeRequested();
+    if (pending >= 0) {
+        json += ",\"requested\":" + String(pending);
+    }
+    json += ",\"recipes\":[";
+    char buf[192];
+    for (int i = 0; i < RECIPE_COUNT; i++) {
+        const Recipe &r = table[i];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"name\":\"%s\",\"dose\":%.1f,\"cup\":%.1f,\"offset\":%.2f,\"time\":%.1f,\"drive\":\"%s\",\"stop\":\"%s\"}",
+                 i ? "," : "", r.name, r.dose, r.cup, r.offset, r.time,
+                 r.grindMode ? "continuous" : "impulse", stopModeName(r.stopMode));
+        json += buf;
+    }
+    json += "]}";
+    return json;
+}
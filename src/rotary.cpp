@@ -5,6 +5,10 @@
 #include "rotary.hpp"
 #include "display.hpp"
 #include "scale.hpp"
+#include "calibration.hpp"
+#include "dose_stats.hpp"
+#include "recipe.hpp"
+#include "cups.hpp"
 
 // Rotary encoder for user input
 AiEsp32RotaryEncoder rotaryEncoder = AiEsp32RotaryEncoder(
@@ -71,11 +75,10 @@ void exitToMenu()
 
 // Handles button clicks on the rotary encoder
 
-// Task function to unlock display after taring
+// Task function to unlock display after a mode change message
 static void unlockDisplayTask(void *param) {
     delay(2000); // Wait 2 seconds
     displayLock = false;
-    showingTaringMessage = false;
     vTaskDelete(NULL);
 }
 
@@ -115,33 +118,21 @@ void rotary_onButtonClick()
             currentMenuItem = 0;
             currentSetting = -1;
             rotaryEncoder.setAcceleration(100); // Restore encoder acceleration
+            calibrationCancel();
             Serial.println("Exited menu due to tare operation");
         }
         
-        // Show taring message on display (non-blocking)
-        displayLock = true;
-        showTaringMessage();
-        
         // Perform the tare operation
         if (!tareScale()) {
-            Serial.println("Tare failed: HX711 not ready. Returning to menu.");
-            showErrorMessage("Tare failed\nHX711 not ready");
-            displayLock = false;
+            Serial.println("Tare failed: weight not stable. Returning to menu.");
+            showErrorMessage("Tare failed\nScale not stable");
             scaleStatus = STATUS_IN_MENU;
             return;
         }
-        
-        // Use a task to unlock the display after a delay instead of relying on rotary_loop
-        xTaskCreatePinnedToCore(
-            unlockDisplayTask,
-            "UnlockDisplayTask",
-            1000,
-            NULL,
-            1,
-            NULL,
-            1
-        );
-        
+
+        // The display task shows the tare progress until it completes or fails
+        taringMessageStartTime = millis();
+        showingTaringMessage = true;
         return;
     }
 
@@ -156,9 +147,9 @@ void rotary_onButtonClick()
             "SingleClickDelay",    // Task name
             1000,                  // Stack size
             &menuPending,          // Parameter (pointer to menuPending)
-            1,                     // Priority
+            UI_TASK_PRIORITY,      // Priority
             NULL,                  // Task handle (can be NULL)
-            1                      // Core ID
+            UI_TASK_CORE           // Core ID
         );
     }
 
@@ -188,22 +179,27 @@ void rotary_onButtonClick()
                 Serial.println("Exited Menu to main screen");
                 delay(200); // Debounce to prevent immediate re-trigger
                 break;
-            case 1: // Mode submenu
+            case 1: // Recipe Menu
+                scaleStatus = STATUS_IN_SUBMENU;
+                currentSetting = 10;
+                Serial.println("Recipe Menu");
+                break;
+            case 2: // Mode submenu
                 currentSubmenu = 1;
                 currentSubmenuItem = 0;
                 Serial.println("Entering Mode submenu");
                 break;
-            case 2: // Offset Menu
+            case 3: // Offset Menu
                 scaleStatus = STATUS_IN_SUBMENU;
                 currentSetting = 2;
                 Serial.println("Offset Menu");
                 break;
-            case 3: // Info Menu
+            case 4: // Info Menu
                 scaleStatus = STATUS_IN_SUBMENU;
                 currentSetting = 5;
                 Serial.println("Info Menu");
                 break;
-            case 4: // Configuration submenu
+            case 5: // Configuration submenu
                 currentSubmenu = 2;
                 currentSubmenuItem = 0;
                 Serial.println("Entering Configuration submenu");
@@ -226,9 +222,9 @@ void rotary_onButtonClick()
                     "ModeChangeDisplayTask",
                     1000,
                     NULL,
-                    1,
+                    UI_TASK_PRIORITY,
                     NULL,
-                    1
+                    UI_TASK_CORE
                 );
                 currentSubmenu = 0; // Return to main menu
                 currentMenuItem = 0;
@@ -246,9 +242,9 @@ void rotary_onButtonClick()
                     "ModeChangeDisplayTask",
                     1000,
                     NULL,
-                    1,
+                    UI_TASK_PRIORITY,
                     NULL,
-                    1
+                    UI_TASK_CORE
                 );
                 currentSubmenu = 0; // Return to main menu
                 currentMenuItem = 0;
@@ -269,19 +265,20 @@ void rotary_onButtonClick()
                 scaleStatus = STATUS_IN_SUBMENU;
                 currentSetting = 1;
                 if (!tareScale()) {
-                    Serial.println("Tare failed: HX711 not ready. Returning to menu.");
-                    showErrorMessage("Tare failed\nHX711 not ready");
+                    Serial.println("Tare failed: weight not stable. Returning to menu.");
+                    showErrorMessage("Tare failed\nScale not stable");
                     scaleStatus = STATUS_IN_MENU;
                     break;
                 }
+                calibrationBegin(); // The tare above is the zero point
                 Serial.println("Calibration Menu");
                 break;
             case 1: // Cup Weight Menu
                 scaleStatus = STATUS_IN_SUBMENU;
                 currentSetting = 0;
                 if (!tareScale()) {
-                    Serial.println("Tare failed: HX711 not ready. Returning to menu.");
-                    showErrorMessage("Tare failed\nHX711 not ready");
+                    Serial.println("Tare failed: weight not stable. Returning to menu.");
+                    showErrorMessage("Tare failed\nScale not stable");
                     scaleStatus = STATUS_IN_MENU;
                     break;
                 }
@@ -289,10 +286,8 @@ void rotary_onButtonClick()
 
                 if (scaleWeight > 0)
                 {
-                    setCupWeight = scaleWeight;
-                    preferences.begin("scale", false);
-                    preferences.putDouble("cup", setCupWeight);
-                    preferences.end();
+                    recipe->cup = scaleWeight;
+                    recipeChanged();
 
                     Serial.println("Cup weight set successfully");
                 }
@@ -316,12 +311,17 @@ void rotary_onButtonClick()
                 currentSetting = 8; // Use setting 8 for grind trigger
                 Serial.println("Grind Trigger Menu");
                 break;
-            case 5: // Reset Menu
+            case 5: // Stop Mode Menu
+                scaleStatus = STATUS_IN_SUBMENU;
+                currentSetting = 9;
+                Serial.println("Stop Mode Menu");
+                break;
+            case 6: // Reset Menu
                 scaleStatus = STATUS_IN_SUBMENU;
                 currentSetting = 6;
                 Serial.println("Reset Menu");
                 break;
-            case 6: // Back
+            case 7: // Back
                 currentSubmenu = 0; // Return to main menu
                 currentSubmenuItem = 0;
                 Serial.println("Returning to main menu from Configuration submenu");
@@ -338,15 +338,19 @@ void rotary_onButtonClick()
         {
             if (scaleWeight > 5)
             { // Ensure cup weight is valid
-                setCupWeight = scaleWeight;
-                Serial.println(setCupWeight);
-
-                preferences.begin("scale", false);
-                preferences.putDouble("cup", setCupWeight);
-                preferences.end();
+                if (!cupRegister(scaleWeight, recipeIndex()))
+                {
+                    Serial.println("Error: Cup list full");
+                    showErrorMessage("Cup list full");
+                    exitToMenu();
+                    break;
+                }
+                recipe->cup = scaleWeight;
+                Serial.println(recipe->cup);
+                recipeChanged();
 
                 displayLock = true;
-                showCupWeightSetScreen(setCupWeight); // Show confirmation
+                showCupWeightSetScreen(recipe->cup); // Show confirmation
                 displayLock = false;
 
                 exitToMenu();
@@ -354,10 +358,8 @@ void rotary_onButtonClick()
             else
             {
                 Serial.println("Error: Invalid cup weight detected. Setting default value.");
-                setCupWeight = 10.0; // Assign a reasonable default value
-                preferences.begin("scale", false);
-                preferences.putDouble("cup", setCupWeight);
-                preferences.end();
+                recipe->cup = 10.0; // Assign a reasonable default value
+                recipeChanged();
                 Serial.println("Failsafe: Exiting cup weight menu due to zero weight");
                 exitToMenu();
             }
@@ -365,40 +367,37 @@ void rotary_onButtonClick()
         }
         case 1: // Calibration Menu
         {
-            // Get the raw reading from the load cell (without scale factor applied)
-            loadcell.set_scale(1.0); // Temporarily set scale to 1 to get raw reading
-            delay(500); // Allow stabilization
-            double rawReading = loadcell.get_units(10); // Take 10 readings for accuracy
-            
-            // Calculate the correct calibration factor: rawReading / knownWeight
-            double newCalibrationValue = rawReading / 100.0; // 100g known weight
-            
-            // Basic validation - ensure we got a reasonable reading
-            if (abs(rawReading) < 1000 || abs(newCalibrationValue) < 100 || abs(newCalibrationValue) > 10000) {
-                Serial.printf("Error: Invalid calibration values (raw: %.2f, factor: %.2f). Using default.\n", 
-                             rawReading, newCalibrationValue);
-                newCalibrationValue = (double)LOADCELL_SCALE_FACTOR;
+            // The readings are taken by updateScale; clicks only drive the wizard.
+            // Click with a weight set: record it. Click at 0 g: fit and save. Click on the result: exit.
+            CalibrationStatus cal = calibrationStatus();
+            if (cal.state == CALIBRATION_DONE || cal.state == CALIBRATION_FAILED || cal.state == CALIBRATION_IDLE)
+            {
+                calibrationCancel();
+                scaleStatus = STATUS_IN_MENU;
+                currentSetting = -1;
+            }
+            else if (cal.state == CALIBRATION_READY && cal.weight > 0)
+            {
+                calibrationCapture();
+                Serial.printf("Calibration: capturing %.0fg\n", cal.weight);
+            }
+            else if (cal.state == CALIBRATION_READY && cal.points == 0)
+            {
+                Serial.println("Calibration cancelled, no weights recorded");
+                calibrationCancel();
+                scaleStatus = STATUS_IN_MENU;
+                currentSetting = -1;
+            }
+            else if (cal.state == CALIBRATION_READY && calibrationFinish())
+            {
+                CalibrationStatus result = calibrationStatus();
+                setCalibration(result.factor, result.curvature);
             }
-            
-            // Save and apply the new calibration
-            preferences.begin("scale", false);
-            preferences.putDouble("calibration", newCalibrationValue);
-            preferences.end();
-            
-            loadcell.set_scale(newCalibrationValue);
-            
-            Serial.printf("Calibration completed: Raw reading = %.2f, New scale factor = %.2f\n", 
-                         rawReading, newCalibrationValue);
-            
-            scaleStatus = STATUS_IN_MENU;
-            currentSetting = -1;
             break;
         }
         case 2: // Offset Menu
         {
-            preferences.begin("scale", false);
-            preferences.putDouble("offset", offset);
-            preferences.end();
+            recipeChanged();
             scaleStatus = STATUS_IN_MENU;
             currentSetting = -1;
             break;
@@ -414,9 +413,7 @@ void rotary_onButtonClick()
         }
         case 4: // Grinding Mode Menu
         {
-            preferences.begin("scale", false);
-            preferences.putBool("grindMode", grindMode);
-            preferences.end();
+            recipeChanged();
             scaleStatus = STATUS_IN_MENU;
             currentSetting = -1;
             break;
@@ -435,25 +432,26 @@ void rotary_onButtonClick()
             if (greset)
             {
                 preferences.begin("scale", false);
-                preferences.putDouble("calibration", (double)LOADCELL_SCALE_FACTOR);
-                setWeight = (double)COFFEE_DOSE_WEIGHT;
-                preferences.putDouble("setWeight", (double)COFFEE_DOSE_WEIGHT);
-                offset = (double)COFFEE_DOSE_OFFSET;
-                preferences.putDouble("offset", (double)COFFEE_DOSE_OFFSET);
-                setCupWeight = (double)CUP_WEIGHT;
-                preferences.putDouble("cup", (double)CUP_WEIGHT);
                 scaleMode = false;
                 preferences.putBool("scaleMode", false);
-                grindMode = false;
-                preferences.putBool("grindMode", false);
                 preferences.putUInt("shotCount", 0);
-                loadcell.set_scale((double)LOADCELL_SCALE_FACTOR);
                 preferences.end();
+                recipeReset();
+                cupsReset();
+                setCalibration((double)LOADCELL_SCALE_FACTOR, 0);
+                doseStatsReset();
             }
             scaleStatus = STATUS_IN_MENU;
             currentSetting = -1;
             break;
         }
+        case 9: // Stop Mode Menu
+        {
+            recipeChanged();
+            scaleStatus = STATUS_IN_MENU;
+            currentSetting = -1;
+            break;
+        }
         case 8: // Grind Trigger Menu
         {
             // Save the current selection and exit
@@ -466,6 +464,14 @@ void rotary_onButtonClick()
             currentSetting = -1;
             break;
         }
+        case 10: // Recipe Menu
+        {
+            // The recipe was already switched while turning; nothing to save
+            Serial.printf("Recipe: %s\n", recipe->name);
+            scaleStatus = STATUS_IN_MENU;
+            currentSetting = -1;
+            break;
+        }
         }
     }
 }
@@ -513,9 +519,9 @@ void rotary_loop()
                 "ModeChangeDisplayTask",
                 1000,
                 NULL,
-                1,
+                UI_TASK_PRIORITY,
                 NULL,
-                1
+                UI_TASK_CORE
             );
         }
     } else {
@@ -544,10 +550,27 @@ void rotary_loop()
                 screenJustWoke = false; // Reset the flag
                 break;
             }
+            if (recipe->stopMode == STOP_TIME && !scaleMode)
+            {
+                // Timed grinding: each detent = 0.1s
+                int newValue = rotaryEncoder.readEncoder();
+                int encoderDelta = newValue - encoderValue;
+                if (encoderDelta != 0) {
+                    recipe->time += (float)encoderDelta * 0.1 * encoderDir;
+                    if (recipe->time < 0) recipe->time = 0;
+                    recipe->time = round(recipe->time * 10.0) / 10.0;
+                    encoderValue = newValue;
+                    recipeChanged();
+                    Serial.print("Time: ");
+                    Serial.print(recipe->time, 1);
+                    Serial.println("s");
+                }
+                break;
+            }
             // Adjust weight when in scale mode
-            if (setWeight < 0)
+            if (recipe->dose < 0)
             {
-                setWeight = 0;
+                recipe->dose = 0;
                 Serial.println("Grind weight cannot be less than 0. Reset to 0.");
             }
             int newValue = rotaryEncoder.readEncoder();
@@ -558,19 +581,17 @@ void rotary_loop()
                 // If 6 detents was giving 0.1g, then each detent was 0.0167g
                 // To make each detent = 0.1g, multiply by 6
                 float increment = (float)encoderDelta * 0.1 * encoderDir;
-                setWeight += increment;
-                if (setWeight < 0) setWeight = 0; // Prevent negative values
+                recipe->dose += increment;
+                if (recipe->dose < 0) recipe->dose = 0; // Prevent negative values
                 
                 // Round to nearest 0.1g for display consistency
-                setWeight = round(setWeight * 10.0) / 10.0;
+                recipe->dose = round(recipe->dose * 10.0) / 10.0;
                 
                 encoderValue = newValue;
-                preferences.begin("scale", false);
-                preferences.putDouble("setWeight", setWeight);
-                preferences.end();
+                recipeChanged();
                 
                 Serial.print("Weight: ");
-                Serial.print(setWeight, 1);
+                Serial.print(recipe->dose, 1);
                 Serial.print("g (delta: ");
                 Serial.print(encoderDelta);
                 Serial.print(", increment: ");
@@ -619,19 +640,24 @@ void rotary_loop()
             int newValue = rotaryEncoder.readEncoder();
             int encoderDelta = newValue - encoderValue;
             
-            if (currentSetting == 2 && encoderDelta != 0)
+            if (currentSetting == 1 && encoderDelta != 0)
+            { // Calibration menu - known weight, CALIBRATION_WEIGHT_STEP per detent
+                calibrationAdjustWeight((double)encoderDelta * CALIBRATION_WEIGHT_STEP * encoderDir);
+                encoderValue = newValue;
+            }
+            else if (currentSetting == 2 && encoderDelta != 0)
             { // Offset menu - make each detent = 0.01g
-                offset += (float)encoderDelta * 0.01 * encoderDir;
+                recipe->offset += (float)encoderDelta * 0.01 * encoderDir;
                 encoderValue = newValue;
-                if (abs(offset) >= setWeight)
+                if (abs(recipe->offset) >= recipe->dose)
                 {
-                    offset = setWeight; // Prevent nonsensical offsets
+                    recipe->offset = recipe->dose; // Prevent nonsensical offsets
                 }
                 // Round to nearest 0.01g
-                offset = round(offset * 100.0) / 100.0;
+                recipe->offset = round(recipe->offset * 100.0) / 100.0;
                 
                 Serial.print("Offset: ");
-                Serial.print(offset, 2);
+                Serial.print(recipe->offset, 2);
                 Serial.print("g (delta: ");
                 Serial.print(encoderDelta);
                 Serial.println(")");
@@ -642,7 +668,7 @@ void rotary_loop()
             }
             else if (currentSetting == 4)
             {
-                grindMode = !grindMode;
+                recipe->grindMode = !recipe->grindMode;
             }
             else if (currentSetting == 6)
             {
@@ -652,6 +678,16 @@ void rotary_loop()
             {
                 useButtonToGrind = !useButtonToGrind;
             }
+            else if (currentSetting == 9 && encoderDelta != 0) // Stop Mode Menu - cycles the three strategies
+            {
+                recipe->stopMode = (recipe->stopMode + (encoderDelta * encoderDir > 0 ? 1 : 2)) % 3;
+                encoderValue = newValue;
+            }
+            else if (currentSetting == 10 && encoderDelta != 0) // Recipe Menu - switches as it turns
+            {
+                recipeSelect((recipeIndex() + (encoderDelta * encoderDir > 0 ? 1 : RECIPE_COUNT - 1)) % RECIPE_COUNT);
+                encoderValue = newValue;
+            }
             break;
         }
         case STATUS_GRINDING_FAILED:
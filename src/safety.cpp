@@ -0,0 +1,91 @@
+#include <Arduino.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "actuator.hpp"
+#include "safety.hpp"
+
+static volatile uint32_t heartbeats[SAFETY_TASKS]; // millis() of each task's last report
+static volatile int trip = SAFETY_OK;
+static hw_timer_t *safetyTimer = nullptr;
+
+static void IRAM_ATTR onSafetyTimer()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t on = actuatorOnTimeFromISR(now);
+    if (on == 0) {
+        return;
+    }
+    uint32_t nowMs = (uint32_t)(now / 1000);
+    int reason = SAFETY_OK;
+    if (on > (int64_t)SAFETY_MAX_ON_MS * 1000) {
+        reason = SAFETY_TRIP_ON_TIME;
+    } else if (nowMs - heartbeats[SAFETY_ACQUISITION] > SAFETY_HEARTBEAT_MS) {
+        reason = SAFETY_TRIP_ACQUISITION;
+    } else if (nowMs - heartbeats[SAFETY_CONTROL] > SAFETY_HEARTBEAT_MS) {
+        reason = SAFETY_TRIP_CONTROL;
+    }
+    if (reason != SAFETY_OK) {
+        actuatorFailSafeFromISR();
+        trip = reason;
+    }
+}
+
+// Call after setupActuator and before the supervised tasks are created
+void setupSafety()
+{
+    esp_task_wdt_init(SAFETY_WDT_TIMEOUT_S, true); // Panic and reboot; the relay pin resets to off
+    for (int i = 0; i < SAFETY_TASKS; i++) {
+        heartbeats[i] = millis();
+    }
+    safetyTimer = timerBegin(SAFETY_TIMER, 80, true); // 1 µs ticks from the 80 MHz APB clock
+    timerAttachInterrupt(safetyTimer, &onSafetyTimer, true);
+    timerAlarmWrite(safetyTimer, SAFETY_CHECK_US, true);
+    timerAlarmEnable(safetyTimer);
+}
+
+// Puts the calling task under the task watchdog; it then has to call safetyFeed() every pass
+void safetyWatchTask()
+{
+    esp_task_wdt_add(NULL);
+}
+
+void safetyFeed()
+{
+    esp_task_wdt_reset();
+}
+
+// Tells the supervisor the task is making progress. The acquisition task reports only
+// delivered conversions, so a stalled HX711 counts as silent.
+void safetyHeartbeat(int task)
+{
+    heartbeats[task] = millis();
+}
+
+// The reason of an unacknowledged stop, SAFETY_OK if there is none
+int safetyTrip()
+{
+    return trip;
+}
+
+// Acknowledges a stop and allows the grinder to start again
+void safetyClear()
+{
+    trip = SAFETY_OK;
+    actuatorUnlock();
+}
+
+const char *safetyTripName(int reason)
+{
+    switch (reason)
+    {
+    case SAFETY_TRIP_ON_TIME:
+        return "on-time limit";
+    case SAFETY_TRIP_ACQUISITION:
+        return "no samples from the load cell";
+    case SAFETY_TRIP_CONTROL:
+        return "control task stalled";
+    }
+    return "none";
+}
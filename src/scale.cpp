@@ -2,6 +2,25 @@
 #include "rotary.hpp"
 #include "scale.hpp"
 #include "display.hpp"
+#include "mqtt.hpp"
+#include "probe.hpp"
+#include "filter.hpp"
+#include "stability.hpp"
+#include "auto_zero.hpp"
+#include "calibration.hpp"
+#include "shot_log.hpp"
+#include "dose_stats.hpp"
+#include "actuator.hpp"
+#include "recipe.hpp"
+#include "cups.hpp"
+#include "safety.hpp"
+
+#include <type_traits>
+
+// The acquisition heartbeat comes with every conversion, so a healthy HX711 that misses one
+// conversion is still far from tripping the safety supervisor
+static_assert(HX711_READY_TIMEOUT_MS + HX711_CONVERSION_MS <= SAFETY_HEARTBEAT_MS / 2,
+              "HX711 conversion period too long for SAFETY_HEARTBEAT_MS");
 
 // Variables for scale functionality
 // HX711 operation flags
@@ -9,17 +28,26 @@ volatile bool requestTare = false;
 volatile bool requestSetOffset = false;
 volatile bool requestCalibration = false;
 double scaleWeight = 0;       // Current weight measured by the scale
-double setWeight = 0;         // Target weight set by the user
-double setCupWeight = 0;      // Weight of the cup set by the user
-double offset = 0;            // Offset for stopping grinding prior to reaching set weight
 bool scaleMode = false;       // Indicates if the scale is used in timer mode
-bool grindMode = false;       // Grinder mode: impulse (false) or continuous (true)
-bool grinderActive = false;   // Grinder state (on/off)
 unsigned int shotCount;
 
 // Buffer for storing recent weight history
 MathBuffer<double, 100> weightHistory;
 
+// Filter stages selected in config.hpp; a disabled stage is a PassStage and costs nothing
+using ScaleFilter = FilterPipeline<
+    std::conditional_t<(FILTER_MEDIAN_WINDOW > 1), MedianStage<(FILTER_MEDIAN_WINDOW > 1 ? FILTER_MEDIAN_WINDOW : 1)>, PassStage>,
+    std::conditional_t<(FILTER_STEP_THRESHOLD > 0), StepStage, PassStage>,
+    AdaptiveKalmanStage>;
+static ScaleFilter scaleFilter({}, {FILTER_STEP_THRESHOLD, FILTER_STEP_CONFIRM},
+                               {FILTER_MEASUREMENT_NOISE, FILTER_PROCESS_NOISE, FILTER_FLOW_NOISE});
+static volatile bool sampleTrace = false; // Print every raw sample for filter_bench
+
+// Evaluated by updateScale after every sample; read through scaleStability()
+static StabilityDetector stabilityDetector(STABLE_WINDOW, STABLE_MAX_STDDEV, STABLE_MAX_SLOPE, STABLE_MIN_SAMPLES);
+static WeightStability stability = {};
+static portMUX_TYPE stabilityMux = portMUX_INITIALIZER_UNLOCKED;
+
 // Timing and status variables
 unsigned long scaleLastUpdatedAt = 0;  // Timestamp of the last scale update
 unsigned long lastSignificantWeightChangeAt = 0; // Timestamp of the last significant weight change
@@ -29,6 +57,13 @@ int scaleStatus = STATUS_EMPTY; // Current status of the scale
 double cupWeightEmpty = 0;    // Measured weight of the empty cup
 unsigned long startedGrindingAt = 0;  // Timestamp of when grinding started
 unsigned long finishedGrindingAt = 0; // Timestamp of when grinding finished
+static volatile double cutoffWeight = 0; // Weight when the relay was cut, to measure the overshoot
+static int topUpPulses = 0;     // Top-up bursts fired for the current shot
+static double firstSettledWeight = 0; // Settled weight before any top-up; the offset learns from it
+// Grinder stop handshake: another task takes a ticket, the control task stops the grinder and
+// answers with the same ticket
+static volatile uint32_t stopRequested = 0;
+static volatile uint32_t stopDone = 0;
 bool greset = false;          // Flag for reset operation
 bool newOffset = false;       // Indicates if a new offset value is pending
 
@@ -41,87 +76,294 @@ unsigned long taringMessageStartTime = 0;
 // Manual grinding mode - grinder controlled directly by button
 bool manualGrindMode = false;
 
-double scaleFactor = 1409.88; // Standard scale factor, can be updated by calibration
+// Tare offset and calibration, written by the tare and the calibration menu and read by
+// updateScale for every sample; each side works on a copy taken under the lock
+static CalibrationModel scaleModel((double)LOADCELL_SCALE_FACTOR);
+static portMUX_TYPE modelMux = portMUX_INITIALIZER_UNLOCKED;
+
+static CalibrationModel currentModel() {
+    portENTER_CRITICAL(&modelMux);
+    CalibrationModel copy = scaleModel;
+    portEXIT_CRITICAL(&modelMux);
+    return copy;
+}
+
+// Applies and stores a calibration result; the tare offset is kept
+void setCalibration(double factor, double curvature) {
+    portENTER_CRITICAL(&modelMux);
+    scaleModel.setCalibration(factor, curvature);
+    portEXIT_CRITICAL(&modelMux);
+    preferences.begin("scale", false);
+    preferences.putDouble("calibration", factor);
+    preferences.putDouble("calCurve", curvature);
+    preferences.end();
+}
+
+WeightStability scaleStability()
+{
+    portENTER_CRITICAL(&stabilityMux);
+    WeightStability copy = stability;
+    portEXIT_CRITICAL(&stabilityMux);
+    return copy;
+}
+
+// A tare on a moving platform would bake the movement into the zero point
+static bool platformMoving()
+{
+    return scaleReady && !scaleStability().stable;
+}
 
 bool tareScale()
 {
+    if (platformMoving()) {
+        Serial.println("Tare refused: weight not stable");
+        return false;
+    }
     // Set tare request flag, actual tare will be performed in updateScale
     requestTare = true;
     // Do not perform HX711 operations here
     return true;
 }
 
+// Averages up to `times` HX711 conversions, sleeping while each one is pending.
+// HX711::read_average() and wait_ready_timeout() with its default delay(0) both spin between
+// conversions, which at acquisition priority starves the control task. Each conversion is
+// reported to the safety supervisor, as an average spans several conversion periods.
+// Returns false if not a single conversion arrived in time.
+static bool readAverage(int times, long &average) {
+    long sum = 0;
+    int count = 0;
+    while (count < times && loadcell.wait_ready_timeout(HX711_READY_TIMEOUT_MS, HX711_POLL_INTERVAL)) {
+        sum += loadcell.read();
+        safetyHeartbeat(SAFETY_ACQUISITION);
+        count++;
+    }
+    if (count == 0) {
+        return false;
+    }
+    average = sum / count;
+    return true;
+}
+
+// Tare state machine, driven by updateScale: a request restarts it, every ready sample adds
+// to it and it finishes by itself after TARE_MEASURES samples, so sampling never pauses
+static volatile uint8_t tareState = TARE_IDLE;
+static volatile uint8_t tareSamples = 0;
+static volatile unsigned long tareFinishedAt = 0;
+static long tareSum = 0;
+static long tareLowest = 0;
+static long tareHighest = 0;
+static int tareMisses = 0;
+
+TareProgress tareProgress() {
+    TareProgress progress;
+    progress.state = tareState;
+    progress.samples = tareSamples;
+    progress.finishedAt = tareFinishedAt;
+    return progress;
+}
+
+static void finishTare(uint8_t state) {
+    tareFinishedAt = millis();
+    tareState = state;
+}
+
+static void beginTare() {
+    tareSum = 0;
+    tareMisses = 0;
+    tareSamples = 0;
+    tareState = TARE_RUNNING;
+    Serial.println("[Tare] Started");
+}
+
+static void tareMissed() {
+    if (++tareMisses >= TARE_MAX_MISSES) {
+        Serial.println("[Tare] Failed: HX711 not ready");
+        finishTare(TARE_FAILED);
+    }
+}
+
+static void feedTare(long raw) {
+    if (tareSamples == 0 || raw < tareLowest) {
+        tareLowest = raw;
+    }
+    if (tareSamples == 0 || raw > tareHighest) {
+        tareHighest = raw;
+    }
+    tareSum += raw;
+    tareMisses = 0;
+    uint8_t samples = tareSamples + 1;
+    tareSamples = samples; // one store, read by the display through tareProgress()
+    if (samples < TARE_MEASURES) {
+        return;
+    }
+
+    CalibrationModel model = currentModel();
+    double spreadGrams = ABS(model.countsToGrams(tareHighest - tareLowest));
+    if (spreadGrams > TARE_MAX_SPREAD) {
+        // Something was put on or taken off while averaging
+        Serial.printf("[Tare] Failed: readings spread %.2f g\n", spreadGrams);
+        finishTare(TARE_FAILED);
+        return;
+    }
+    portENTER_CRITICAL(&modelMux);
+    scaleModel.setOffset(tareSum / tareSamples);
+    portEXIT_CRITICAL(&modelMux);
+    lastTareAt = millis();
+    scaleFilter.reset(0);
+    autoZeroReset();
+    Serial.println("[Tare] Done");
+    finishTare(TARE_DONE);
+}
+
+// Sleeps until one period after the previous wake-up. After an overrun (tare, averaged
+// reads, HX711 timeouts) the schedule restarts from now instead of catching up back to back.
+static void waitNextSample(TickType_t &lastWake, TickType_t period) {
+    if (xTaskGetTickCount() - lastWake >= period) {
+        lastWake = xTaskGetTickCount();
+        PROBE_MARK(PROBE_SAMPLE_JITTER);
+        return;
+    }
+    vTaskDelayUntil(&lastWake, period);
+    // Sample timing only matters while grinding; elsewhere just keep the reference current
+    if (scaleStatus == STATUS_GRINDING_IN_PROGRESS) {
+        PROBE_JITTER(PROBE_SAMPLE_JITTER, SCALE_SAMPLE_INTERVAL * 1000);
+    } else {
+        PROBE_MARK(PROBE_SAMPLE_JITTER);
+    }
+}
+
+// Total weight at which a weight-targeted grind stops
+static double grindTarget() {
+    double currentOffset = scaleMode ? 0 : recipe->offset;
+    if (useButtonToGrind && !manualGrindMode) {
+        // Button-activated automatic grinding: ignore cup weight
+        return recipe->dose + currentOffset;
+    }
+    // Other modes: include cup weight
+    return cupWeightEmpty + recipe->dose + currentOffset;
+}
+
+// Called with every sample while grinding by weight: predicts when the weight reaches the
+// target from the filter's flow rate and hands that moment to the actuator's timer, so the
+// relay drops on time instead of on the next pass of scaleStatusLoop. Each sample refines it.
+static void armCutoff(double weight, double flow) {
+    static bool armed = false;
+    if (scaleStatus != STATUS_GRINDING_IN_PROGRESS || recipe->stopMode == STOP_TIME || startedGrindingAt == 0) {
+        armed = false;
+        return;
+    }
+    double target = grindTarget();
+    double remaining = target - weight;
+    if (remaining <= 0) {
+        if (actuatorRunning()) {
+            actuatorStop();
+            cutoffWeight = weight;
+        }
+        return;
+    }
+    // Once armed, every sample moves the deadline; a stalled HX711 lets the armed stop
+    // fire within CUTOFF_MAX_DELAY_US even if the flow seemed to stop
+    double us = flow >= CUTOFF_MIN_FLOW ? remaining / flow * 1000000 : CUTOFF_MAX_DELAY_US;
+    if (us <= CUTOFF_HORIZON_US || armed) {
+        armed = actuatorStopIn(us < CUTOFF_MAX_DELAY_US ? (uint32_t)us : CUTOFF_MAX_DELAY_US);
+        cutoffWeight = target;
+    }
+}
+
+// Where the weight crossed the target, interpolated between the samples around it, against
+// the relay-off edge. Positive means the relay dropped after the crossing.
+static void logCutoffError(double target) {
+    ActuatorStop cut = actuatorLastStop();
+    double crossedAt = -1, newerValue = 0;
+    int64_t newerMs = -1;
+    // Newest sample first; the last pair found is the first crossing
+    weightHistory.executeOnSamplesSince((int64_t)finishedGrindingAt - 2000, [&](double value, int64_t ms) {
+        if (newerMs >= 0 && value < target && newerValue >= target) {
+            crossedAt = ms + (target - value) / (newerValue - value) * (newerMs - ms);
+        }
+        newerValue = value;
+        newerMs = ms;
+    });
+    if (crossedAt < 0) {
+        Serial.printf("[Cutoff] relay off %lld us after the deadline, target %.2fg not reached\n",
+                      (long long)(cut.at - cut.deadline), target);
+        return;
+    }
+    double errorMs = cut.at / 1000.0 - crossedAt;
+    PROBE_US(PROBE_CUTOFF_ERROR, ABS(errorMs) * 1000);
+    Serial.printf("[Cutoff] relay off %lld us after the deadline, %+.0f ms from the target crossing\n",
+                  (long long)(cut.at - cut.deadline), errorMs);
+}
+
 // Task to continuously update the scale readings
 void updateScale(void *parameter) {
     float lastEstimate;
-    const TickType_t xDelay = 100 / portTICK_PERIOD_MS; // 10Hz = 100ms interval
+    const TickType_t xDelay = SCALE_SAMPLE_INTERVAL / portTICK_PERIOD_MS;
+    TickType_t lastWake = xTaskGetTickCount();
     int hx711_fail_count = 0;
+    safetyWatchTask();
     for (;;) {
         vTaskDelay(1); // Minimal delay to mitigate timing/race condition
-        // Request tare on startup if needed
-        if (lastTareAt == 0) {
+        safetyFeed();
+        // Request tare on startup if needed, until one succeeds
+        if (lastTareAt == 0 && tareState != TARE_RUNNING) {
             requestTare = true;
         }
-        // Serialize HX711 access: handle tare request first
         if (requestTare) {
-            Serial.println("Taring scale (serialized in updateScale)...");
-            bool tareSuccess = false;
-            for (int attempt = 1; attempt <= 3; ++attempt) {
-                Serial.printf("[tareScale] Attempt %d: Waiting for HX711 ready...\n", attempt);
-                unsigned long t0 = millis();
-                bool ready = loadcell.wait_ready_timeout(1000);
-                Serial.printf("[tareScale] wait_ready_timeout returned %s after %lu ms\n", ready ? "true" : "false", millis() - t0);
-                if (ready) {
-                    Serial.println("[tareScale] HX711 ready, reading average...");
-                    t0 = millis();
-                    long offset = loadcell.read_average(10); // Average 10 readings for stability
-                    Serial.printf("[tareScale] read_average finished after %lu ms\n", millis() - t0);
-                    loadcell.set_offset(offset);
-                    lastTareAt = millis();
-                    scaleWeight = 0;
-                    kalmanFilter = SimpleKalmanFilter(0.02, 0.02, 0.01);
-                    Serial.println("Scale tared successfully");
-                    tareSuccess = true;
-                    break;
-                } else {
-                    Serial.print("Tare attempt ");
-                    Serial.print(attempt);
-                    Serial.println(": HX711 not ready, retrying...");
-                    Serial.println("[tareScale] Delaying for 200ms...");
-                    unsigned long d0 = millis();
-                    delay(200);
-                    Serial.printf("[tareScale] Delay finished after %lu ms\n", millis() - d0);
-                }
-            }
             requestTare = false;
-            // If tare failed, skip regular sampling this cycle
-            if (!tareSuccess) {
-                vTaskDelay(xDelay);
-                continue;
-            }
+            beginTare();
         }
         // Regular HX711 sampling
         unsigned long t0 = millis();
-        bool ready = loadcell.wait_ready_timeout(300);
+        PROBE_START(waitStart);
+        bool ready = loadcell.wait_ready_timeout(HX711_READY_TIMEOUT_MS, HX711_POLL_INTERVAL);
+        PROBE_STOP(PROBE_HX711_WAIT, waitStart);
         if (ready) {
             hx711_fail_count = 0;
-            if (scaleStatus == STATUS_GRINDING_IN_PROGRESS) {
-                long raw = loadcell.read();
-                double grams = (double)(raw - loadcell.get_offset()) / scaleFactor;
-                scaleWeight = kalmanFilter.updateEstimate(grams);
+            // Single conversions while the relay is on, grinding or taring, averaged ones otherwise
+            PROBE_START(readStart);
+            long raw;
+            if (scaleStatus == STATUS_GRINDING_IN_PROGRESS || tareState == TARE_RUNNING || actuatorRunning()) {
+                raw = loadcell.read();
+                safetyHeartbeat(SAFETY_ACQUISITION);
             } else {
-                long raw = loadcell.read_average(5);
-                double grams = (double)(raw - loadcell.get_offset()) / scaleFactor;
-                scaleWeight = kalmanFilter.updateEstimate(grams);
+                readAverage(5, raw); // Cannot fail, the first conversion is already ready
             }
-            if (ABS(scaleWeight) < 3) {
-                scaleWeight = 0;
+            PROBE_STOP(PROBE_HX711_READ, readStart);
+            if (tareState == TARE_RUNNING) {
+                feedTare(raw); // A finished tare already applies to this sample
+            }
+            PROBE_START(filterStart);
+            CalibrationModel model = currentModel();
+            long counts = model.counts(raw);
+            double grams = model.grams(raw) - autoZeroDrift();
+            unsigned long now = millis();
+            double dt = scaleLastUpdatedAt ? (now - scaleLastUpdatedAt) / 1000.0 : 0;
+            scaleWeight = scaleFilter.update(grams, dt);
+            PROBE_STOP(PROBE_FILTER, filterStart);
+            if (sampleTrace) {
+                Serial.printf("T,%lu,%.3f\n", now, grams);
             }
-            scaleLastUpdatedAt = millis();
+            scaleLastUpdatedAt = now;
+            armCutoff(scaleWeight, scaleFilter.flowRate());
             weightHistory.push(scaleWeight);
+            const WeightStability &evaluated = stabilityDetector.update(weightHistory, now);
+            portENTER_CRITICAL(&stabilityMux);
+            stability = evaluated;
+            portEXIT_CRITICAL(&stabilityMux);
+            // Track the zero only on an empty, idle scale, well clear of the last grind
+            bool idle = scaleStatus == STATUS_EMPTY && !actuatorRunning() &&
+                        (finishedGrindingAt == 0 || now - finishedGrindingAt > TARE_MIN_INTERVAL);
+            autoZeroUpdate(evaluated, idle, now);
+            calibrationFeed(counts, evaluated.stable);
             scaleReady = true;
+            mqttPublishWeight(scaleWeight);
         } else {
             hx711_fail_count++;
+            if (tareState == TARE_RUNNING) {
+                tareMissed();
+            }
             Serial.println("HX711 not found.");
             scaleReady = false;
             if (scaleStatus != STATUS_GRINDING_IN_PROGRESS && hx711_fail_count >= 5) {
@@ -130,44 +372,132 @@ void updateScale(void *parameter) {
                 hx711_fail_count = 0;
             }
         }
-        vTaskDelay(xDelay); // Wait 100ms before next read (10Hz)
+        waitNextSample(lastWake, xDelay);
     }
 }
 
-// Toggles the grinder on or off based on mode
-void grinderToggle() {
-    Serial.println("[grinderToggle] called");
-    // Toggle grinder/LED output
-    if (!grinderActive) {
-        Serial.println("[grinderToggle] BEFORE digitalWrite ON");
-        digitalWrite(GRINDER_ACTIVE_PIN, LOW); // Relay/LED ON
-        delay(1); // Minimal delay after toggling ON
-        Serial.println("[grinderToggle] AFTER digitalWrite ON");
-        grinderActive = true;
-        Serial.println("Grinder/LED ON");
+// Starts or stops printing raw samples as "T,<ms>,<grams>" lines; returns the new state
+bool toggleSampleTrace() {
+    sampleTrace = !sampleTrace;
+    return sampleTrace;
+}
+
+// Starts the grinder for a new shot with the active stop strategy
+static void startGrinding() {
+    topUpPulses = 0;
+    if (recipe->stopMode == STOP_TIME && !scaleMode) {
+        actuatorRun((uint32_t)(recipe->time * 1000000));
     } else {
-        Serial.println("[grinderToggle] BEFORE digitalWrite OFF");
-        digitalWrite(GRINDER_ACTIVE_PIN, HIGH); // Relay/LED OFF
-        delay(1); // Minimal delay after toggling OFF
-        Serial.println("[grinderToggle] AFTER digitalWrite OFF");
-        grinderActive = false;
-        Serial.println("Grinder/LED OFF");
+        actuatorStart();
+    }
+    Serial.println("Grinder/LED ON");
+}
+
+// Length of a top-up burst for the missing grams at the flow rate of the main grind
+static uint32_t topUpPulseUs(double deficit) {
+    double grams = cutoffWeight - cupWeightEmpty;
+    double seconds = (finishedGrindingAt - startedGrindingAt) / 1000.0;
+    if (grams <= 0 || seconds <= 0) {
+        return 0;
+    }
+    double us = deficit / (grams / seconds) * 1000000;
+    if (us < TOPUP_MIN_PULSE_US) {
+        us = TOPUP_MIN_PULSE_US;
+    } else if (us > TOPUP_MAX_PULSE_US) {
+        us = TOPUP_MAX_PULSE_US;
+    }
+    return (uint32_t)us;
+}
+
+// Weight the dose is measured from: button-triggered grinding ignores the cup weight
+static double doseBaseline() {
+    return (useButtonToGrind && !manualGrindMode) ? 0 : cupWeightEmpty;
+}
+
+// Publishes a finished or aborted shot and appends it to the shot log
+static void reportShot(double actual, unsigned long grindTimeMs, int result) {
+    mqttPublishShot(recipe->dose, actual, grindTimeMs, recipe->offset, result);
+    shotLogRecord(recipe->dose, actual, grindTimeMs, recipe->offset, useButtonToGrind ? SHOT_TRIGGER_BUTTON : SHOT_TRIGGER_CUP, result);
+}
+
+// Stops the grinder, enters the failed state and reports the aborted shot
+static void failGrinding(int result) {
+    actuatorStop();
+    scaleStatus = STATUS_GRINDING_FAILED;
+    reportShot(scaleWeight - doseBaseline(), startedGrindingAt > 0 ? millis() - startedGrindingAt : 0, result);
+}
+
+// Forces the relay off, also in manual grind mode. A running shot is reported as aborted.
+static void stopGrinder() {
+    actuatorStop();
+    if (scaleStatus == STATUS_GRINDING_IN_PROGRESS) {
+        scaleStatus = STATUS_GRINDING_FAILED;
+        reportShot(scaleWeight - doseBaseline(), startedGrindingAt > 0 ? millis() - startedGrindingAt : 0,
+                   GRIND_RESULT_ABORTED);
     }
+    Serial.println("Grinder stopped");
+}
+
+// Asks the control task to stop the grinder and wakes it, without waiting. Only valid while
+// otaInProgress holds the control task in its idle branch. Returns the ticket to pass to
+// grinderStopped().
+uint32_t requestGrinderStop() {
+    uint32_t ticket = stopRequested + 1;
+    stopRequested = ticket;
+    if (ScaleStatusTask != nullptr) {
+        xTaskNotifyGive(ScaleStatusTask);
+    }
+    return ticket;
+}
+
+// Whether the control task has carried out the stop requestGrinderStop() returned the ticket for
+bool grinderStopped(uint32_t ticket) {
+    return stopDone == ticket;
 }
 
 // Task to manage the status of the scale
 void scaleStatusLoop(void *p) {
+    safetyWatchTask();
+    int previousStatus = STATUS_EMPTY;
     for (;;) {
-        // Monitor heap and stack usage (deactivated)
-        // Serial.printf("[Heap] Free: %u | [Stack] High Water Mark: %u\n", ESP.getFreeHeap(), uxTaskGetStackHighWaterMark(NULL));
         vTaskDelay(1); // Minimal delay to mitigate timing/race condition
+        safetyFeed();
+        safetyHeartbeat(SAFETY_CONTROL);
+        int trip = safetyTrip();
+        if (trip != SAFETY_OK) {
+            // The supervisor already cut the relay; fail the shot before anything can restart it
+            Serial.printf("[Safety] Grinder stopped: %s\n", safetyTripName(trip));
+            if (scaleStatus == STATUS_GRINDING_IN_PROGRESS || scaleStatus == STATUS_GRINDING_FINISHED) {
+                failGrinding(GRIND_RESULT_SAFETY);
+            }
+            safetyClear();
+        }
+        if (otaInProgress) {
+            // Firmware update running: relay stays off and no shot may start. A stop asked for
+            // by the update is carried out here, where the shot state belongs.
+            uint32_t ticket = stopRequested;
+            if (stopDone != ticket) {
+                stopGrinder();
+                stopDone = ticket;
+            }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+            continue;
+        }
+        recipeFlush();
+        // A recognised cup is forgotten once a shot or a menu takes the scale out of STATUS_EMPTY
+        if (previousStatus == STATUS_EMPTY && scaleStatus != STATUS_EMPTY) {
+            cupForget();
+        }
+        previousStatus = scaleStatus;
+        PROBE_SCOPE(decisionProbe, PROBE_DECISION);
         double tenSecAvg = weightHistory.averageSince((int64_t)millis() - 10000);
         if (ABS(tenSecAvg - scaleWeight) > SIGNIFICANT_WEIGHT_CHANGE) {
             lastSignificantWeightChangeAt = millis();
         }
         switch (scaleStatus) {
             case STATUS_EMPTY: {
-                // Auto-tare is disabled except for startup (handled in updateScale)
+                recipeApplyRequest(); // selections made over the API or the console
+                // Auto-tare is disabled except for startup (handled in updateScale); slow drift is tracked by auto_zero
                 static bool grinderButtonPressed = false;
                 static unsigned long grinderButtonPressedAt = 0;
                 static bool manualGrinderActive = false;
@@ -178,33 +508,27 @@ void scaleStatusLoop(void *p) {
                     if (buttonCurrentlyPressed && !manualGrinderActive) {
                         // Button just pressed - start grinder
                         manualGrinderActive = true;
-                        Serial.println("[ManualGrind] BEFORE digitalWrite ON");
-                        digitalWrite(GRINDER_ACTIVE_PIN, LOW); // Relay ON
-                        delay(1); // Minimal delay after toggling ON
-                        Serial.println("[ManualGrind] AFTER digitalWrite ON");
+                        actuatorStart();
                         Serial.println("Manual grind: Grinder ON");
                         wakeScreen();
                     } else if (!buttonCurrentlyPressed && manualGrinderActive) {
                         // Button just released - stop grinder
                         manualGrinderActive = false;
-                        Serial.println("[ManualGrind] BEFORE digitalWrite OFF");
-                        digitalWrite(GRINDER_ACTIVE_PIN, HIGH); // Relay OFF
-                        delay(1); // Minimal delay after toggling OFF
-                        Serial.println("[ManualGrind] AFTER digitalWrite OFF");
+                        actuatorStop();
                         Serial.println("Manual grind: Grinder OFF");
                     }
                     break; // Skip automatic grinding logic when in manual mode
                 }
 
-                // Only allow button trigger if grindMode == true (automatic mode)
-                if (grindMode && digitalRead(GRIND_BUTTON_PIN) == LOW && !grinderButtonPressed) {
+                // Only allow button trigger if the grind trigger is the button
+                if (useButtonToGrind && digitalRead(GRIND_BUTTON_PIN) == LOW && !grinderButtonPressed) {
                     grinderButtonPressed = true;
                     grinderButtonPressedAt = millis();
                     wakeScreen(); // wake screen immediately
                     Serial.println("Grinder button pressed, screen waking...");
                 }
             
-                if (grindMode && grinderButtonPressed && millis() - grinderButtonPressedAt >= 600) {
+                if (useButtonToGrind && grinderButtonPressed && millis() - grinderButtonPressedAt >= 600) {
                     grinderButtonPressed = false; // reset flag
                     cupWeightEmpty = scaleWeight;
                     scaleStatus = STATUS_GRINDING_IN_PROGRESS;
@@ -212,23 +536,33 @@ void scaleStatusLoop(void *p) {
                         newOffset = true;
                         startedGrindingAt = millis();
                     }
-                    grinderToggle();
+                    startGrinding();
                     Serial.println("Grinding started after delay.");
                     continue;
                 }
             
-                // Only allow cup trigger if grindMode == false
-                if (!grindMode &&
-                    ABS(weightHistory.minSince(millis() - 1000) - setCupWeight) < CUP_DETECTION_TOLERANCE &&
-                    ABS(weightHistory.maxSince(millis() - 1000) - setCupWeight) < CUP_DETECTION_TOLERANCE) {
-                    
-                    cupWeightEmpty = weightHistory.averageSince(millis() - 500);
+                // A recognised cup selects its recipe; with the cup trigger it also starts the
+                // shot, measured from the cup's own stable weight
+                WeightStability cup = scaleStability();
+                if (scaleWeight < CUP_DETECTION_TOLERANCE) {
+                    cupForget(); // nothing on the scale, the cup was lifted
+                }
+                bool newCup = false;
+                int known = cup.stable ? cupMatch(cup.value, newCup) : -1;
+                if (known >= 0 && newCup) {
+                    CupEntry entry = cupAt(known);
+                    recipeSelect(entry.recipe);
+                    Serial.printf("[Cup] %.1fg matches %.1fg: %s\n", cup.value, entry.weight, recipe->name);
+                }
+                // Only allow cup trigger if the grind trigger is the cup
+                if (!useButtonToGrind && known >= 0) {
+                    cupWeightEmpty = cup.value;
                     scaleStatus = STATUS_GRINDING_IN_PROGRESS;
                     if (!scaleMode) {
                         newOffset = true;
                         startedGrindingAt = millis();
                     }
-                    grinderToggle();
+                    startGrinding();
                     Serial.println("Grinding started from cup detection.");
                     continue;
                 }
@@ -240,15 +574,13 @@ void scaleStatusLoop(void *p) {
             if (scaleWeight < -10.0)
             { // Only fail if weight is significantly negative (cup removed)
                 Serial.println("GRINDING FAILED: Significantly negative weight detected (cup removed).");
-                grinderToggle(); // Ensure grinder is off
-                scaleStatus = STATUS_GRINDING_FAILED;
+                failGrinding(GRIND_RESULT_CUP_REMOVED); // Ensure grinder is off
                 continue;
             }
             if (!scaleReady)
             {
                 Serial.println("GRINDING FAILED: Scale not ready");
-                grinderToggle();
-                scaleStatus = STATUS_GRINDING_FAILED;
+                failGrinding(GRIND_RESULT_SCALE_NOT_READY);
                 continue;
             }
                 if (scaleMode && startedGrindingAt == 0 && scaleWeight - cupWeightEmpty >= 0.1) {
@@ -257,43 +589,38 @@ void scaleStatusLoop(void *p) {
             }
                 if (millis() - startedGrindingAt > MAX_GRINDING_TIME && !scaleMode) {
                 Serial.println("GRINDING FAILED: Max grinding time exceeded");
-                grinderToggle();
-                scaleStatus = STATUS_GRINDING_FAILED;
+                failGrinding(GRIND_RESULT_MAX_TIME);
                 continue;
             }
             if (millis() - startedGrindingAt > 5000 &&
                 scaleWeight - weightHistory.firstValueOlderThan(millis() - 5000) < 1 &&
-                    !scaleMode) {
+                    !scaleMode && recipe->stopMode != STOP_TIME) {
                 Serial.println("GRINDING FAILED: No weight increase after 2 seconds");
-                grinderToggle();
-                scaleStatus = STATUS_GRINDING_FAILED;
+                failGrinding(GRIND_RESULT_NO_FLOW);
                 continue;
             }
                 if (weightHistory.minSince((int64_t)millis() - 200) < cupWeightEmpty - CUP_DETECTION_TOLERANCE && !scaleMode) {
                 Serial.printf("GRINDING FAILED: Cup removed - min weight: %.2f, cup weight: %.2f, tolerance: %d\n", 
                              weightHistory.minSince((int64_t)millis() - 200), cupWeightEmpty, CUP_DETECTION_TOLERANCE);
-                grinderToggle();
-                scaleStatus = STATUS_GRINDING_FAILED;
+                failGrinding(GRIND_RESULT_CUP_REMOVED);
                 continue;
             }
-            double currentOffset = offset;
-                if (scaleMode) {
-                currentOffset = 0;
-            }
-                double grindTarget;
-                if (grindMode && !manualGrindMode) {
-                    // Button-activated automatic grinding: ignore cup weight
-                    grindTarget = setWeight + currentOffset;
-                } else {
-                    // Other modes: include cup weight
-                    grindTarget = cupWeightEmpty + setWeight + currentOffset;
-                }
-                if (weightHistory.maxSince((int64_t)millis() - 200) >= grindTarget) {
-                    finishedGrindingAt = millis();
-                    grinderToggle();
-                    scaleStatus = STATUS_GRINDING_FINISHED;
-                    continue;
+            // The relay is normally dropped by the actuator's timer: at the end of a timed grind,
+            // or at the cutoff updateScale armed. The threshold check is only the fallback.
+            bool reached = recipe->stopMode != STOP_TIME && weightHistory.maxSince((int64_t)millis() - 200) >= grindTarget();
+            if (!actuatorRunning() || reached) {
+                if (actuatorRunning()) {
+                    actuatorStop();
+                    cutoffWeight = scaleWeight;
+                } else if (recipe->stopMode == STOP_TIME) {
+                    cutoffWeight = scaleWeight;
                 }
+                ActuatorStop cut = actuatorLastStop();
+                PROBE_US(PROBE_RELAY_LATENCY, cut.at - cut.deadline);
+                finishedGrindingAt = actuatorStoppedAt();
+                scaleStatus = STATUS_GRINDING_FINISHED;
+                continue;
+            }
             break;
         }
         case STATUS_GRINDING_FINISHED:
@@ -309,52 +636,91 @@ void scaleStatusLoop(void *p) {
                 Serial.println(" seconds");
             }
 
-            double currentWeight = weightHistory.averageSince((int64_t)millis() - 500);
+            // Learn from the settled weight; give up waiting after STABLE_SETTLE_TIMEOUT.
+            // A top-up burst restarts the wait.
+            unsigned long stoppedAt = topUpPulses > 0 ? actuatorStoppedAt() : finishedGrindingAt;
+            WeightStability settled = scaleStability();
+            bool settledAfterStop = settled.stable && settled.settledAt > stoppedAt;
+            double currentWeight = settledAfterStop ? settled.value : weightHistory.averageSince((int64_t)millis() - 500);
             if (scaleWeight < 5) {
+                actuatorStop(); // Cup lifted during a top-up burst
                 startedGrindingAt = 0;
                 grindingFinishedAt = 0; // Reset the timestamp
                 scaleWeight = 0;
                 scaleStatus = STATUS_EMPTY;
                 continue;
-            } else if (millis() - finishedGrindingAt > 2000 && newOffset && AUTO_OFFSET_ADJUSTMENT) {
-                // Wait 2 seconds for all coffee to settle, then auto-adjust offset
-                if (!manualGrindMode) {
+            } else if (actuatorRunning()) {
+                break; // Top-up burst still running
+            } else if ((settledAfterStop || millis() - stoppedAt > STABLE_SETTLE_TIMEOUT) && newOffset) {
+                bool byWeight = recipe->stopMode != STOP_TIME && !scaleMode;
+                if (topUpPulses == 0) {
+                    firstSettledWeight = currentWeight;
+                    if (byWeight) {
+                        logCutoffError(grindTarget());
+                    }
+                }
+                // Under target after settling: one more short burst, sized from the main grind's flow
+                double deficit = recipe->dose - (currentWeight - doseBaseline());
+                if (byWeight && recipe->stopMode == STOP_WEIGHT_TOPUP && settledAfterStop && topUpPulses < TOPUP_MAX_PULSES &&
+                    deficit > TOPUP_MIN_DEFICIT) {
+                    uint32_t pulseUs = topUpPulseUs(deficit);
+                    if (pulseUs > 0) {
+                        topUpPulses++;
+                        Serial.printf("Top-up %d: %.2fg short, %lu us burst\n", topUpPulses, deficit, (unsigned long)pulseUs);
+                        actuatorRun(pulseUs);
+                        continue;
+                    }
+                }
+                // All coffee has settled: report and log the shot, then auto-adjust offset
+                reportShot(currentWeight - doseBaseline(), finishedGrindingAt - startedGrindingAt, GRIND_RESULT_OK);
+                if (byWeight) {
+                    doseStatsRecord(recipeIndex(), currentWeight - doseBaseline() - recipe->dose,
+                                    firstSettledWeight - cutoffWeight, finishedGrindingAt - startedGrindingAt);
+                }
+                if (AUTO_OFFSET_ADJUSTMENT && !manualGrindMode && byWeight) {
                     double targetTotalWeight;
-                    if (grindMode && !manualGrindMode) {
+                    if (useButtonToGrind && !manualGrindMode) {
                         // Button-activated automatic grinding: ignore cup weight
-                        targetTotalWeight = setWeight;
+                        targetTotalWeight = recipe->dose;
                     } else {
                         // Other modes: include cup weight
-                        targetTotalWeight = setWeight + cupWeightEmpty;
+                        targetTotalWeight = recipe->dose + cupWeightEmpty;
                     }
-                    double actualWeight = currentWeight;
+                    double actualWeight = firstSettledWeight; // The offset corrects the main cut, not the top-up
                     double weightError = targetTotalWeight - actualWeight;
 
                     if (ABS(weightError) > 0.3) { // Only adjust if error is significant (>0.3g)
-                        double oldOffset = offset;
-                        offset += weightError;
+                        double oldOffset = recipe->offset;
+                        recipe->offset += weightError;
                         // Constrain offset to reasonable limits
-                        if (offset > 5.0) offset = 5.0;
-                        if (offset < -5.0) offset = -5.0;
+                        if (recipe->offset > 5.0) recipe->offset = 5.0;
+                        if (recipe->offset < -5.0) recipe->offset = -5.0;
                         // Serial output disabled for performance
+                        recipeChanged();
                         shotCount++;
+                        PROBE_START(nvsStart);
                         preferences.begin("scale", false);
-                        preferences.putDouble("offset", offset);
                         preferences.putUInt("shotCount", shotCount);
                         preferences.end();
+                        PROBE_STOP(PROBE_NVS_WRITE, nvsStart);
                     } else {
                         shotCount++;
+                        PROBE_START(nvsStart);
                         preferences.begin("scale", false);
                         preferences.putUInt("shotCount", shotCount);
                         preferences.end();
+                        PROBE_STOP(PROBE_NVS_WRITE, nvsStart);
                     }
                 } else {
-                    // Manual grind mode: do not adjust offset, just increment shotCount
+                    // Manual grind mode, timed grinding or learning off: do not adjust offset, just increment shotCount
                     shotCount++;
+                    PROBE_START(nvsStart);
                     preferences.begin("scale", false);
                     preferences.putUInt("shotCount", shotCount);
                     preferences.end();
+                    PROBE_STOP(PROBE_NVS_WRITE, nvsStart);
                 }
+                recipeCommitActive();
                 newOffset = false;
             }
 
@@ -385,8 +751,9 @@ void scaleStatusLoop(void *p) {
             break;
         }
         }
+        PROBE_SCOPE_END(decisionProbe);
         rotary_loop();
-        delay(50);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50)); // 50 ms, cut short by requestGrinderStop()
     }
 }
 
@@ -445,34 +812,40 @@ void setupScale() {
     Serial.println("Initializing load cell...");
     // Set HX711 to 10Hz (default debug mode)
     loadcell.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN); // default 10 Hz mode
-    pinMode(GRINDER_ACTIVE_PIN, OUTPUT);
+    setupActuator(); // Relay OFF = Grinder stopped
+    setupSafety();
     pinMode(GRIND_BUTTON_PIN, INPUT_PULLUP);
-    digitalWrite(GRINDER_ACTIVE_PIN, HIGH); // Initialize HIGH = Relay OFF = Grinder stopped
     Serial.println("Load cell and pins initialized.");
 
     preferences.begin("scale", false);
     
     double scaleFactor = preferences.getDouble("calibration", (double)LOADCELL_SCALE_FACTOR);
-    if (scaleFactor <= 0 || std::isnan(scaleFactor)) {
+    double scaleCurvature = preferences.getDouble("calCurve", 0);
+    if (std::isnan(scaleFactor) || ABS(scaleFactor) < 100 || ABS(scaleFactor) > 10000 || std::isnan(scaleCurvature)) {
     scaleFactor = LOADCELL_SCALE_FACTOR;
+    scaleCurvature = 0;
     preferences.putDouble("calibration", scaleFactor);
+    preferences.putDouble("calCurve", scaleCurvature);
     Serial.println("Invalid scale factor detected. Resetting to default.");
     }
-    setWeight = preferences.getDouble("setWeight", (double)COFFEE_DOSE_WEIGHT);
-    offset = preferences.getDouble("offset", (double)COFFEE_DOSE_OFFSET);
-    setCupWeight = preferences.getDouble("cup", (double)CUP_WEIGHT);
+    scaleModel.setCalibration(scaleFactor, scaleCurvature); // Tasks are not running yet
     scaleMode = preferences.getBool("scaleMode", false);
-    grindMode = preferences.getBool("grindMode", false);
+    if (preferences.getUInt("version", 1) < 2) {
+        // Older firmware used grindMode for the trigger (true = button) and always held the relay
+        preferences.putBool("grindTrigger", preferences.getBool("grindMode", DEFAULT_GRIND_TRIGGER_MODE));
+        preferences.putBool("grindMode", DEFAULT_GRIND_MODE);
+        preferences.putUInt("version", 2);
+    }
     shotCount = preferences.getUInt("shotCount", 0);
     sleepTime = preferences.getInt("sleepTime", SLEEP_AFTER_MS); // Default to SLEEP_AFTER_MS if not set
     useButtonToGrind = preferences.getBool("grindTrigger", DEFAULT_GRIND_TRIGGER_MODE);
     manualGrindMode = preferences.getBool("manualGrindMode", false);
     preferences.end();
-  Serial.printf("→ scaleFactor = %.0f  |  offset = %.0f\n", scaleFactor, offset);
+    setupRecipes(); // After the migration above, which the first recipe picks up
+    setupCups();
+  Serial.printf("→ scaleFactor = %.2f  |  curvature = %.3e  |  offset = %.2f\n", scaleFactor, scaleCurvature, recipe->offset);
   Serial.printf("→ Manual Grind Mode: %s\n", manualGrindMode ? "ENABLED" : "DISABLED");
-    // loadcell.set_scale(scaleFactor); // Not used in debug form
-    // loadcell.set_offset(offset); // Not used in debug form
 
-    xTaskCreatePinnedToCore(updateScale, "Scale", 20000, NULL, 0, &ScaleTask, 1);
-    xTaskCreatePinnedToCore(scaleStatusLoop, "ScaleStatus", 20000, NULL, 0, &ScaleStatusTask, 1);
+    xTaskCreatePinnedToCore(updateScale, "Scale", 20000, NULL, ACQUISITION_TASK_PRIORITY, &ScaleTask, ACQUISITION_TASK_CORE);
+    xTaskCreatePinnedToCore(scaleStatusLoop, "ScaleStatus", 20000, NULL, CONTROL_TASK_PRIORITY, &ScaleStatusTask, CONTROL_TASK_CORE);
 }
@@ -0,0 +1,371 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "config.hpp"
+#include "mqtt.hpp"
+#include "shot_log.hpp"
+
+// Shots are packed into blocks of SHOT_LOG_BLOCK_SIZE bytes, each stored as one blob in the
+// "shots" NVS namespace (NVS does its own wear levelling). The blocks form a ring of
+// SHOT_LOG_BLOCKS slots, so once it is full the oldest block is dropped as a whole.
+//
+// Record layout; varints are LEB128, signed ones zigzag encoded:
+//   flags   1 byte: result (bits 0-2), trigger (bit 3), target changed (bit 4), offset changed (bit 5)
+//   error   signed varint, actual - target in 0.01 g
+//   time    varint, grind time in 0.1 s
+//   target  signed varint, change from the previous record in 0.1 g, only if flagged
+//   offset  signed varint, change from the previous record in 0.01 g, only if flagged
+// Deltas restart from zero in every block, so a block decodes on its own. A typical shot
+// with unchanged target and offset takes 3-4 bytes.
+
+#define SHOT_FLAG_RESULT 0x07
+#define SHOT_FLAG_TRIGGER 0x08
+#define SHOT_FLAG_TARGET 0x10
+#define SHOT_FLAG_OFFSET 0x20
+#define SHOT_RECORD_MAX 16 // worst-case encoded size
+
+struct ShotBlock
+{
+    uint32_t firstSeq; // seq of the first record in data
+    uint16_t length;   // bytes used in data
+    uint16_t count;    // records in data
+    uint8_t data[SHOT_LOG_BLOCK_SIZE];
+};
+#define SHOT_BLOCK_HEADER offsetof(ShotBlock, data)
+
+// The block being filled, plus a just-filled one the writer task has not stored yet.
+// Encoding happens in the caller's task; only the writer task touches flash.
+static ShotBlock current = {};
+static ShotBlock sealed = {};
+static bool sealedPending = false;
+static bool currentDirty = false;
+static uint32_t currentBlock = 0; // block number; its slot is currentBlock % SHOT_LOG_BLOCKS
+static int32_t lastTarget = 0;    // 0.1 g, encoder state within the current block
+static int32_t lastOffset = 0;    // 0.01 g
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+
+TaskHandle_t ShotLogTask = nullptr;
+
+static size_t putVarint(uint8_t *out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+static size_t putSigned(uint8_t *out, int32_t value)
+{
+    return putVarint(out, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static bool getVarint(const uint8_t *data, size_t length, size_t &pos, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; pos < length && shift < 35; shift += 7) {
+        uint8_t b = data[pos++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool getSigned(const uint8_t *data, size_t length, size_t &pos, int32_t &value)
+{
+    uint32_t raw;
+    if (!getVarint(data, length, pos, raw)) {
+        return false;
+    }
+    value = (int32_t)(raw >> 1) ^ -(int32_t)(raw & 1);
+    return true;
+}
+
+static int32_t toUnits(double value, double scale)
+{
+    return (int32_t)lround(value * scale);
+}
+
+// Decodes a block. Records with seq in [lo, hi] are written to out[hi - seq], i.e. newest first;
+// out may be null. The encoder state after the last record is returned through the pointers.
+static size_t decodeBlock(const ShotBlock &block, ShotRecord *out, uint32_t lo, uint32_t hi,
+                          int32_t *endTarget = nullptr, int32_t *endOffset = nullptr)
+{
+    int32_t target = 0, offset = 0;
+    size_t pos = 0, n = 0;
+    while (pos < block.length && n < block.count) {
+        uint8_t flags = block.data[pos++];
+        int32_t error, delta;
+        uint32_t time;
+        if (!getSigned(block.data, block.length, pos, error) || !getVarint(block.data, block.length, pos, time)) {
+            break;
+        }
+        if (flags & SHOT_FLAG_TARGET) {
+            if (!getSigned(block.data, block.length, pos, delta)) {
+                break;
+            }
+            target += delta;
+        }
+        if (flags & SHOT_FLAG_OFFSET) {
+            if (!getSigned(block.data, block.length, pos, delta)) {
+                break;
+            }
+            offset += delta;
+        }
+        uint32_t seq = block.firstSeq + n;
+        if (out && seq >= lo && seq <= hi) {
+            ShotRecord &r = out[hi - seq];
+            r.seq = seq;
+            r.target = target / 10.0f;
+            r.actual = r.target + error / 100.0f;
+            r.grindTimeMs = time * 100;
+            r.offset = offset / 100.0f;
+            r.trigger = flags & SHOT_FLAG_TRIGGER ? SHOT_TRIGGER_BUTTON : SHOT_TRIGGER_CUP;
+            r.result = flags & SHOT_FLAG_RESULT;
+        }
+        n++;
+    }
+    if (endTarget) {
+        *endTarget = target;
+    }
+    if (endOffset) {
+        *endOffset = offset;
+    }
+    return n;
+}
+
+static void blockKey(char *key, size_t size, uint32_t block)
+{
+    snprintf(key, size, "b%u", (unsigned)(block % SHOT_LOG_BLOCKS));
+}
+
+static bool loadBlock(Preferences &store, uint32_t block, ShotBlock &out)
+{
+    char key[8];
+    blockKey(key, sizeof(key), block);
+    size_t length = store.getBytes(key, &out, sizeof(out));
+    return length >= SHOT_BLOCK_HEADER && out.length <= SHOT_LOG_BLOCK_SIZE && length == SHOT_BLOCK_HEADER + out.length;
+}
+
+static void storeBlock(Preferences &store, uint32_t block, const ShotBlock &data)
+{
+    char key[8];
+    blockKey(key, sizeof(key), block);
+    if (store.putBytes(key, &data, SHOT_BLOCK_HEADER + data.length) == 0) {
+        Serial.printf("[ShotLog] Writing block %u failed\n", (unsigned)block);
+    }
+}
+
+// Stores whatever the encoder has changed; flash writes never run in the scale tasks
+static void shotLogLoop(void *parameter)
+{
+    static ShotBlock sealedCopy;
+    static ShotBlock currentCopy;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&logMux);
+        bool writeSealed = sealedPending;
+        bool writeCurrent = currentDirty;
+        uint32_t block = currentBlock;
+        if (writeSealed) {
+            sealedCopy = sealed;
+        }
+        if (writeCurrent) {
+            currentCopy = current;
+        }
+        sealedPending = false;
+        currentDirty = false;
+        portEXIT_CRITICAL(&logMux);
+
+        Preferences store;
+        store.begin("shots", false);
+        if (writeSealed) {
+            storeBlock(store, block - 1, sealedCopy);
+        }
+        if (writeCurrent) {
+            // A new block also replaces the oldest one in its slot
+            storeBlock(store, block, currentCopy);
+            store.putUInt("block", block);
+        }
+        store.end();
+    }
+}
+
+void shotLogRecord(double target, double actual, unsigned long grindTimeMs, double offset, int trigger, int result)
+{
+    int32_t targetUnits = toUnits(target, 10);
+    int32_t offsetUnits = toUnits(offset, 100);
+    int32_t error = toUnits(actual - target, 100);
+    uint32_t time = (grindTimeMs + 50) / 100;
+    uint8_t record[SHOT_RECORD_MAX];
+
+    portENTER_CRITICAL(&logMux);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t n = 1;
+        uint8_t flags = (result & SHOT_FLAG_RESULT) | (trigger == SHOT_TRIGGER_BUTTON ? SHOT_FLAG_TRIGGER : 0);
+        n += putSigned(record + n, error);
+        n += putVarint(record + n, time);
+        if (targetUnits != lastTarget) {
+            flags |= SHOT_FLAG_TARGET;
+            n += putSigned(record + n, targetUnits - lastTarget);
+        }
+        if (offsetUnits != lastOffset) {
+            flags |= SHOT_FLAG_OFFSET;
+            n += putSigned(record + n, offsetUnits - lastOffset);
+        }
+        record[0] = flags;
+
+        if (current.length + n <= SHOT_LOG_BLOCK_SIZE) {
+            memcpy(current.data + current.length, record, n);
+            current.length += n;
+            current.count++;
+            lastTarget = targetUnits;
+            lastOffset = offsetUnits;
+            currentDirty = true;
+            break;
+        }
+        // Block full: hand it to the writer and encode again against a fresh block
+        sealed = current;
+        sealedPending = true;
+        currentBlock++;
+        current.firstSeq += current.count;
+        current.length = 0;
+        current.count = 0;
+        lastTarget = 0;
+        lastOffset = 0;
+    }
+    portEXIT_CRITICAL(&logMux);
+
+    if (ShotLogTask) {
+        xTaskNotifyGive(ShotLogTask);
+    }
+}
+
+uint32_t shotLogTotal()
+{
+    portENTER_CRITICAL(&logMux);
+    uint32_t total = current.firstSeq + current.count;
+    portEXIT_CRITICAL(&logMux);
+    return total;
+}
+
+// Fills out with up to pageSize shots, newest first; page 0 holds the latest shots
+size_t shotLogPage(uint32_t page, size_t pageSize, ShotRecord *out)
+{
+    ShotBlock block;
+
+    portENTER_CRITICAL(&logMux);
+    uint32_t newestBlock = currentBlock;
+    uint32_t total = current.firstSeq + current.count;
+    portEXIT_CRITICAL(&logMux);
+    if (pageSize == 0 || (uint64_t)page * pageSize >= total) {
+        return 0;
+    }
+    uint32_t hi = total - 1 - page * pageSize;
+    uint32_t lo = hi + 1 >= pageSize ? hi + 1 - pageSize : 0;
+    uint32_t oldestSeq = hi + 1;
+
+    Preferences store;
+    bool stored = store.begin("shots", true);
+    for (uint32_t b = newestBlock; b + SHOT_LOG_BLOCKS > newestBlock; b--) {
+        bool ok = false;
+        // The newest blocks may not be in flash yet
+        portENTER_CRITICAL(&logMux);
+        if (b == currentBlock) {
+            block = current;
+            ok = true;
+        } else if (b + 1 == currentBlock && sealedPending) {
+            block = sealed;
+            ok = true;
+        }
+        portEXIT_CRITICAL(&logMux);
+        if (!ok && stored) {
+            ok = loadBlock(store, b, block);
+        }
+        if (!ok) {
+            break;
+        }
+        decodeBlock(block, out, lo, hi);
+        oldestSeq = block.firstSeq;
+        if (block.firstSeq <= lo || b == 0) {
+            break;
+        }
+    }
+    if (stored) {
+        store.end();
+    }
+    // Shots older than the ring are gone
+    if (oldestSeq > lo) {
+        lo = oldestSeq;
+    }
+    return hi >= lo ? hi - lo + 1 : 0;
+}
+
+String shotLogPageJson(uint32_t page, size_t pageSize)
+{
+    ShotRecord records[SHOT_LOG_PAGE_MAX];
+    if (pageSize > SHOT_LOG_PAGE_MAX) {
+        pageSize = SHOT_LOG_PAGE_MAX;
+    }
+    size_t count = shotLogPage(page, pageSize, records);
+
+    String json = "{\"total\":";
+    json += shotLogTotal();
+    json += ",\"page\":";
+    json += page;
+    json += ",\"shots\":[";
+    char buf[192];
+    for (size_t i = 0; i < count; i++) {
+        const ShotRecord &r = records[i];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"seq\":%lu,\"target\":%.1f,\"actual\":%.2f,\"time\":%.1f,\"offset\":%.2f,\"trigger\":\"%s\",\"result\":\"%s\"}",
+                 i ? "," : "", (unsigned long)r.seq, r.target, r.actual, r.grindTimeMs / 1000.0, r.offset,
+                 r.trigger == SHOT_TRIGGER_BUTTON ? "button" : "cup", grindResultName(r.result));
+        json += buf;
+    }
+    json += "]}";
+    return json;
+}
+
+void shotLogPrintRecent(size_t count)
+{
+    ShotRecord records[SHOT_LOG_PAGE_MAX];
+    if (count > SHOT_LOG_PAGE_MAX) {
+        count = SHOT_LOG_PAGE_MAX;
+    }
+    count = shotLogPage(0, count, records);
+    Serial.printf("[ShotLog] %lu shots logged, latest %u:\n", (unsigned long)shotLogTotal(), (unsigned)count);
+    for (size_t i = 0; i < count; i++) {
+        const ShotRecord &r = records[i];
+        Serial.printf("[ShotLog] #%lu %5.1f -> %6.2f g  %4.1f s  offset %+.2f  %s  %s\n", (unsigned long)r.seq, r.target,
+                      r.actual, r.grindTimeMs / 1000.0, r.offset, r.trigger == SHOT_TRIGGER_BUTTON ? "button" : "cup",
+                      grindResultName(r.result));
+    }
+}
+
+// Restores the block being filled and starts the writer task
+void setupShotLog()
+{
+    Preferences store;
+    if (store.begin("shots", true)) {
+        currentBlock = store.getUInt("block", 0);
+        if (!loadBlock(store, currentBlock, current)) {
+            // Lost or never written: continue the numbering of the block before it, if any
+            ShotBlock previous;
+            current = {};
+            if (currentBlock > 0 && loadBlock(store, currentBlock - 1, previous)) {
+                current.firstSeq = previous.firstSeq + previous.count;
+            }
+        }
+        store.end();
+    }
+    current.count = decodeBlock(current, nullptr, 0, 0, &lastTarget, &lastOffset);
+    Serial.printf("[ShotLog] %lu shots logged\n", (unsigned long)shotLogTotal());
+
+    xTaskCreatePinnedToCore(shotLogLoop, "ShotLog", 4096, NULL, STATS_TASK_PRIORITY, &ShotLogTask, STATS_TASK_CORE);
+}
@@ -0,0 +1,191 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+
+#include "config.hpp"
+#include "task_stats.hpp"
+
+extern TaskHandle_t DisplayTask;
+extern TaskHandle_t MqttTask;
+
+TaskHandle_t StatsTask = nullptr;
+
+// Ring of the last TASK_STATS_RING_SIZE snapshots, written by the stats task only
+static TaskStatsSnapshot ring[TASK_STATS_RING_SIZE];
+static size_t ringHead = 0; // next slot to write
+static size_t ringCount = 0;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Idle time per core, in microseconds (wraps). The idle hook runs over and over while a core
+// has nothing else to do: two calls close together mean the core stayed idle in between, a
+// longer gap means a task or a long interrupt ran. The hook returns false so the idle task
+// keeps calling it instead of waiting for an interrupt; that costs power, not CPU time.
+static volatile uint32_t idleUs[portNUM_PROCESSORS];
+static uint32_t lastIdleAt[portNUM_PROCESSORS]; // each entry only touched on its own core
+static uint32_t idleUsAtSnapshot[portNUM_PROCESSORS];
+static int64_t lastSnapshotUs = 0;
+
+static bool idleHook()
+{
+    int core = xPortGetCoreID();
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t gap = now - lastIdleAt[core];
+    lastIdleAt[core] = now;
+    if (gap <= CPU_IDLE_GAP_US) {
+        uint32_t total = idleUs[core] + gap;
+        idleUs[core] = total;
+    }
+    return false;
+}
+
+static void collect(TaskStatsSnapshot &s)
+{
+    s.at = millis();
+    s.freeHeap = ESP.getFreeHeap();
+    s.minFreeHeap = ESP.getMinFreeHeap();
+    s.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    int64_t now = esp_timer_get_time();
+    uint64_t elapsed = now - lastSnapshotUs;
+    lastSnapshotUs = now;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t idle = idleUs[core];
+        uint64_t idleDelta = idle - idleUsAtSnapshot[core];
+        idleUsAtSnapshot[core] = idle;
+        s.cpuBusy[core] = elapsed ? 100 - min((uint64_t)100, idleDelta * 100 / elapsed) : 0;
+    }
+    s.taskCount = 0;
+
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t status[TASK_STATS_MAX_TASKS];
+    UBaseType_t n = uxTaskGetSystemState(status, TASK_STATS_MAX_TASKS, nullptr);
+    if (n == 0) {
+        Serial.println("[Stats] More tasks than TASK_STATS_MAX_TASKS");
+    }
+    for (UBaseType_t i = 0; i < n; i++) {
+        TaskStatsEntry &e = s.tasks[s.taskCount++];
+        strlcpy(e.name, status[i].pcTaskName, sizeof(e.name));
+        e.stackFree = status[i].usStackHighWaterMark;
+#if configTASKLIST_INCLUDE_COREID
+        e.core = status[i].xCoreID == tskNO_AFFINITY ? -1 : status[i].xCoreID;
+#else
+        e.core = -1;
+#endif
+    }
+#else
+    // Without the trace facility only the application tasks can be looked at
+    TaskHandle_t handles[] = {ScaleTask, ScaleStatusTask, DisplayTask, MqttTask};
+    for (TaskHandle_t handle : handles) {
+        if (handle == nullptr || s.taskCount >= TASK_STATS_MAX_TASKS) {
+            continue;
+        }
+        TaskStatsEntry &e = s.tasks[s.taskCount++];
+        strlcpy(e.name, pcTaskGetName(handle), sizeof(e.name));
+        e.stackFree = uxTaskGetStackHighWaterMark(handle);
+        e.core = -1;
+    }
+#endif
+}
+
+void statsLoop(void *parameter)
+{
+    for (;;) {
+        TaskStatsSnapshot snapshot;
+        collect(snapshot);
+        portENTER_CRITICAL(&ringMux);
+        ring[ringHead] = snapshot;
+        ringHead = (ringHead + 1) % TASK_STATS_RING_SIZE;
+        if (ringCount < TASK_STATS_RING_SIZE) {
+            ringCount++;
+        }
+        portEXIT_CRITICAL(&ringMux);
+        vTaskDelay(TASK_STATS_INTERVAL / portTICK_PERIOD_MS);
+    }
+}
+
+// Copies the i-th snapshot counted from the oldest one
+static bool snapshotAt(size_t i, TaskStatsSnapshot &out)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&ringMux);
+    if (i < ringCount) {
+        out = ring[(ringHead + TASK_STATS_RING_SIZE - ringCount + i) % TASK_STATS_RING_SIZE];
+        ok = true;
+    }
+    portEXIT_CRITICAL(&ringMux);
+    return ok;
+}
+
+bool taskStatsLatest(TaskStatsSnapshot &out)
+{
+    portENTER_CRITICAL(&ringMux);
+    size_t count = ringCount;
+    portEXIT_CRITICAL(&ringMux);
+    return count > 0 && snapshotAt(count - 1, out);
+}
+
+void taskStatsPrintLatest()
+{
+    TaskStatsSnapshot s;
+    if (!taskStatsLatest(s)) {
+        Serial.println("[Stats] No snapshot yet");
+        return;
+    }
+    Serial.printf("[Stats] at %lu ms | heap free %lu, min %lu, largest block %lu\n", (unsigned long)s.at,
+                  (unsigned long)s.freeHeap, (unsigned long)s.minFreeHeap, (unsigned long)s.largestFreeBlock);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        Serial.printf("[Stats] core %d busy %3u%%\n", core, s.cpuBusy[core]);
+    }
+    for (int i = 0; i < s.taskCount; i++) {
+        const TaskStatsEntry &e = s.tasks[i];
+        Serial.printf("[Stats] %-16s stack free %6lu B  core %d\n", e.name, (unsigned long)e.stackFree, e.core);
+    }
+}
+
+// Heap figures and per-core load of every snapshot (oldest first) and the tasks of the latest
+// one; task watermarks only ever go down, so older task lists add little
+String taskStatsJson()
+{
+    String json = "{\"interval_ms\":";
+    json += TASK_STATS_INTERVAL;
+    json += ",\"heap\":[";
+    TaskStatsSnapshot s;
+    char buf[96];
+    for (size_t i = 0; snapshotAt(i, s); i++) {
+        snprintf(buf, sizeof(buf), "%s[%lu,%lu,%lu,%lu]", i ? "," : "", (unsigned long)s.at,
+                 (unsigned long)s.freeHeap, (unsigned long)s.minFreeHeap, (unsigned long)s.largestFreeBlock);
+        json += buf;
+    }
+    json += "],\"cpu_busy\":[";
+    for (size_t i = 0; snapshotAt(i, s); i++) {
+        json += i ? ",[" : "[";
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (core) {
+                json += ",";
+            }
+            json += s.cpuBusy[core];
+        }
+        json += "]";
+    }
+    json += "],\"tasks\":[";
+    if (taskStatsLatest(s)) {
+        for (int t = 0; t < s.taskCount; t++) {
+            const TaskStatsEntry &e = s.tasks[t];
+            snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"stack_free\":%lu,\"core\":%d}",
+                     t ? "," : "", e.name, (unsigned long)e.stackFree, e.core);
+            json += buf;
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+void setupTaskStats()
+{
+    lastSnapshotUs = esp_timer_get_time();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_register_freertos_idle_hook_for_cpu(idleHook, core);
+    }
+    xTaskCreatePinnedToCore(statsLoop, "Stats", 4096, NULL, STATS_TASK_PRIORITY, &StatsTask, STATS_TASK_CORE);
+}
@@ -6,66 +6,95 @@
 
 AsyncWebServer server(80);
 
-String currentIPAddress = "192.168.4.1"; // Default AP mode IP
-
-const char *apSSID = "ESP32_Config_openGBW";  // AP SSID
-const char *apPassword = "12345678";           // AP Password (must be at least 8 characters)
+String currentIPAddress = "-"; // Shown on the display until the station has an address
 
 void updateIPAddress() {
     if (WiFi.status() == WL_CONNECTED) {
         currentIPAddress = WiFi.localIP().toString();
     } else {
-        currentIPAddress = "192.168.4.1";
+        currentIPAddress = "-";
     }
 }
 
-void connectToWiFi() {
-    preferences.begin("wifi", true);  // Open preferences in read mode
-    String storedSSID = preferences.getString("wifi_ssid", "");
-    String storedPass = preferences.getString("wifi_pass", "");
-    preferences.end();  // Close preferences
-
-    if (storedSSID.length() > 0) {
-        Serial.print("Connecting to WiFi: ");
-        Serial.println(storedSSID);
+static portMUX_TYPE wifiMux = portMUX_INITIALIZER_UNLOCKED;
+static bool wifiStarted = false; // The station has been started; later callers only wait for it
 
-        WiFi.begin(storedSSID.c_str(), storedPass.c_str());
-        unsigned long startAttemptTime = millis();
+// Waits up to 10 s for the station to get an address
+static bool waitForWiFi() {
+    unsigned long startAttemptTime = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000) {
+        delay(500);
+    }
+    return WiFi.status() == WL_CONNECTED;
+}
 
-        while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000) {
-            delay(500);
-            Serial.print(".");
+// Joins the network stored with wifiConfigure(). Called from the MQTT task as well, so it keeps
+// its own Preferences handle, and only the first call starts the station. The station keeps
+// reconnecting on its own after a failed attempt or a dropped link; it never falls back to an
+// access point.
+void connectToWiFi() {
+    portENTER_CRITICAL(&wifiMux);
+    bool first = !wifiStarted;
+    wifiStarted = true;
+    portEXIT_CRITICAL(&wifiMux);
+    if (!first) {
+        if (WiFi.getMode() & WIFI_STA) {
+            waitForWiFi();
         }
+        return;
+    }
 
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("\nWiFi Connected!");
-            Serial.print("IP Address: ");
-            Serial.println(WiFi.localIP());
-            updateIPAddress();
-            return;
-        }
+    Preferences store;
+    store.begin("wifi", true);  // Open preferences in read mode
+    String storedSSID = store.getString("wifi_ssid", "");
+    String storedPass = store.getString("wifi_pass", "");
+    store.end();  // Close preferences
+
+    if (storedSSID.length() == 0) {
+        Serial.println("No WiFi credentials stored; set them with 'w <ssid> <password>'");
+        return;
     }
 
-    Serial.println("Failed to connect. Starting AP mode...");
-    WiFi.mode(WIFI_AP);
-    WiFi.softAP(apSSID, apPassword);
-    delay(500); // Ensure the AP starts properly
+    Serial.print("Connecting to WiFi: ");
+    Serial.println(storedSSID);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
+    if (waitForWiFi()) {
+        Serial.print("WiFi Connected! IP Address: ");
+        Serial.println(WiFi.localIP());
+    } else {
+        Serial.println("WiFi not connected yet, retrying in the background");
+    }
     updateIPAddress();
-    Serial.print("AP IP Address: ");
-    Serial.println(WiFi.softAPIP());
+}
+
+// Stores the network to join (an empty SSID forgets it). Takes effect after a restart.
+bool wifiConfigure(const char *ssid, const char *pass) {
+    size_t passLen = strlen(pass);
+    if (strlen(ssid) > 32 || (passLen > 0 && (passLen < 8 || passLen > 63))) {
+        Serial.println("Invalid WiFi credentials: SSID up to 32 characters, password 8 to 63");
+        return false;
+    }
+    Preferences store;
+    store.begin("wifi", false);
+    store.putString("wifi_ssid", ssid);
+    store.putString("wifi_pass", pass);
+    store.end(); // Close preferences
+    Serial.printf("WiFi credentials %s\n", ssid[0] ? "SAVED" : "cleared");
+    return true;
 }
 
 void handleWiFiConfig(AsyncWebServerRequest *request) {
     if (request->hasParam("ssid") && request->hasParam("pass")) {
         String newSSID = request->getParam("ssid")->value();
         String newPass = request->getParam("pass")->value();
+        if (!wifiConfigure(newSSID.c_str(), newPass.c_str())) {
+            request->send(400, "text/plain", "Invalid SSID or Password");
+            return;
+        }
 
-        preferences.begin("wifi", false);
-        preferences.putString("wifi_ssid", newSSID);
-        preferences.putString("wifi_pass", newPass);
-        preferences.end(); // Close preferences
-
-        Serial.println("WiFi credentials SAVED. Rebooting in 5 seconds...");
+        Serial.println("Rebooting in 5 seconds...");
         request->send(200, "text/plain", "WiFi credentials SAVED. Rebooting...");
         delay(5000);
         ESP.restart();
@@ -75,6 +104,15 @@ void handleWiFiConfig(AsyncWebServerRequest *request) {
     }
 }
 
-// void setupWebServer() {
-//     // Web server disabled
-// }
+// Serves the API on port 80 once the station is up. Without stored credentials there is no
+// network to serve on, so the server stays off.
+void setupWebServer() {
+    connectToWiFi();
+    if (!(WiFi.getMode() & WIFI_STA)) {
+        Serial.println("Web server not started: no WiFi network stored");
+        return;
+    }
+    setupApiEndpoints(server);
+    server.begin();
+    Serial.println("Web server started on port 80");
+}
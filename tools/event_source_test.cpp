@@ -0,0 +1,117 @@
+// Streams server-sent events (lib/ESPAsyncWebServer-master AsyncEventSource) to clients on a PC
+// whose send window is smaller than the events, and whose add() takes only part of what it is
+// given. Every event has to arrive whole and in order. Build and run:
+//
+//   L=lib/ESPAsyncWebServer-master/src
+//   g++ -std=gnu++17 -O2 -DESP32 -I$L -Itools/host tools/event_source_test.cpp $L/AsyncEventSource.cpp $L/WebRequest.cpp $L/WebResponses.cpp $L/WebServer.cpp $L/WebHandlers.cpp -lpthread -o event_source_test
+//   ./event_source_test
+
+#include <string>
+#include <vector>
+
+#include <ESPAsyncWebServer.h>
+#include <AsyncEventSource.h>
+
+// The parser only calls into authentication for handlers that ask for it
+bool checkBasicAuthentication(const char *, const char *, const char *) { return false; }
+String requestDigestAuthentication(const char *) { return String(); }
+bool checkDigestAuthentication(const char *, const char *, const char *, const char *, const char *, bool,
+                               const char *, const char *, const char *)
+{
+    return false;
+}
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static AsyncEventSourceClient *connected;
+
+// Opens an event stream and returns the connection once the head has been acknowledged
+static AsyncClient *open(size_t window, size_t addLimit)
+{
+    AsyncClient *client = new AsyncClient;
+    AsyncServer::listening()->accept(client);
+    const char request[] = "GET /events HTTP/1.1\r\nHost: scale\r\n\r\n";
+    client->receive(request, sizeof(request) - 1);
+    client->ack();
+    client->output.clear();
+    client->window = window;
+    client->addLimit = addLimit;
+    return client;
+}
+
+static void drain(AsyncClient *client)
+{
+    for (int i = 0; i < 1000 && client->inFlight; i++) {
+        client->ack();
+    }
+    client->poll();
+    for (int i = 0; i < 1000 && client->inFlight; i++) {
+        client->ack();
+    }
+}
+
+// The data lines of every complete event in a stream
+static std::vector<std::string> events(const std::string &stream)
+{
+    std::vector<std::string> out;
+    for (size_t at = 0, end; (end = stream.find("\r\n\r\n", at)) != std::string::npos; at = end + 4) {
+        std::string event = stream.substr(at, end - at);
+        size_t data = event.find("data: ");
+        out.push_back(data == std::string::npos ? "" : event.substr(data + 6));
+    }
+    return out;
+}
+
+int main()
+{
+    AsyncWebServer server(80);
+    AsyncEventSource &source = *new AsyncEventSource("/events"); // the server deletes its handlers
+    source.onConnect([](AsyncEventSourceClient *client) { connected = client; });
+    server.addHandler(&source);
+
+    AsyncClient *slow = open(200, 64);
+    AsyncEventSourceClient *slowEvents = connected;
+    AsyncClient *fast = open(5744, SIZE_MAX);
+    check(source.count() == 2, "two clients connected");
+
+    std::string big(3000, 'w');
+    source.send(big.c_str(), "weight");
+    check(fast->output.find(big) != std::string::npos, "event larger than a slow window: fast client has it at once");
+    check(slow->output.size() == 64 && slowEvents->packetsWaiting() == 1, "slow client has its first piece, rest pending");
+    slowEvents->send("just for you", "hello");
+    source.send("second", "weight");
+    drain(slow);
+    drain(fast);
+    std::vector<std::string> got = events(slow->output);
+    check(got.size() == 3 && got[0] == big && got[1] == "just for you" && got[2] == "second",
+          "slow client: started event finishes, then its own message, then the next broadcast");
+    check(events(fast->output).size() == 2, "fast client: both broadcasts");
+    check(slowEvents->packetsWaiting() == 0 && slowEvents->skipped() == 0, "nothing left or skipped");
+
+    slow->output.clear();
+    slow->window = 30; // about one tick at a time
+    for (int i = 0; i < SSE_RING_SIZE + 3; i++) {
+        source.send(std::to_string(i).c_str(), "tick");
+    }
+    drain(slow);
+    got = events(slow->output);
+    check(!got.empty() && got.back() == std::to_string(SSE_RING_SIZE + 2) && slowEvents->skipped() > 0,
+          "client behind the ring skips to the newest event");
+
+    slow->disconnect();
+    check(source.count() == 1, "disconnected client removed");
+    source.send("after", "weight");
+    check(fast->output.find("data: after\r\n\r\n") != std::string::npos, "remaining client still served");
+    fast->disconnect();
+
+    printf("%s: %d failed\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+// Replays weight traces through the filter pipeline variants and reports noise against
+// settling time. Build and run on a PC:
+//
+//   g++ -std=gnu++17 -O2 -Iinclude tools/filter_bench.cpp -o filter_bench
+//   ./filter_bench trace.log       (serial log captured with the 't' console command)
+//   ./filter_bench --synthetic     (generated cup placement, grind ramp and spikes)
+//
+// Only "T,<ms>,<grams>" lines are read, so a raw serial log can be passed as is.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "filter.hpp"
+
+// Keep in sync with config.hpp
+#define FILTER_STEP_THRESHOLD 2.0
+#define FILTER_STEP_CONFIRM 2
+#define FILTER_MEASUREMENT_NOISE 0.02
+#define FILTER_PROCESS_NOISE 0.01
+#define FILTER_FLOW_NOISE 0.25
+
+#define REFERENCE_WINDOW 9 // samples in the centered median used as ground truth
+#define STEP_MIN 2.0 // grams the reference has to jump between samples to count as a step
+#define SETTLED_BAND 0.2 // grams around the reference that count as settled
+#define SETTLED_SAMPLES 5
+#define FLAT_SLOPE 0.2 // g/s under which the reference counts as at rest
+
+struct Sample
+{
+    double t; // s
+    double grams;
+};
+
+static std::vector<Sample> readTrace(const char *path)
+{
+    std::vector<Sample> trace;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        const char *tag = strstr(line, "T,");
+        unsigned long ms;
+        double grams;
+        if (tag && sscanf(tag, "T,%lu,%lf", &ms, &grams) == 2) {
+            trace.push_back({ms / 1000.0, grams});
+        }
+    }
+    fclose(f);
+    return trace;
+}
+
+// 10 Hz: 3 s empty, cup placed (70 g), 3 s rest, grind at 2 g/s for 9 s, 4 s rest, cup lifted
+static std::vector<Sample> syntheticTrace()
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, 0.12);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::vector<Sample> trace;
+    for (int i = 0; i < 250; i++) {
+        double t = i * 0.1;
+        double truth = 0;
+        if (t >= 3 && t < 24) {
+            truth = 70;
+        }
+        if (t >= 6 && t < 24) {
+            truth += 2 * (std::min(t, 15.0) - 6);
+        }
+        double grams = truth + noise(rng);
+        if (chance(rng) < 0.03) {
+            grams += chance(rng) < 0.5 ? 15 : -15; // Vibration spike
+        }
+        trace.push_back({t, grams});
+    }
+    return trace;
+}
+
+static std::vector<double> reference(const std::vector<Sample> &trace)
+{
+    std::vector<double> ref(trace.size());
+    for (size_t i = 0; i < trace.size(); i++) {
+        size_t from = i >= REFERENCE_WINDOW / 2 ? i - REFERENCE_WINDOW / 2 : 0;
+        size_t to = std::min(trace.size(), i + REFERENCE_WINDOW / 2 + 1);
+        std::vector<double> window;
+        for (size_t j = from; j < to; j++) {
+            window.push_back(trace[j].grams);
+        }
+        std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+        ref[i] = window[window.size() / 2];
+    }
+    return ref;
+}
+
+template <typename Filter>
+static void run(const char *name, Filter filter, const std::vector<Sample> &trace, const std::vector<double> &ref)
+{
+    std::vector<double> out(trace.size());
+    for (size_t i = 0; i < trace.size(); i++) {
+        double dt = i ? trace[i].t - trace[i - 1].t : 0;
+        out[i] = filter.update(trace[i].grams, dt);
+    }
+
+    // Noise: RMS error while the reference is at rest
+    double sumSquares = 0;
+    int restSamples = 0;
+    // Lag: mean error while the reference is moving (grinding)
+    double sumLag = 0;
+    int moveSamples = 0;
+    for (size_t i = REFERENCE_WINDOW; i + REFERENCE_WINDOW < trace.size(); i++) {
+        double slope = (ref[i + 1] - ref[i - 1]) / (trace[i + 1].t - trace[i - 1].t);
+        double error = out[i] - ref[i];
+        if (std::fabs(slope) < FLAT_SLOPE) {
+            sumSquares += error * error;
+            restSamples++;
+        } else if (std::fabs(ref[i + 1] - ref[i - 1]) < STEP_MIN) {
+            sumLag += std::fabs(error);
+            moveSamples++;
+        }
+    }
+
+    // Settling: time from each step until the output is within SETTLED_BAND for SETTLED_SAMPLES in a row
+    double sumSettle = 0;
+    int steps = 0;
+    for (size_t i = 1; i < trace.size(); i++) {
+        if (std::fabs(ref[i] - ref[i - 1]) < STEP_MIN) {
+            continue;
+        }
+        size_t settled = i;
+        int inside = 0;
+        for (size_t j = i; j < trace.size() && inside < SETTLED_SAMPLES; j++) {
+            if (std::fabs(out[j] - ref[j]) > SETTLED_BAND) {
+                inside = 0;
+                settled = j + 1;
+            } else {
+                inside++;
+            }
+        }
+        sumSettle += trace[std::min(settled, trace.size() - 1)].t - trace[i].t;
+        steps++;
+    }
+
+    printf("%-22s %10.3f %10.0f %10.2f\n", name, restSamples ? std::sqrt(sumSquares / restSamples) : 0.0,
+           steps ? 1000 * sumSettle / steps : 0.0, moveSamples ? sumLag / moveSamples : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace.log | --synthetic>\n", argv[0]);
+        return 1;
+    }
+    std::vector<Sample> trace = strcmp(argv[1], "--synthetic") == 0 ? syntheticTrace() : readTrace(argv[1]);
+    if (trace.size() < 2 * REFERENCE_WINDOW) {
+        fprintf(stderr, "trace too short (%zu samples)\n", trace.size());
+        return 1;
+    }
+    std::vector<double> ref = reference(trace);
+
+    StepStage step(FILTER_STEP_THRESHOLD, FILTER_STEP_CONFIRM);
+    AdaptiveKalmanStage fixed(FILTER_MEASUREMENT_NOISE, FILTER_PROCESS_NOISE, 0);
+    AdaptiveKalmanStage adaptive(FILTER_MEASUREMENT_NOISE, FILTER_PROCESS_NOISE, FILTER_FLOW_NOISE);
+
+    printf("%zu samples\n%-22s %10s %10s %10s\n", trace.size(), "pipeline", "noise g", "settle ms", "lag g");
+    run("kalman", FilterPipeline<PassStage, PassStage, AdaptiveKalmanStage>({}, {}, fixed), trace, ref);
+    run("median+kalman", FilterPipeline<MedianStage<3>, PassStage, AdaptiveKalmanStage>({}, {}, fixed), trace, ref);
+    run("median+step+kalman", FilterPipeline<MedianStage<3>, StepStage, AdaptiveKalmanStage>({}, step, fixed), trace, ref);
+    run("median+step+adaptive", FilterPipeline<MedianStage<3>, StepStage, AdaptiveKalmanStage>({}, step, adaptive), trace, ref);
+    run("median5+step+adaptive", FilterPipeline<MedianStage<5>, StepStage, AdaptiveKalmanStage>({}, step, adaptive), trace, ref);
+    return 0;
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+// Minimal Arduino-ESP32 stand-in for building firmware modules on a PC (see tools/*_test.cpp).
+// Tasks are threads, critical sections are mutexes, and the clock runs HOST_TIME_SCALE times
+// faster than real time so the firmware's multi-second intervals pass quickly.
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <utility>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef HOST_TIME_SCALE
+#define HOST_TIME_SCALE 20
+#endif
+
+#define IRAM_ATTR
+
+inline unsigned long hostRealMicros()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+inline unsigned long millis() { return hostRealMicros() * HOST_TIME_SCALE / 1000; }
+inline unsigned long micros() { return hostRealMicros() * HOST_TIME_SCALE; }
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::microseconds(ms * 1000 / HOST_TIME_SCALE)); }
+
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+class __FlashStringHelper;
+
+class String
+{
+public:
+    String() {}
+    String(const char *s) : s_(s ? s : "") {}
+    String(const std::string &s) : s_(s) {}
+    String(const __FlashStringHelper *s) : String((const char *)s) {}
+    explicit String(char c) : s_(1, c) {}
+    explicit String(int v) : s_(std::to_string(v)) {}
+    explicit String(unsigned int v) : s_(std::to_string(v)) {}
+    explicit String(long v) : s_(std::to_string(v)) {}
+    explicit String(unsigned long v) : s_(std::to_string(v)) {}
+    explicit String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+    explicit String(double v, unsigned int decimals = 2)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        s_ = buf;
+    }
+    const char *c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    bool reserve(unsigned int size) { s_.reserve(size); return true; }
+    long toInt() const { return atol(s_.c_str()); }
+    float toFloat() const { return atof(s_.c_str()); }
+    void trim()
+    {
+        size_t b = s_.find_first_not_of(" \t\r\n\v\f");
+        size_t e = s_.find_last_not_of(" \t\r\n\v\f");
+        s_ = b == std::string::npos ? "" : s_.substr(b, e - b + 1);
+    }
+    bool concat(const char *s, unsigned int len) { s_.append(s, len); return true; }
+    bool concat(const char *s) { s_ += s; return true; }
+    bool concat(const String &s) { s_ += s.s_; return true; }
+    bool concat(char c) { s_ += c; return true; }
+    bool concat(int v) { s_ += std::to_string(v); return true; }
+    bool concat(unsigned int v) { s_ += std::to_string(v); return true; }
+    bool concat(long v) { s_ += std::to_string(v); return true; }
+    bool concat(unsigned long v) { s_ += std::to_string(v); return true; }
+    String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        return from < s_.size() ? String(s_.substr(from, to - from)) : String();
+    }
+    int indexOf(char c, unsigned int from = 0) const { return found(s_.find(c, from)); }
+    int indexOf(const char *s, unsigned int from = 0) const { return found(s_.find(s, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return found(s_.find(s.s_, from)); }
+    int lastIndexOf(char c) const { return found(s_.rfind(c)); }
+    int lastIndexOf(const String &s) const { return found(s_.rfind(s.s_)); }
+    void replace(const String &from, const String &to)
+    {
+        if (from.s_.empty()) {
+            return;
+        }
+        for (size_t i = s_.find(from.s_); i != std::string::npos; i = s_.find(from.s_, i + to.s_.size())) {
+            s_.replace(i, from.s_.size(), to.s_);
+        }
+    }
+    void remove(unsigned int index) { if (index < s_.size()) s_.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s_.size()) s_.erase(index, count); }
+    bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+    bool endsWith(const String &p) const
+    {
+        return p.s_.size() <= s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+    }
+    bool equals(const String &o) const { return s_ == o.s_; }
+    bool equals(const char *o) const { return s_ == o; }
+    bool equalsIgnoreCase(const String &o) const
+    {
+        return s_.size() == o.s_.size() && strncasecmp(s_.c_str(), o.s_.c_str(), s_.size()) == 0;
+    }
+    void toLowerCase() { for (char &c : s_) c = tolower((unsigned char)c); }
+    void toUpperCase() { for (char &c : s_) c = toupper((unsigned char)c); }
+    char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char &operator[](unsigned int i) { return s_[i]; }
+    void getBytes(unsigned char *buf, unsigned int size) const
+    {
+        strlcpy((char *)buf, s_.c_str(), size);
+    }
+    explicit operator bool() const { return true; }
+    template <typename T> String &operator+=(const T &o) { concat(o); return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.s_); }
+    friend String operator+(const String &a, char b) { return String(a.s_ + b); }
+    friend String operator+(const String &a, int b) { return String(a.s_ + std::to_string(b)); }
+    friend String operator+(const String &a, unsigned int b) { return String(a.s_ + std::to_string(b)); }
+    friend String operator+(const String &a, long b) { return String(a.s_ + std::to_string(b)); }
+    friend String operator+(const String &a, unsigned long b) { return String(a.s_ + std::to_string(b)); }
+    bool operator==(const char *o) const { return s_ == o; }
+    bool operator==(const String &o) const { return s_ == o.s_; }
+    bool operator!=(const char *o) const { return s_ != o; }
+    bool operator!=(const String &o) const { return s_ != o.s_; }
+    bool operator<(const String &o) const { return s_ < o.s_; }
+
+private:
+    static int found(size_t i) { return i == std::string::npos ? -1 : (int)i; }
+    std::string s_;
+};
+
+// Flash strings are ordinary strings on a PC
+#define F(s) ((const __FlashStringHelper *)(s))
+#define FPSTR(s) ((const __FlashStringHelper *)(s))
+#define PSTR(s) (s)
+#define PROGMEM
+#define PGM_P const char *
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define vsnprintf_P vsnprintf
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define ets_printf printf
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *data, size_t len)
+    {
+        size_t n = 0;
+        while (len-- && write(*data++)) {
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        return n > 0 ? write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1) : 0;
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t n = 0;
+        int c;
+        while (n < length && (c = read()) >= 0) {
+            buffer[n++] = c;
+        }
+        return n;
+    }
+};
+
+class HostSerial
+{
+public:
+    void begin(unsigned long) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    String readStringUntil(char) { return String(); }
+    void print(const char *s) { printf("%s", s); }
+    void print(const String &s) { printf("%s", s.c_str()); }
+    void println(const char *s = "") { printf("%s\n", s); }
+    void println(const String &s) { printf("%s\n", s.c_str()); }
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        if (quiet) {
+            return 0;
+        }
+        va_list args;
+        va_start(args, format);
+        int n = vprintf(format, args);
+        va_end(args);
+        return n;
+    }
+    bool quiet = false;
+};
+inline HostSerial Serial;
+
+class HostEsp
+{
+public:
+    uint64_t getEfuseMac() { return 0x123456789ABCull << 8; }
+    void restart() { exit(0); }
+};
+inline HostEsp ESP;
+
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0) : address_(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address_(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    operator uint32_t() const { return address_; }
+    bool operator==(const IPAddress &o) const { return address_ == o.address_; }
+    bool operator!=(const IPAddress &o) const { return address_ != o.address_; }
+
+private:
+    uint32_t address_;
+};
+
+// FreeRTOS
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+struct portMUX_TYPE
+{
+    std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+#define portENTER_CRITICAL_ISR(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL_ISR(mux) (mux)->mutex.unlock()
+
+inline int xTaskCreatePinnedToCore(void (*task)(void *), const char *, uint32_t, void *parameter, unsigned int,
+                                   TaskHandle_t *handle, int)
+{
+    std::thread thread(task, parameter);
+    if (handle) {
+        *handle = (TaskHandle_t)1;
+    }
+    thread.detach();
+    return 1;
+}
+
+// Binary semaphores, as used by the web server's locks
+#define portMAX_DELAY 0xffffffffu
+struct HostSemaphore
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool given = false;
+};
+typedef HostSemaphore *SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new HostSemaphore; }
+inline void vSemaphoreDelete(SemaphoreHandle_t s) { delete s; }
+inline int xSemaphoreGive(SemaphoreHandle_t s)
+{
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->given = true;
+    s->ready.notify_one();
+    return 1;
+}
+inline int xSemaphoreTake(SemaphoreHandle_t s, TickType_t)
+{
+    std::unique_lock<std::mutex> lock(s->mutex);
+    s->ready.wait(lock, [s] { return s->given; });
+    s->given = false;
+    return 1;
+}
+// The running task as seen by those locks; the web server tests drive it from one thread
+inline char hostTaskControlBlock;
+inline void *pxCurrentTCB = &hostTaskControlBlock;
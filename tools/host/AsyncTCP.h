@@ -0,0 +1,115 @@
+#pragma once
+
+// Host stand-in for AsyncTCP. Nothing touches the network: a test hands the last server that
+// registered a client handler a connection through AsyncServer::listening()->accept(), feeds
+// it bytes with receive(), and reads what the server sent from output. The send window is
+// `window` bytes and only drains when the test acks.
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "Arduino.h"
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+
+class AsyncClient;
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, size_t, uint32_t)> AcAckHandler;
+typedef std::function<void(void *, AsyncClient *, int8_t)> AcErrorHandler;
+typedef std::function<void(void *, AsyncClient *, void *, size_t)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t)> AcTimeoutHandler;
+
+class AsyncClient
+{
+public:
+    void onConnect(AcConnectHandler cb, void *arg = nullptr) { (void)cb; (void)arg; }
+    void onDisconnect(AcConnectHandler cb, void *arg = nullptr) { discardCb_ = cb; discardArg_ = arg; }
+    void onAck(AcAckHandler cb, void *arg = nullptr) { ackCb_ = cb; ackArg_ = arg; }
+    void onError(AcErrorHandler cb, void *arg = nullptr) { (void)cb; (void)arg; }
+    void onData(AcDataHandler cb, void *arg = nullptr) { dataCb_ = cb; dataArg_ = arg; }
+    void onTimeout(AcTimeoutHandler cb, void *arg = nullptr) { (void)cb; (void)arg; }
+    void onPoll(AcConnectHandler cb, void *arg = nullptr) { pollCb_ = cb; pollArg_ = arg; }
+
+    size_t space() const { return connected_ ? window - inFlight : 0; }
+    bool canSend() const { return space() > 0; }
+    size_t add(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY)
+    {
+        (void)apiflags;
+        size_t n = std::min(std::min(size, space()), addLimit);
+        output.append(data, n);
+        inFlight += n;
+        return n;
+    }
+    bool send() { return connected_; }
+    size_t write(const char *data) { return write(data, strlen(data)); }
+    size_t write(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY)
+    {
+        return add(data, size, apiflags);
+    }
+    void close(bool now = false) { (void)now; connected_ = false; }
+    bool connected() const { return connected_; }
+    bool free() const { return !connected_; }
+    size_t packetsWaiting() const { return 0; }
+    void ackLater() {}
+    void setRxTimeout(uint32_t timeout) { (void)timeout; }
+    void setNoDelay(bool nodelay) { (void)nodelay; }
+    IPAddress localIP() const { return IPAddress(192, 168, 4, 1); }
+    IPAddress remoteIP() const { return IPAddress(192, 168, 4, 2); }
+    uint16_t remotePort() const { return 50000; }
+    const char *stateToString() const { return connected_ ? "Connected" : "Closed"; }
+
+    // Test side
+    void receive(const char *data, size_t len) { dataCb_(dataArg_, this, (void *)data, len); }
+    void ack()
+    {
+        size_t len = inFlight;
+        inFlight = 0;
+        if (ackCb_ && len) {
+            ackCb_(ackArg_, this, len, 1);
+        }
+    }
+    void poll() { if (pollCb_) pollCb_(pollArg_, this); }
+    // The server's disconnect handler deletes the client
+    void disconnect() { connected_ = false; discardCb_(discardArg_, this); }
+
+    std::string output;
+    size_t window = 5744;
+    size_t addLimit = SIZE_MAX; // most bytes one add() takes, to mimic lwIP running short of pbufs
+    size_t inFlight = 0;
+
+private:
+    bool connected_ = true;
+    AcConnectHandler discardCb_, pollCb_;
+    AcAckHandler ackCb_;
+    AcDataHandler dataCb_;
+    void *discardArg_ = nullptr, *ackArg_ = nullptr, *dataArg_ = nullptr, *pollArg_ = nullptr;
+};
+
+class AsyncServer
+{
+public:
+    explicit AsyncServer(uint16_t port) { (void)port; }
+    void onClient(AcConnectHandler cb, void *arg)
+    {
+        connectCb_ = cb;
+        connectArg_ = arg;
+        last() = this;
+    }
+    void begin() {}
+    void end() {}
+    void setNoDelay(bool nodelay) { (void)nodelay; }
+
+    // Test side
+    static AsyncServer *listening() { return last(); }
+    void accept(AsyncClient *client) { connectCb_(connectArg_, client); }
+
+private:
+    static AsyncServer *&last()
+    {
+        static AsyncServer *server = nullptr;
+        return server;
+    }
+
+    AcConnectHandler connectCb_;
+    void *connectArg_ = nullptr;
+};
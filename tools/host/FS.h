@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for the Arduino file system API. Nothing is ever stored, so every open fails
+// and the web server's static and file responses answer 404.
+#include "Arduino.h"
+
+namespace fs
+{
+class File : public Stream
+{
+public:
+    operator bool() const { return false; }
+    size_t write(uint8_t) override { return 0; }
+    size_t write(const uint8_t *, size_t) override { return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t read(uint8_t *, size_t) { return 0; }
+    size_t size() const { return 0; }
+    const char *name() const { return ""; }
+    bool isDirectory() const { return false; }
+    void close() {}
+};
+
+class FS
+{
+public:
+    File open(const String &, const char * = "r") { return File(); }
+    bool exists(const String &) { return false; }
+};
+}
@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in: only the type is needed by config.hpp
+class HX711
+{
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+// In-memory stand-in for the ESP32 Preferences (NVS) library
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false)
+    {
+        ns_ = name;
+        readOnly_ = readOnly;
+        return true;
+    }
+    void end() {}
+    bool clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto &all = store();
+        for (auto it = all.begin(); it != all.end();) {
+            it = it->first.compare(0, ns_.size() + 1, ns_ + "/") == 0 ? all.erase(it) : std::next(it);
+        }
+        return true;
+    }
+
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        if (readOnly_) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(mutex());
+        store()[ns_ + "/" + key].assign((const uint8_t *)value, (const uint8_t *)value + len);
+        return len;
+    }
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto it = store().find(ns_ + "/" + key);
+        if (it == store().end() || it->second.size() > maxLen) {
+            return 0;
+        }
+        memcpy(buf, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putString(const char *key, const char *value) { return putBytes(key, value, strlen(value) + 1); }
+    size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+    size_t getString(const char *key, char *value, size_t maxLen)
+    {
+        size_t len = getBytes(key, value, maxLen);
+        if (len == 0 && maxLen) {
+            value[0] = '\0';
+        }
+        return len;
+    }
+    String getString(const char *key, const String &defaultValue = String())
+    {
+        char buf[256];
+        return getString(key, buf, sizeof(buf)) ? String(buf) : defaultValue;
+    }
+
+    size_t putBool(const char *key, bool value) { return putValue(key, value); }
+    bool getBool(const char *key, bool defaultValue = false) { return getValue(key, defaultValue); }
+    size_t putUChar(const char *key, uint8_t value) { return putValue(key, value); }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putUShort(const char *key, uint16_t value) { return putValue(key, value); }
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putInt(const char *key, int32_t value) { return putValue(key, value); }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putUInt(const char *key, uint32_t value) { return putValue(key, value); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    size_t putDouble(const char *key, double value) { return putValue(key, value); }
+    double getDouble(const char *key, double defaultValue = 0) { return getValue(key, defaultValue); }
+
+private:
+    template <typename T> size_t putValue(const char *key, T value) { return putBytes(key, &value, sizeof(value)); }
+    template <typename T> T getValue(const char *key, T defaultValue)
+    {
+        T value;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+    static std::map<std::string, std::vector<uint8_t>> &store()
+    {
+        static std::map<std::string, std::vector<uint8_t>> all;
+        return all;
+    }
+    static std::mutex &mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    std::string ns_;
+    bool readOnly_ = false;
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+// Host stand-in for PubSubClient with the same publishing behaviour: MQTT 3.1.1, clean session,
+// QoS 0 publish only, and publish() returns true once the packet was written to the socket.
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+class PubSubClient
+{
+public:
+    explicit PubSubClient(WiFiClient &client) : client_(client) {}
+
+    PubSubClient &setServer(const char *domain, uint16_t port)
+    {
+        domain_ = domain;
+        port_ = port;
+        return *this;
+    }
+    bool setBufferSize(uint16_t size)
+    {
+        bufferSize_ = size;
+        return true;
+    }
+    PubSubClient &setSocketTimeout(uint16_t seconds)
+    {
+        socketTimeout_ = seconds;
+        return *this;
+    }
+
+    bool connect(const char *id)
+    {
+        if (!client_.connect(domain_, port_)) {
+            state_ = MQTT_CONNECT_FAILED;
+            return false;
+        }
+        std::vector<uint8_t> body = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 15}; // clean session, 15 s keep-alive
+        appendString(body, id);
+        if (!writePacket(0x10, body)) {
+            state_ = MQTT_CONNECT_FAILED;
+            return false;
+        }
+        uint8_t header;
+        std::vector<uint8_t> reply;
+        if (!readPacket(header, reply, socketTimeout_ * 1000) || header != 0x20 || reply.size() != 2 || reply[1] != 0) {
+            client_.stop();
+            state_ = MQTT_CONNECT_FAILED;
+            return false;
+        }
+        state_ = MQTT_CONNECTED;
+        return true;
+    }
+
+    bool connected()
+    {
+        if (state_ == MQTT_CONNECTED && !client_.connected()) {
+            state_ = MQTT_CONNECTION_LOST;
+        }
+        return state_ == MQTT_CONNECTED;
+    }
+
+    void disconnect()
+    {
+        if (state_ == MQTT_CONNECTED) {
+            writePacket(0xE0, {});
+        }
+        client_.stop();
+        state_ = MQTT_DISCONNECTED;
+    }
+
+    bool publish(const char *topic, const char *payload, bool retained = false)
+    {
+        if (!connected()) {
+            return false;
+        }
+        std::vector<uint8_t> body;
+        appendString(body, topic);
+        body.insert(body.end(), payload, payload + strlen(payload));
+        if (body.size() + 5 > bufferSize_) {
+            return false;
+        }
+        return writePacket(0x30 | (retained ? 1 : 0), body);
+    }
+
+    // Drains whatever the broker sent (PINGRESP) and notices a closed connection
+    bool loop()
+    {
+        if (!connected()) {
+            return false;
+        }
+        while (client_.available()) {
+            uint8_t header;
+            std::vector<uint8_t> body;
+            if (!readPacket(header, body, socketTimeout_ * 1000)) {
+                break;
+            }
+        }
+        return connected();
+    }
+
+    int state() { return state_; }
+
+private:
+    static void appendString(std::vector<uint8_t> &out, const char *s)
+    {
+        size_t len = strlen(s);
+        out.push_back(len >> 8);
+        out.push_back(len & 0xFF);
+        out.insert(out.end(), s, s + len);
+    }
+
+    bool writePacket(uint8_t header, const std::vector<uint8_t> &body)
+    {
+        std::vector<uint8_t> packet = {header};
+        size_t len = body.size();
+        do {
+            uint8_t digit = len % 128;
+            len /= 128;
+            packet.push_back(len ? digit | 0x80 : digit);
+        } while (len);
+        packet.insert(packet.end(), body.begin(), body.end());
+        return client_.write(packet.data(), packet.size()) == packet.size();
+    }
+
+    int readByte(unsigned long timeoutMs)
+    {
+        unsigned long start = hostRealMicros() / 1000;
+        while (!client_.available()) {
+            if (!client_.connected() || hostRealMicros() / 1000 - start > timeoutMs) {
+                return -1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return client_.read();
+    }
+
+    bool readPacket(uint8_t &header, std::vector<uint8_t> &body, unsigned long timeoutMs)
+    {
+        int b = readByte(timeoutMs);
+        if (b < 0) {
+            return false;
+        }
+        header = b;
+        size_t len = 0, shift = 0;
+        do {
+            if ((b = readByte(timeoutMs)) < 0) {
+                return false;
+            }
+            len |= (size_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        body.clear();
+        while (body.size() < len) {
+            if ((b = readByte(timeoutMs)) < 0) {
+                return false;
+            }
+            body.push_back(b);
+        }
+        return true;
+    }
+
+    WiFiClient &client_;
+    const char *domain_ = nullptr;
+    uint16_t port_ = 1883;
+    size_t bufferSize_ = 256;
+    uint16_t socketTimeout_ = 15;
+    int state_ = MQTT_DISCONNECTED;
+};
@@ -0,0 +1,2 @@
+#pragma once
+// Host stand-in: nothing from this library is used by the modules built on a PC
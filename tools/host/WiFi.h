@@ -0,0 +1,108 @@
+#pragma once
+
+// Host stand-in for the ESP32 WiFi library: the station is always connected and WiFiClient
+// is a plain blocking TCP socket.
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class HostWiFi
+{
+public:
+    int status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(192, 168, 4, 1); }
+};
+inline HostWiFi WiFi;
+
+class WiFiClient
+{
+public:
+    ~WiFiClient() { stop(); }
+
+    int connect(const char *host, uint16_t port)
+    {
+        stop();
+        addrinfo hints = {}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        char service[8];
+        snprintf(service, sizeof(service), "%u", port);
+        if (getaddrinfo(host, service, &hints, &res) != 0) {
+            return 0;
+        }
+        fd_ = socket(res->ai_family, res->ai_socktype, 0);
+        if (fd_ >= 0 && ::connect(fd_, res->ai_addr, res->ai_addrlen) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        freeaddrinfo(res);
+        if (fd_ >= 0) {
+            int one = 1;
+            setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd_ >= 0;
+    }
+    size_t write(const uint8_t *buf, size_t size)
+    {
+        if (fd_ < 0) {
+            return 0;
+        }
+        ssize_t n = send(fd_, buf, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            stop();
+            return 0;
+        }
+        return n;
+    }
+    // Bytes waiting; also notices a peer that closed the connection
+    int available()
+    {
+        if (fd_ < 0) {
+            return 0;
+        }
+        pollfd p = {fd_, POLLIN, 0};
+        if (poll(&p, 1, 0) <= 0) {
+            return 0;
+        }
+        uint8_t b;
+        ssize_t n = recv(fd_, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n <= 0) {
+            stop();
+            return 0;
+        }
+        return 1;
+    }
+    int read()
+    {
+        uint8_t b;
+        if (fd_ < 0 || recv(fd_, &b, 1, 0) != 1) {
+            stop();
+            return -1;
+        }
+        return b;
+    }
+    uint8_t connected()
+    {
+        available();
+        return fd_ >= 0;
+    }
+    void stop()
+    {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+private:
+    int fd_ = -1;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for the ESP32 core's growable byte ring
+#include <string>
+#include "Arduino.h"
+
+class cbuf
+{
+public:
+    explicit cbuf(size_t size) : size_(size) {}
+    size_t available() const { return data_.size(); }
+    size_t room() const { return size_ - data_.size(); }
+    size_t resizeAdd(size_t add) { return size_ += add; }
+    size_t write(const char *src, size_t len)
+    {
+        len = len < room() ? len : room();
+        data_.append(src, len);
+        return len;
+    }
+    size_t read(char *dst, size_t len)
+    {
+        len = len < data_.size() ? len : data_.size();
+        memcpy(dst, data_.data(), len);
+        data_.erase(0, len);
+        return len;
+    }
+
+private:
+    size_t size_;
+    std::string data_;
+};
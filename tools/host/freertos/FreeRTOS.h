@@ -0,0 +1,3 @@
+#pragma once
+// The FreeRTOS stand-ins live in the host Arduino.h
+#include "../Arduino.h"
@@ -0,0 +1,368 @@
+// Runs the MQTT publisher (src/mqtt.cpp) on a PC against a stand-in broker that speaks the
+// MQTT 3.1.1 wire protocol, like mosquitto. Build and run:
+//
+//   g++ -std=gnu++17 -O2 -Iinclude -Itools/host tools/mqtt_test.cpp src/mqtt.cpp -lpthread -o mqtt_test
+//   ./mqtt_test          (add -v for the firmware's serial output)
+//
+// tools/host holds the Arduino, Preferences, WiFi and PubSubClient stand-ins. The clock runs
+// HOST_TIME_SCALE times faster than real time, so the reconnect and flush intervals are short.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "mqtt.hpp"
+
+// The publisher task calls this when the station is down; the host is always connected
+void connectToWiFi() {}
+
+struct Message
+{
+    std::string topic;
+    std::string payload;
+    bool retained;
+};
+
+// Accepts any number of clients, answers CONNECT, PINGREQ and QoS 1 PUBLISH, and records every
+// PUBLISH. stop() drops all connections and the listener, start() brings it back on the same port.
+class Broker
+{
+public:
+    ~Broker() { stop(); }
+
+    void start(uint16_t port)
+    {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(listener_, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener_, 4) != 0) {
+            perror("broker");
+            exit(2);
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listener_, (sockaddr *)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+        running_ = true;
+        acceptThread_ = std::thread(&Broker::acceptLoop, this);
+    }
+
+    void stop()
+    {
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        shutdown(listener_, SHUT_RDWR);
+        close(listener_);
+        acceptThread_.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (int fd : clients_) {
+                shutdown(fd, SHUT_RDWR);
+            }
+        }
+        for (std::thread &t : clientThreads_) {
+            t.join();
+        }
+        clientThreads_.clear();
+    }
+
+    uint16_t port() const { return port_; }
+    int connects() const { return connects_; }
+    int disconnects() const { return disconnects_; }
+
+    std::vector<Message> messages()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_;
+    }
+    std::vector<Message> messages(const std::string &suffix)
+    {
+        std::vector<Message> out;
+        for (const Message &m : messages()) {
+            if (m.topic.size() >= suffix.size() && m.topic.compare(m.topic.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                out.push_back(m);
+            }
+        }
+        return out;
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        messages_.clear();
+    }
+
+private:
+    void acceptLoop()
+    {
+        while (running_) {
+            int fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0) {
+                break;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            clients_.push_back(fd);
+            clientThreads_.emplace_back(&Broker::serve, this, fd);
+        }
+    }
+
+    static bool readAll(int fd, uint8_t *buf, size_t len)
+    {
+        while (len) {
+            ssize_t n = recv(fd, buf, len, 0);
+            if (n <= 0) {
+                return false;
+            }
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void serve(int fd)
+    {
+        for (;;) {
+            uint8_t header, b;
+            if (!readAll(fd, &header, 1)) {
+                break;
+            }
+            size_t len = 0, shift = 0;
+            do {
+                if (!readAll(fd, &b, 1)) {
+                    goto closed;
+                }
+                len |= (size_t)(b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            std::vector<uint8_t> body(len);
+            if (len && !readAll(fd, body.data(), len)) {
+                break;
+            }
+
+            uint8_t type = header >> 4;
+            if (type == 1) { // CONNECT
+                const uint8_t connack[] = {0x20, 2, 0, 0};
+                send(fd, connack, sizeof(connack), MSG_NOSIGNAL);
+                connects_++;
+            } else if (type == 3) { // PUBLISH
+                uint8_t qos = (header >> 1) & 3;
+                size_t topicLen = body[0] << 8 | body[1];
+                size_t at = 2 + topicLen;
+                Message m = {std::string(body.begin() + 2, body.begin() + at), "", (header & 1) != 0};
+                if (qos) {
+                    const uint8_t puback[] = {0x40, 2, body[at], body[at + 1]};
+                    send(fd, puback, sizeof(puback), MSG_NOSIGNAL);
+                    at += 2;
+                }
+                m.payload.assign(body.begin() + at, body.end());
+                std::lock_guard<std::mutex> lock(mutex_);
+                messages_.push_back(m);
+            } else if (type == 12) { // PINGREQ
+                const uint8_t pingresp[] = {0xD0, 0};
+                send(fd, pingresp, sizeof(pingresp), MSG_NOSIGNAL);
+            } else if (type == 14) { // DISCONNECT
+                disconnects_++;
+                break;
+            }
+        }
+    closed:
+        std::lock_guard<std::mutex> lock(mutex_);
+        clients_.erase(std::remove(clients_.begin(), clients_.end(), fd), clients_.end());
+        close(fd);
+    }
+
+    int listener_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> running_{false};
+    std::atomic<int> connects_{0};
+    std::atomic<int> disconnects_{0};
+    std::thread acceptThread_;
+    std::vector<std::thread> clientThreads_;
+    std::vector<int> clients_;
+    std::vector<Message> messages_;
+    std::mutex mutex_;
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+// Polls for up to five seconds of real time
+static bool waitFor(const std::function<bool()> &condition)
+{
+    for (int i = 0; i < 500; i++) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+static bool statusHas(const char *field)
+{
+    return strstr(mqttStatusJson().c_str(), field) != nullptr;
+}
+
+// Samples of all weight messages, in the order they were published
+static std::vector<double> samples(Broker &broker)
+{
+    std::vector<double> out;
+    for (const Message &m : broker.messages("/weight")) {
+        const char *p = m.payload.c_str();
+        unsigned long at;
+        double weight;
+        int used;
+        while ((p = strchr(p, '[')) != nullptr) {
+            if (sscanf(p, "[%lu,%lf]%n", &at, &weight, &used) == 2) {
+                out.push_back(weight);
+                p += used;
+            } else {
+                p++;
+            }
+        }
+    }
+    return out;
+}
+
+static bool contains(const std::string &s, const char *part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+static void waitDisconnected()
+{
+    check(waitFor([] { return statusHas("\"connected\":false"); }), "publisher notices the broker is gone");
+}
+
+int main(int argc, char **argv)
+{
+    Serial.quiet = !(argc > 1 && strcmp(argv[1], "-v") == 0);
+    Broker broker;
+    broker.start(0);
+
+    // Nothing configured: no task, publishing is a no-op
+    setupMqtt();
+    mqttPublishShot(18, 18, 1000, 0, GRIND_RESULT_OK);
+    check(statusHas("\"enabled\":false"), "publisher disabled without a broker host");
+
+    // Hosts that would break the status JSON are refused
+    check(!mqttConfigure("bad\"host", 1883, false) && !mqttConfigure("bad\\host", 1883, false) &&
+              statusHas("\"enabled\":false"),
+          "host with a quote or backslash rejected");
+
+    // Configured at run time
+    mqttConfigure("127.0.0.1", broker.port(), true);
+    check(waitFor([&] { return broker.connects() == 1 && statusHas("\"connected\":true"); }), "connects after mqttConfigure()");
+
+    // Shot summary
+    mqttPublishShot(18, 18.1, 9500, -1.5, GRIND_RESULT_OK);
+    check(waitFor([&] { return broker.messages("/shot").size() == 1; }), "shot summary published");
+    std::vector<Message> shots = broker.messages("/shot");
+    if (!shots.empty()) {
+        const Message &shot = shots[0];
+        check(shot.topic.rfind("opengbw/", 0) == 0, "shot topic is opengbw/<id>/shot");
+        check(shot.retained, "shot summary is retained");
+        check(contains(shot.payload, "\"target\":18.00") && contains(shot.payload, "\"actual\":18.10") &&
+                  contains(shot.payload, "\"time\":9.50") && contains(shot.payload, "\"offset\":-1.50") &&
+                  contains(shot.payload, "\"result\":\"ok\""),
+              "shot payload fields");
+    }
+
+    // Telemetry is decimated
+    for (int i = 0; i < 30; i++) {
+        mqttPublishWeight(i);
+    }
+    check(waitFor([&] { return samples(broker).size() == 3; }), "every 10th weight sample published");
+    check(samples(broker) == std::vector<double>({9, 19, 29}), "decimated samples in order");
+    check(!broker.messages("/weight").empty() && !broker.messages("/weight")[0].retained, "telemetry is not retained");
+
+    // Outage: records wait in RAM and are flushed in order, samples in batches
+    broker.clear();
+    broker.stop();
+    waitDisconnected();
+    for (int i = 1; i <= 5; i++) {
+        mqttPublishShot(i, i, 1000, 0, GRIND_RESULT_NO_FLOW);
+    }
+    for (int i = 0; i < 200; i++) {
+        mqttPublishWeight(100 + i);
+    }
+    delay(3 * MQTT_RECONNECT_INTERVAL);
+    check(statusHas("\"queued\":25"), "records queued during the outage");
+    broker.start(broker.port());
+    check(waitFor([&] { return broker.messages("/shot").size() == 5 && samples(broker).size() == 20; }), "queue flushed after reconnect");
+    shots = broker.messages("/shot");
+    bool inOrder = shots.size() == 5;
+    for (size_t i = 0; inOrder && i < shots.size(); i++) {
+        char expect[32];
+        snprintf(expect, sizeof(expect), "\"target\":%zu.00", i + 1);
+        inOrder = contains(shots[i].payload, expect) && contains(shots[i].payload, "\"result\":\"no_flow\"");
+    }
+    check(inOrder, "shots flushed in order");
+    std::vector<double> flushed = samples(broker);
+    check(std::is_sorted(flushed.begin(), flushed.end()), "samples flushed in order");
+    check(broker.messages("/weight").size() <= (20 + MQTT_BURST_SIZE - 1) / MQTT_BURST_SIZE + 1, "samples batched per burst");
+    check(statusHas("\"queued\":0") && statusHas("\"dropped\":0"), "queue drained, nothing dropped");
+
+    // Overflow: telemetry stops at the headroom, shots fill the rest, the excess is dropped
+    broker.clear();
+    broker.stop();
+    waitDisconnected();
+    for (int i = 0; i < 1000; i++) {
+        mqttPublishWeight(i);
+    }
+    for (int i = 0; i < 20; i++) {
+        mqttPublishShot(i, i, 1000, 0, GRIND_RESULT_OK);
+    }
+    char expect[64];
+    snprintf(expect, sizeof(expect), "\"queued\":%d", MQTT_QUEUE_SIZE);
+    check(statusHas(expect), "queue full");
+    snprintf(expect, sizeof(expect), "\"dropped\":%d", 100 - (MQTT_QUEUE_SIZE - MQTT_TELEMETRY_HEADROOM) + 20 - MQTT_TELEMETRY_HEADROOM);
+    check(statusHas(expect), "overflow counted");
+    broker.start(broker.port());
+    check(waitFor([&] { return broker.messages("/shot").size() == MQTT_TELEMETRY_HEADROOM &&
+                               samples(broker).size() == MQTT_QUEUE_SIZE - MQTT_TELEMETRY_HEADROOM; }),
+          "headroom kept for shot summaries");
+
+    // Disabled again at run time
+    int disconnects = broker.disconnects();
+    mqttConfigure("", 0, false);
+    check(waitFor([&] { return statusHas("\"enabled\":false") && broker.disconnects() == disconnects + 1; }), "disabled without a reboot");
+    broker.clear();
+    mqttPublishShot(18, 18, 1000, 0, GRIND_RESULT_OK);
+    delay(2 * MQTT_FLUSH_INTERVAL);
+    check(broker.messages().empty(), "nothing published while disabled");
+
+    // Moved to another broker, telemetry off
+    Broker other;
+    other.start(0);
+    mqttConfigure("127.0.0.1", other.port(), false);
+    check(waitFor([&] { return other.connects() == 1 && statusHas("\"connected\":true"); }), "connects to the new broker");
+    for (int i = 0; i < 30; i++) {
+        mqttPublishWeight(i);
+    }
+    mqttPublishShot(20, 20.2, 1000, 0, GRIND_RESULT_ABORTED);
+    check(waitFor([&] { return other.messages("/shot").size() == 1; }), "shot published to the new broker");
+    check(other.messages("/weight").empty(), "no telemetry when it is off");
+
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    // The publisher task never returns; leave without joining it
+    fflush(stdout);
+    _exit(failures ? 1 : 0);
+}
@@ -0,0 +1,599 @@
+// Checks the web server's in-place request parser against the one it replaced. Random requests
+// are cut into random packets and fed both to the real parser (lib/ESPAsyncWebServer-master) and
+// to OldRequest below, the previous parser carried over line for line. Everything a handler can
+// read back is compared. Build and run:
+//
+//   L=lib/ESPAsyncWebServer-master/src
+//   g++ -std=gnu++17 -O2 -DESP32 -I$L -Itools/host tools/web_parser_fuzz.cpp $L/WebRequest.cpp $L/WebResponses.cpp $L/WebServer.cpp $L/WebHandlers.cpp -lpthread -o web_parser_fuzz
+//   ./web_parser_fuzz [requests] [seed]
+//
+// One difference is intended: a header line without a colon used to be stored with the whole
+// line as its name and all but its first character as its value, and was matched against Host,
+// Content-Length and the other headers the parser acts on. It is now skipped. OldRequest skips
+// it too, and the run reports how many such lines it sent.
+//
+// Requests stay within the header, parameter and arena limits; the answers to requests past
+// them are checked by web_request_bench.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ESPAsyncWebServer.h>
+
+// The parser only calls into authentication for handlers that ask for it
+bool checkBasicAuthentication(const char *, const char *, const char *) { return false; }
+String requestDigestAuthentication(const char *) { return String(); }
+bool checkDigestAuthentication(const char *, const char *, const char *, const char *, const char *, bool,
+                               const char *, const char *, const char *)
+{
+    return false;
+}
+
+#define __is_param_char(c) ((c) && ((c) != '{') && ((c) != '[') && ((c) != '&') && ((c) != '='))
+
+enum { PARSE_REQ_START, PARSE_REQ_HEADERS, PARSE_REQ_BODY, PARSE_REQ_END, PARSE_REQ_FAIL };
+
+struct Field
+{
+    std::string name, value;
+    bool post;
+    bool operator==(const Field &o) const { return name == o.name && value == o.value && post == o.post; }
+};
+
+// What a handler can read back from a request
+struct Parsed
+{
+    bool handled = false;
+    int method = HTTP_ANY;
+    uint8_t version = 0;
+    std::string url, host, contentType;
+    size_t contentLength = 0;
+    int connType = RCT_DEFAULT;
+    bool expectingContinue = false;
+    std::string basicAuth; // Basic credentials the request accepts, if any
+    std::vector<Field> headers, params;
+};
+
+// The previous parser: AsyncWebServerRequest::_onData and the functions it called before
+// the in-place rewrite, cut down to the state they touch. The body of a multipart request
+// is not covered; its parser did not change.
+class OldRequest
+{
+public:
+    Parsed parsed;
+    unsigned colonless = 0;
+
+    void onData(void *buf, size_t len)
+    {
+        size_t i = 0;
+        while (true) {
+
+        if(_parseState < PARSE_REQ_BODY){
+          // Find new line in buf
+          char *str = (char*)buf;
+          for (i = 0; i < len; i++) {
+            if (str[i] == '\n') {
+              break;
+            }
+          }
+          if (i == len) { // No new line, just add the buffer in _temp
+            char ch = str[len-1];
+            str[len-1] = 0;
+            _temp.reserve(_temp.length()+len);
+            _temp.concat(str);
+            _temp.concat(ch);
+          } else { // Found new line - extract it and parse
+            str[i] = 0; // Terminate the string at the end of the line.
+            _temp.concat(str);
+            _temp.trim();
+            _parseLine();
+            if (++i < len) {
+              // Still have more buffer to process
+              buf = str+i;
+              len-= i;
+              continue;
+            }
+          }
+        } else if(_parseState == PARSE_REQ_BODY){
+          if(_parsedLength == 0){
+            if(_contentType.startsWith("application/x-www-form-urlencoded")){
+              _isPlainPost = true;
+            } else if(_contentType == "text/plain" && __is_param_char(((char*)buf)[0])){
+              size_t i = 0;
+              while (i<len && __is_param_char(((char*)buf)[i++]));
+              if(i < len && ((char*)buf)[i-1] == '='){
+                _isPlainPost = true;
+              }
+            }
+          }
+          if(!_isPlainPost) {
+            _parsedLength += len;
+          } else {
+            size_t i;
+            for(i=0; i<len; i++){
+              _parsedLength++;
+              _parsePlainPostChar(((uint8_t*)buf)[i]);
+            }
+          }
+          if(_parsedLength == _contentLength){
+            _parseState = PARSE_REQ_END;
+            handleRequest();
+          }
+        }
+        break;
+        }
+    }
+
+private:
+    String _temp, _url, _host, _contentType, _boundary, _authorization;
+    uint8_t _parseState = PARSE_REQ_START;
+    uint8_t _version = 0;
+    int _method = HTTP_ANY;
+    RequestedConnectionType _reqconntype = RCT_HTTP;
+    bool _isDigest = false, _isMultipart = false, _isPlainPost = false, _expectingContinue = false;
+    size_t _contentLength = 0, _parsedLength = 0;
+
+    void _addParam(const String &name, const String &value, bool form = false)
+    {
+        parsed.params.push_back({name.c_str(), value.c_str(), form});
+    }
+
+    void _addGetParams(const String& params){
+      size_t start = 0;
+      while (start < params.length()){
+        int end = params.indexOf('&', start);
+        if (end < 0) end = params.length();
+        int equal = params.indexOf('=', start);
+        if (equal < 0 || equal > end) equal = end;
+        String name = params.substring(start, equal);
+        String value = equal + 1 < end ? params.substring(equal + 1, end) : String();
+        _addParam(urlDecode(name), urlDecode(value));
+        start = end + 1;
+      }
+    }
+
+    bool _parseReqHead(){
+      // Split the head into method, url and version
+      int index = _temp.indexOf(' ');
+      String m = _temp.substring(0, index);
+      index = _temp.indexOf(' ', index+1);
+      String u = _temp.substring(m.length()+1, index);
+      _temp = _temp.substring(index+1);
+
+      if(m == "GET"){
+        _method = HTTP_GET;
+      } else if(m == "POST"){
+        _method = HTTP_POST;
+      } else if(m == "DELETE"){
+        _method = HTTP_DELETE;
+      } else if(m == "PUT"){
+        _method = HTTP_PUT;
+      } else if(m == "PATCH"){
+        _method = HTTP_PATCH;
+      } else if(m == "HEAD"){
+        _method = HTTP_HEAD;
+      } else if(m == "OPTIONS"){
+        _method = HTTP_OPTIONS;
+      }
+
+      String g = String();
+      index = u.indexOf('?');
+      if(index > 0){
+        g = u.substring(index +1);
+        u = u.substring(0, index);
+      }
+      _url = urlDecode(u);
+      _addGetParams(g);
+
+      if(!_temp.startsWith("HTTP/1.0"))
+        _version = 1;
+
+      _temp = String();
+      return true;
+    }
+
+    static bool strContains(String src, String find, bool mindcase = true) {
+      int pos=0, i=0;
+      const int slen = src.length();
+      const int flen = find.length();
+
+      if (slen < flen) return false;
+      while (pos <= (slen - flen)) {
+        for (i=0; i < flen; i++) {
+          if (mindcase) {
+            if (src[pos+i] != find[i]) i = flen + 1; // no match
+          } else if (tolower(src[pos+i]) != tolower(find[i])) i = flen + 1; // no match
+        }
+        if (i == flen) return true;
+        pos++;
+      }
+      return false;
+    }
+
+    bool _parseReqHeader(){
+      int index = _temp.indexOf(':');
+      if(index < 0){ // the one intended difference, see the top of the file
+        colonless++;
+        _temp = String();
+        return true;
+      }
+      if(index){
+        String name = _temp.substring(0, index);
+        String value = _temp.substring(index + 2);
+        if(name.equalsIgnoreCase("Host")){
+          _host = value;
+        } else if(name.equalsIgnoreCase("Content-Type")){
+          _contentType = value.substring(0, value.indexOf(';'));
+          if (value.startsWith("multipart/")){
+            _boundary = value.substring(value.indexOf('=')+1);
+            _boundary.replace("\"","");
+            _isMultipart = true;
+          }
+        } else if(name.equalsIgnoreCase("Content-Length")){
+          _contentLength = atoi(value.c_str());
+        } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
+          _expectingContinue = true;
+        } else if(name.equalsIgnoreCase("Authorization")){
+          if(value.length() > 5 && value.substring(0,5).equalsIgnoreCase("Basic")){
+            _authorization = value.substring(6);
+          } else if(value.length() > 6 && value.substring(0,6).equalsIgnoreCase("Digest")){
+            _isDigest = true;
+            _authorization = value.substring(7);
+          }
+        } else {
+          if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
+            // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
+            _reqconntype = RCT_WS;
+          } else {
+            if(name.equalsIgnoreCase("Accept") && strContains(value, "text/event-stream", false)){
+              // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
+              _reqconntype = RCT_EVENT;
+            }
+          }
+        }
+        parsed.headers.push_back({name.c_str(), value.c_str(), false});
+      }
+      _temp = String();
+      return true;
+    }
+
+    void _parsePlainPostChar(uint8_t data){
+      if(data && (char)data != '&')
+        _temp += (char)data;
+      if(!data || (char)data == '&' || _parsedLength == _contentLength){
+        String name = "body";
+        String value = _temp;
+        if(!_temp.startsWith("{") && !_temp.startsWith("[") && _temp.indexOf('=') > 0){
+          name = _temp.substring(0, _temp.indexOf('='));
+          value = _temp.substring(_temp.indexOf('=') + 1);
+        }
+        _addParam(urlDecode(name), urlDecode(value), true);
+        _temp = String();
+      }
+    }
+
+    void _parseLine(){
+      if(_parseState == PARSE_REQ_START){
+        if(!_temp.length()){
+          _parseState = PARSE_REQ_FAIL;
+        } else {
+          _parseReqHead();
+          _parseState = PARSE_REQ_HEADERS;
+        }
+        return;
+      }
+
+      if(_parseState == PARSE_REQ_HEADERS){
+        if(!_temp.length()){
+          //end of headers
+          if(_contentLength){
+            _parseState = PARSE_REQ_BODY;
+          } else {
+            _parseState = PARSE_REQ_END;
+            handleRequest();
+          }
+        } else _parseReqHeader();
+      }
+    }
+
+    String urlDecode(const String& text) const {
+      char temp[] = "0x00";
+      unsigned int len = text.length();
+      unsigned int i = 0;
+      String decoded = String();
+      decoded.reserve(len); // Allocate the string internal buffer - never longer from source text
+      while (i < len){
+        char decodedChar;
+        char encodedChar = text.charAt(i++);
+        if ((encodedChar == '%') && (i + 1 < len)){
+          temp[2] = text.charAt(i++);
+          temp[3] = text.charAt(i++);
+          decodedChar = strtol(temp, NULL, 16);
+        } else if (encodedChar == '+') {
+          decodedChar = ' ';
+        } else {
+          decodedChar = encodedChar;  // normal ascii char
+        }
+        decoded.concat(decodedChar);
+      }
+      return decoded;
+    }
+
+    void handleRequest()
+    {
+        parsed.handled = true;
+        parsed.method = _method;
+        parsed.version = _version;
+        parsed.url = _url.c_str();
+        parsed.host = _host.c_str();
+        parsed.contentType = _contentType.c_str();
+        parsed.contentLength = _contentLength;
+        parsed.connType = _reqconntype;
+        parsed.expectingContinue = _expectingContinue;
+        if (!_isDigest) {
+            parsed.basicAuth = _authorization.c_str();
+        }
+    }
+};
+
+static Parsed seen;
+static AsyncWebServerRequest *lastRequest;
+
+static void onRequest(AsyncWebServerRequest *request)
+{
+    lastRequest = request;
+    seen.handled = true;
+    seen.method = request->method();
+    seen.version = request->version();
+    seen.url = request->url().c_str();
+    seen.host = request->host().c_str();
+    seen.contentType = request->contentType().c_str();
+    seen.contentLength = request->contentLength();
+    seen.connType = request->requestedConnType();
+    for (size_t i = 0; i < request->headers(); i++) {
+        AsyncWebHeader *h = request->getHeader(i);
+        seen.headers.push_back({h->name().c_str(), h->value().c_str(), false});
+    }
+    for (size_t i = 0; i < request->params(); i++) {
+        AsyncWebParameter *p = request->getParam(i);
+        seen.params.push_back({p->name().c_str(), p->value().c_str(), p->isPost()});
+    }
+    request->send(200);
+}
+
+static std::mt19937 rng;
+
+static size_t pick(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); }
+static bool chance(int percent) { return (int)pick(100) < percent; }
+
+template <size_t N> static const char *oneOf(const char *const (&list)[N]) { return list[pick(N)]; }
+
+static std::string text(const char *alphabet, size_t maxLen)
+{
+    std::string s;
+    size_t len = pick(maxLen + 1), n = strlen(alphabet);
+    while (s.size() < len) {
+        s += alphabet[pick(n)];
+    }
+    return s;
+}
+
+// Names and values with escapes, broken escapes and the separators the parsers split on
+static std::string urlText(size_t maxLen)
+{
+    static const char *const pieces[] = {"%20", "%41", "%2F", "%3d", "%26", "%4", "%", "%zz", "+", "=", "~", "."};
+    std::string s;
+    size_t len = pick(maxLen + 1);
+    while (s.size() < len) {
+        s += chance(20) ? oneOf(pieces) : text("abcXYZ019-_", 3);
+    }
+    return s;
+}
+
+static std::string query(size_t maxParams)
+{
+    std::string q;
+    size_t n = 1 + pick(maxParams);
+    for (size_t i = 0; i < n; i++) {
+        q += i ? (chance(5) ? "&&" : "&") : "";
+        q += urlText(8);
+        if (!chance(10)) {
+            q += "=" + urlText(12);
+        }
+    }
+    return q + (chance(5) ? "&" : "");
+}
+
+static std::string formBody()
+{
+    static const char *const odd[] = {"{\"a\":1}", "[1,2]", "=x", "novalue", ""};
+    std::string body;
+    size_t n = 1 + pick(6);
+    for (size_t i = 0; i < n; i++) {
+        body += i ? "&" : "";
+        body += chance(15) ? std::string(oneOf(odd)) : urlText(8) + "=" + urlText(12);
+    }
+    return body;
+}
+
+static std::string header(const std::string &name, const std::string &value)
+{
+    static const char *const separators[] = {": ", ": ", ": ", ":", ":  "};
+    static const char *const endings[] = {"\r\n", "\r\n", "\r\n", "\n", " \r\n", "\t\r\n"};
+    return name + oneOf(separators) + value + oneOf(endings);
+}
+
+struct Generated
+{
+    std::string request;
+    bool hasBody;
+};
+
+static Generated generate()
+{
+    static const char *const methods[] = {"GET", "POST", "PUT", "DELETE", "PATCH", "HEAD", "OPTIONS", "get", "FOO"};
+    static const char *const versions[] = {"HTTP/1.1", "HTTP/1.1", "HTTP/1.0", "HTTP/1.0 ", "HTTP/2", ""};
+    static const char *const names[] = {"Host", "hOsT", "Accept", "Upgrade", "Expect", "Authorization", "User-Agent",
+                                        "X-Test", "Name With Space", "Connection", "If-None-Match", "Cookie"};
+    static const char *const values[] = {"text/event-stream", "text/html, Text/Event-Stream", "websocket", "WebSocket",
+                                         "100-continue", "100-Continue", "Basic YWRtaW46c2VjcmV0", "basic eA==",
+                                         "Digest username=\"a\"", "Basic", "Bearer token", "keep-alive"};
+    static const char *const types[] = {"application/x-www-form-urlencoded", "application/x-www-form-urlencoded; charset=UTF-8",
+                                        "text/plain", "text/plain;charset=utf-8", "application/json", "application/octet-stream"};
+    static const char *const colonless[] = {"Host", "Content-Length", "Garbage line", "X"};
+
+    std::string target = chance(5) ? "" : "/" + urlText(16);
+    if (chance(50)) {
+        target += "?" + query(6);
+    }
+    const char *space = chance(5) ? "  " : " ";
+    std::string request = std::string(oneOf(methods)) + space + target + " " + oneOf(versions) + "\r\n";
+
+    std::string body;
+    bool hasBody = chance(40);
+    if (hasBody) {
+        const char *type = oneOf(types);
+        body = strncmp(type, "text/plain", 10) == 0 && chance(50) ? text("abc=&{[ xyz", 30) : formBody();
+        if (body.empty()) {
+            body = "x";
+        }
+        request += header("Content-Type", type);
+    }
+    size_t n = pick(8);
+    size_t bodyAt = pick(n + 1);
+    for (size_t i = 0; i <= n; i++) {
+        if (hasBody && i == bodyAt) {
+            request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        if (i == n) {
+            break;
+        }
+        if (chance(4)) {
+            request += std::string(oneOf(colonless)) + "\r\n";
+        } else if (chance(3)) {
+            request += ":" + text("abc ", 6) + "\r\n";
+        } else {
+            request += header(oneOf(names), chance(50) ? oneOf(values) : text("abc XYZ:;=\"/,019", 30));
+        }
+    }
+    request += chance(10) ? "\n" : "\r\n";
+    return {request + body, hasBody};
+}
+
+// Cuts the request into up to five packets, sometimes one byte each
+static std::vector<std::string> packets(const std::string &request)
+{
+    std::vector<std::string> out;
+    if (chance(5)) {
+        for (char c : request) {
+            out.push_back(std::string(1, c));
+        }
+        return out;
+    }
+    std::vector<size_t> cuts = {0, request.size()};
+    for (size_t n = pick(5); n; n--) {
+        cuts.push_back(1 + pick(request.size() - 1));
+    }
+    std::sort(cuts.begin(), cuts.end());
+    for (size_t i = 1; i < cuts.size(); i++) {
+        if (cuts[i] > cuts[i - 1]) {
+            out.push_back(request.substr(cuts[i - 1], cuts[i] - cuts[i - 1]));
+        }
+    }
+    return out;
+}
+
+static std::string escaped(const std::string &s)
+{
+    std::string out;
+    for (char c : s) {
+        out += c == '\r' ? "\\r" : c == '\n' ? "\\n\n    " : std::string(1, c);
+    }
+    return out;
+}
+
+static void differ(std::vector<std::string> &diffs, const char *field, const std::string &before, const std::string &after)
+{
+    if (before != after) {
+        diffs.push_back(std::string(field) + ": \"" + before + "\" != \"" + after + "\"");
+    }
+}
+
+static std::string fields(const std::vector<Field> &list)
+{
+    std::string s;
+    for (const Field &f : list) {
+        s += "[" + f.name + "=" + f.value + (f.post ? " post" : "") + "]";
+    }
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    long requests = argc > 1 ? atol(argv[1]) : 100000;
+    rng.seed(argc > 2 ? atol(argv[2]) : 1);
+
+    AsyncWebServer server(80);
+    server.onNotFound(onRequest);
+
+    unsigned colonless = 0, failed = 0, handled = 0, bodies = 0;
+    for (long n = 0; n < requests; n++) {
+        Generated g = generate();
+        std::vector<std::string> split = packets(g.request);
+
+        OldRequest old;
+        for (std::string packet : split) {
+            old.onData(&packet[0], packet.size());
+        }
+        colonless += old.colonless;
+        handled += old.parsed.handled;
+        bodies += g.hasBody;
+
+        seen = {};
+        AsyncClient *client = new AsyncClient;
+        AsyncServer::listening()->accept(client);
+        for (std::string packet : split) {
+            client->receive(&packet[0], packet.size());
+        }
+        seen.expectingContinue = client->output.rfind("HTTP/1.1 100 Continue", 0) == 0;
+
+        // Basic credentials are only visible through authenticate(); the request lives until the
+        // peer hangs up below
+        if (seen.handled && !old.parsed.basicAuth.empty()) {
+            seen.basicAuth = lastRequest->authenticate(old.parsed.basicAuth.c_str()) ? old.parsed.basicAuth : "(rejected)";
+        }
+
+        const Parsed &a = old.parsed, &b = seen;
+        std::vector<std::string> diffs;
+        differ(diffs, "handled", a.handled ? "yes" : "no", b.handled ? "yes" : "no");
+        if (a.handled && b.handled) {
+            differ(diffs, "method", std::to_string(a.method), std::to_string(b.method));
+            differ(diffs, "version", std::to_string(a.version), std::to_string(b.version));
+            differ(diffs, "url", a.url, b.url);
+            differ(diffs, "host", a.host, b.host);
+            differ(diffs, "content type", a.contentType, b.contentType);
+            differ(diffs, "content length", std::to_string(a.contentLength), std::to_string(b.contentLength));
+            differ(diffs, "connection type", std::to_string(a.connType), std::to_string(b.connType));
+            differ(diffs, "basic credentials", a.basicAuth, b.basicAuth);
+            differ(diffs, "expect continue", a.expectingContinue ? "yes" : "no", b.expectingContinue ? "yes" : "no");
+            differ(diffs, "headers", fields(a.headers), fields(b.headers));
+            differ(diffs, "params", fields(a.params), fields(b.params));
+        }
+        if (!diffs.empty() && ++failed <= 5) {
+            printf("FAIL request %ld:\n    %s\n", n, escaped(g.request).c_str());
+            for (const std::string &d : diffs) {
+                printf("  %s\n", d.c_str());
+            }
+        }
+
+        while (client->inFlight) {
+            client->ack();
+        }
+        client->disconnect();
+    }
+    printf("%ld requests (%u with a body, %u answered), %u header lines without a colon, %u mismatches\n", requests,
+           bodies, handled, colonless, failed);
+    return failed ? 1 : 0;
+}
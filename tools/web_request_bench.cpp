@@ -0,0 +1,214 @@
+// Feeds HTTP requests through the web server's request parser (lib/ESPAsyncWebServer-master)
+// on a PC, checks the answers to requests that overflow its limits, and reports the time and
+// heap allocations it takes to parse typical requests. Build and run:
+//
+//   L=lib/ESPAsyncWebServer-master/src
+//   g++ -std=gnu++17 -O2 -DESP32 -I$L -Itools/host tools/web_request_bench.cpp $L/WebRequest.cpp $L/WebResponses.cpp $L/WebServer.cpp $L/WebHandlers.cpp -lpthread -o web_request_bench
+//   ./web_request_bench
+//
+// Allocations are counted at malloc, so they include the host String (std::string, which keeps
+// up to 15 characters inline where the ESP32 String keeps 11); compare runs, not absolutes.
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <ESPAsyncWebServer.h>
+
+// The parser only calls into authentication for handlers that ask for it
+bool checkBasicAuthentication(const char *, const char *, const char *) { return false; }
+String requestDigestAuthentication(const char *) { return String(); }
+bool checkDigestAuthentication(const char *, const char *, const char *, const char *, const char *, bool,
+                               const char *, const char *, const char *)
+{
+    return false;
+}
+
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+static size_t allocations;
+extern "C" void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t n, size_t size)
+{
+    allocations++;
+    return __libc_calloc(n, size);
+}
+extern "C" void *realloc(void *p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+// What the handler saw of the last request
+static struct
+{
+    bool called;
+    size_t allocations; // from the first byte received to the handler
+    std::chrono::steady_clock::time_point at;
+    std::string host, agent, dose, name, ssid, password;
+} seen;
+
+static void onRequest(AsyncWebServerRequest *request)
+{
+    seen.allocations = allocations;
+    seen.at = std::chrono::steady_clock::now();
+    seen.called = true;
+    seen.host = request->header("Host").c_str();
+    seen.agent = request->header("User-Agent").c_str();
+    if (request->hasParam("dose")) {
+        seen.dose = request->getParam("dose")->value().c_str();
+    }
+    seen.name = request->arg("name").c_str();
+    seen.ssid = request->arg("ssid").c_str();
+    seen.password = request->arg("password").c_str();
+    request->send(200, "text/plain", "ok");
+}
+
+// Runs one connection: the request arrives in pieces of `chunk` bytes (0 = all at once), the
+// answer is acknowledged and the peer hangs up. Returns the status line.
+static std::string exchange(const std::string &request, size_t chunk = 0)
+{
+    seen = {};
+    AsyncClient *client = new AsyncClient;
+    AsyncServer::listening()->accept(client);
+    allocations = 0;
+    for (size_t at = 0; at < request.size();) {
+        size_t n = chunk ? std::min(chunk, request.size() - at) : request.size();
+        client->receive(request.data() + at, n);
+        at += n;
+    }
+    while (client->inFlight) {
+        client->ack();
+    }
+    std::string answer = client->output.substr(0, client->output.find("\r\n"));
+    client->disconnect();
+    return answer;
+}
+
+static std::string get(const std::string &target, const std::string &headers = "")
+{
+    return "GET " + target + " HTTP/1.1\r\nHost: 192.168.4.1\r\n" + headers + "\r\n";
+}
+
+static std::string post(const std::string &target, const std::string &body)
+{
+    return "POST " + target + " HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+           "Content-Type: application/x-www-form-urlencoded\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static const std::string browserHeaders =
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Referer: http://192.168.4.1/\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n";
+
+static void testParsing()
+{
+    check(exchange(get("/api/status", browserHeaders)) == "HTTP/1.1 200 OK", "browser GET answered");
+    check(seen.host == "192.168.4.1" && seen.agent.rfind("Mozilla/5.0", 0) == 0, "header values");
+    check(exchange(get("/api/recipe?index=1&dose=18.5&name=Filter%20V60+x")) == "HTTP/1.1 200 OK", "query answered");
+    check(seen.dose == "18.5" && seen.name == "Filter V60 x", "query values decoded");
+    check(exchange(post("/api/wifi", "ssid=Home+Net&password=s%21cret")) == "HTTP/1.1 200 OK", "form answered");
+    check(seen.ssid == "Home Net" && seen.password == "s!cret", "form values decoded");
+    exchange(get("/api/status", browserHeaders), 7);
+    check(seen.called && seen.agent.rfind("Mozilla/5.0", 0) == 0, "request split into 7-byte packets");
+}
+
+static void testLimits()
+{
+    std::string many;
+    for (int i = 0; i < WEBSERVER_MAX_HEADERS; i++) {
+        many += "X-Header-" + std::to_string(i) + ": " + std::to_string(i) + "\r\n";
+    }
+    check(exchange(get("/api/status", many)).rfind("HTTP/1.1 431 ", 0) == 0 && !seen.called,
+          "more than WEBSERVER_MAX_HEADERS headers: 431");
+    std::string big = "X-Big: " + std::string(WEBSERVER_ARENA_SIZE, 'b') + "\r\n";
+    check(exchange(get("/api/status", big)).rfind("HTTP/1.1 431 ", 0) == 0 && !seen.called,
+          "header text larger than the arena: 431");
+    check(exchange(get("/api/recipe?name=" + std::string(WEBSERVER_ARENA_SIZE, 'q'))).rfind("HTTP/1.1 414 ", 0) == 0 &&
+              !seen.called,
+          "query larger than the arena: 414");
+    std::string params;
+    for (int i = 0; i <= WEBSERVER_MAX_PARAMS; i++) {
+        params += (i ? "&p" : "p") + std::to_string(i) + "=1";
+    }
+    check(exchange(get("/api/recipe?" + params)).rfind("HTTP/1.1 414 ", 0) == 0 && !seen.called,
+          "more than WEBSERVER_MAX_PARAMS query params: 414");
+    check(exchange(post("/api/wifi", "ssid=" + std::string(WEBSERVER_ARENA_SIZE, 's'))).rfind("HTTP/1.1 413 ", 0) == 0 &&
+              !seen.called,
+          "form body larger than the arena: 413");
+    check(exchange(get("/api/status", browserHeaders)) == "HTTP/1.1 200 OK", "next request unaffected");
+}
+
+// The route index follows a handler whose URI changes after it was added
+static void testRoutes(AsyncWebServer &server)
+{
+    AsyncCallbackWebHandler &moved = server.on("/api/old", HTTP_GET, onRequest);
+    moved.setUri("/api/moved");
+    check(exchange(get("/api/moved")) == "HTTP/1.1 200 OK" && seen.called, "handler found under its new URI");
+    exchange(get("/api/old"));
+    check(!seen.called, "old URI no longer served");
+    check(server.removeHandler(&moved), "handler removed"); // and deleted by the server
+    exchange(get("/api/moved"));
+    check(!seen.called, "removed handler no longer served");
+}
+
+static void bench(const char *label, const std::string &request)
+{
+    const int rounds = 20000;
+    double total = 0;
+    size_t allocs = 0;
+    for (int i = 0; i < rounds; i++) {
+        seen = {};
+        AsyncClient *client = new AsyncClient;
+        AsyncServer::listening()->accept(client);
+        allocations = 0;
+        auto start = std::chrono::steady_clock::now();
+        client->receive(request.data(), request.size());
+        total += std::chrono::duration<double, std::micro>(seen.at - start).count();
+        allocs += seen.allocations;
+        while (client->inFlight) {
+            client->ack();
+        }
+        client->disconnect();
+    }
+    printf("%-22s %4zu bytes  %6.2f us  %5.1f allocations to the handler\n", label, request.size(),
+           total / rounds, (double)allocs / rounds);
+}
+
+int main()
+{
+    AsyncWebServer server(80);
+    server.on("/api/status", HTTP_GET, onRequest);
+    server.on("/api/recipe", HTTP_GET, onRequest);
+    server.on("/api/wifi", HTTP_POST, onRequest);
+
+    testParsing();
+    testLimits();
+    testRoutes(server);
+
+    bench("browser GET", get("/api/status", browserHeaders));
+    bench("GET with query", get("/api/recipe?index=1&dose=18.5&name=Filter%20V60"));
+    bench("form POST", post("/api/wifi", "ssid=Home+Net&password=s%21cret"));
+
+    printf("%s: %d failed\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+// Sends web server responses (lib/ESPAsyncWebServer-master) through a client on a PC whose
+// send window is small and whose add() takes fewer bytes than it has room for, or none at all,
+// as lwIP does when it runs short of buffers. Every body has to arrive intact, and a source
+// that ends before its Content-Length has to close the connection instead of spinning.
+// Build and run:
+//
+//   L=lib/ESPAsyncWebServer-master/src
+//   g++ -std=gnu++17 -O2 -DESP32 -I$L -Itools/host tools/web_response_test.cpp $L/WebRequest.cpp $L/WebResponses.cpp $L/WebServer.cpp $L/WebHandlers.cpp -lpthread -o web_response_test
+//   ./web_response_test
+//
+// A response that spins trips the alarm and the run ends with "Alarm clock".
+
+#include <string>
+#include <unistd.h>
+
+#include <ESPAsyncWebServer.h>
+
+// The parser only calls into authentication for handlers that ask for it
+bool checkBasicAuthentication(const char *, const char *, const char *) { return false; }
+String requestDigestAuthentication(const char *) { return String(); }
+bool checkDigestAuthentication(const char *, const char *, const char *, const char *, const char *, bool,
+                               const char *, const char *, const char *)
+{
+    return false;
+}
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static std::string content(size_t len)
+{
+    std::string s;
+    for (size_t i = 0; i < len; i++) {
+        s += 'a' + i * 7 % 26;
+    }
+    return s;
+}
+
+static const std::string body = content(20000);
+static const uint8_t flashBody[] PROGMEM = "stored in flash, sent straight from there without a copy";
+
+// Fills from `body`, stopping at `end`
+static AwsResponseFiller filler(size_t end)
+{
+    return [end](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+        size_t n = index < end ? std::min(maxLen, end - index) : 0;
+        memcpy(buf, body.data() + index, n);
+        return n;
+    };
+}
+
+struct Result
+{
+    std::string head, body;
+    bool closed;
+};
+
+// Runs one request against a client with the given window and add() limit, acking and polling
+// until the response has gone out or nothing moves any more
+static Result exchange(const char *path, size_t window, size_t addLimit, int stalls = 0)
+{
+    AsyncClient *client = new AsyncClient;
+    client->window = window;
+    client->addLimit = stalls ? 0 : addLimit;
+    AsyncServer::listening()->accept(client);
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: scale\r\n\r\n";
+    client->receive(request.data(), request.size());
+    for (int idle = 0; idle < 3;) {
+        size_t before = client->output.size();
+        if (stalls && --stalls == 0) {
+            client->addLimit = addLimit;
+        }
+        client->ack();
+        client->poll();
+        idle = client->output.size() == before && !client->inFlight && !stalls ? idle + 1 : 0;
+    }
+    Result r;
+    size_t split = client->output.find("\r\n\r\n");
+    r.head = client->output.substr(0, split);
+    r.body = split == std::string::npos ? "" : client->output.substr(split + 4);
+    r.closed = !client->connected();
+    client->disconnect();
+    return r;
+}
+
+static std::string unchunk(const std::string &s)
+{
+    std::string out;
+    size_t at = 0;
+    while (at < s.size()) {
+        size_t len = strtoul(s.c_str() + at, nullptr, 16);
+        at = s.find("\r\n", at) + 2;
+        out += s.substr(at, len);
+        at += len + 2;
+        if (!len) {
+            break;
+        }
+    }
+    return out;
+}
+
+int main()
+{
+    alarm(20);
+    AsyncWebServer server(80);
+    server.on("/length", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(request->beginResponse("text/plain", body.size(), filler(body.size())));
+    });
+    server.on("/chunked", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(request->beginChunkedResponse("text/plain", filler(body.size())));
+    });
+    server.on("/short", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(request->beginResponse("text/plain", body.size(), filler(3000)));
+    });
+    server.on("/flash", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send_P(200, "text/plain", flashBody, sizeof(flashBody) - 1);
+    });
+
+    Result r = exchange("/length", 5744, SIZE_MAX);
+    check(r.body == body, "Content-Length body, whole window");
+    r = exchange("/length", 1000, 300);
+    check(r.body == body, "Content-Length body, add() takes 300 of 1000 bytes");
+    r = exchange("/length", 1000, 1);
+    check(r.body == body, "Content-Length body, add() takes one byte at a time");
+    r = exchange("/length", 1000, 300, 5);
+    check(r.body == body, "Content-Length body, add() takes nothing for a while");
+    r = exchange("/chunked", 700, 250);
+    check(unchunk(r.body) == body && r.body.size() > body.size(), "chunked body, add() takes 250 of 700 bytes");
+    r = exchange("/chunked", 700, 250, 5);
+    check(unchunk(r.body) == body, "chunked body, add() takes nothing for a while");
+    r = exchange("/flash", 20, 7);
+    check(r.body == (const char *)flashBody, "flash body sent in place, add() takes 7 of 20 bytes");
+    r = exchange("/short", 5744, SIZE_MAX);
+    check(r.closed && r.body == body.substr(0, 3000), "source short of Content-Length: connection closed");
+
+    printf("%s: %d failed\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}